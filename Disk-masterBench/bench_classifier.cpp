@@ -0,0 +1,106 @@
+// Disk-masterBench/bench_classifier.cpp
+// 文件名分类微基准：每秒分类次数 (原实现 vs 反向后缀树)，并校验两者结果一致
+#include "disk_cleaner.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cctype>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// --- 原实现 (逐个后缀 compare + 五个 unordered_set 查询)，作为对比基准 ---
+static std::unordered_set<std::string> g_package_exts = {".deb", ".rpm", ".pkg", ".appimage"};
+static std::unordered_set<std::string> g_video_exts = {".mp4", ".mkv", ".avi", ".mov", ".wmv", ".flv", ".webm",
+                                                       ".3gp", ".m4v", ".mpg", ".rmvb", ".rm", ".vob", ".mpeg"};
+static std::unordered_set<std::string> g_audio_exts = {".mp3", ".wav", ".flac", ".aac", ".ogg", ".m4a", ".wma"};
+static std::unordered_set<std::string> g_image_exts = {".jpg", ".jpeg", ".png", ".gif", ".bmp", ".tiff", ".svg", ".webp"};
+static std::unordered_set<std::string> g_document_exts = {".pdf", ".doc", ".docx", ".xls", ".xlsx", ".ppt", ".pptx"};
+static std::vector<std::string> g_compressed_endings = {
+    ".tar.gz", ".tar.bz2", ".tar.xz", ".tgz",
+    ".zip", ".rar", ".7z", ".gz", ".bz2", ".xz", ".tar"
+};
+
+static FileCategory baseline_get_file_category(const fs::path& path) {
+    std::string filename = path.filename().string();
+    std::transform(filename.begin(), filename.end(), filename.begin(), ::tolower);
+    for (const auto& ending : g_compressed_endings) {
+        if (filename.length() >= ending.length() &&
+            filename.compare(filename.length() - ending.length(), ending.length(), ending) == 0) {
+            return CATEGORY_COMPRESSED;
+        }
+    }
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (g_package_exts.count(ext)) return CATEGORY_PACKAGES;
+    if (g_video_exts.count(ext)) return CATEGORY_VIDEO;
+    if (g_audio_exts.count(ext)) return CATEGORY_AUDIO;
+    if (g_image_exts.count(ext)) return CATEGORY_IMAGE;
+    if (g_document_exts.count(ext)) return CATEGORY_DOCUMENT;
+    return CATEGORY_UNKNOWN;
+}
+
+// 生成与真实主目录相近的文件名：大部分是无关文件，少量命中各分类，大小写混合
+static std::vector<std::string> make_names(size_t count) {
+    static const char* exts[] = {
+        ".txt", ".cpp", ".h", ".json", ".js", ".py", ".o", ".so", ".log", ".conf", ".xml", ".html", ".css", "",
+        ".mp4", ".MKV", ".mp3", ".Flac", ".jpg", ".PNG", ".pdf", ".docx", ".deb", ".AppImage",
+        ".zip", ".tar.gz", ".TAR.XZ", ".gz", ".7z", ".tar.mp4", ".gz.txt", ".rm", ".rmvb"
+    };
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> ext_dist(0, sizeof(exts) / sizeof(exts[0]) - 1);
+    std::uniform_int_distribution<int> len_dist(3, 24);
+    std::uniform_int_distribution<int> char_dist('a', 'z');
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string name;
+        int len = len_dist(rng);
+        for (int j = 0; j < len; ++j) name.push_back(static_cast<char>(char_dist(rng)));
+        if (i % 7 == 0) name.push_back('.'), name.append(std::to_string(i % 100));
+        name.append(exts[ext_dist(rng)]);
+        names.push_back(name);
+    }
+    return names;
+}
+
+template <typename Fn>
+static double measure(const std::vector<std::string>& names, int rounds, Fn fn, unsigned& sink) {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (const auto& name : names) sink += fn(name);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(names.size()) * rounds / seconds;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 200000;
+    int rounds = argc > 2 ? std::stoi(argv[2]) : 10;
+    std::vector<std::string> names = make_names(count);
+
+    size_t mismatches = 0;
+    for (const auto& name : names) {
+        if (baseline_get_file_category(fs::path(name)) != ClassifyFileName(name.c_str())) {
+            if (mismatches++ < 10) std::cerr << "mismatch: " << name << std::endl;
+        }
+    }
+
+    unsigned sink = 0;
+    double before = measure(names, rounds, [](const std::string& n) {
+        return static_cast<unsigned>(baseline_get_file_category(fs::path(n)));
+    }, sink);
+    double after = measure(names, rounds, [](const std::string& n) {
+        return static_cast<unsigned>(ClassifyFileName(n.c_str()));
+    }, sink);
+
+    std::cout << "names: " << count << ", rounds: " << rounds << ", mismatches: " << mismatches << "\n";
+    std::cout << "baseline (transform + unordered_set): " << before / 1e6 << " M classifications/s\n";
+    std::cout << "suffix trie:                          " << after / 1e6 << " M classifications/s\n";
+    std::cout << "speedup: " << after / before << "x (sink " << sink << ")\n";
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+// Disk-masterBench/bench_results.cpp
+// 结果收集的竞争基准 (1/4/16 线程)：
+//   1. 写入路径微基准：原实现 (全局互斥锁 + 每文件 new 路径 + 共享原子计数) 与按线程分片的写法对比
+//   2. 端到端：在合成目录树上用不同的工作线程数调用 StartScan，统计每秒文件数
+#include "disk_cleaner.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// --- 原实现的写入路径：所有线程共用一把锁、一组 vector 和一个原子计数 ---
+struct BaselineCollector {
+    std::mutex mutex;
+    std::vector<FileInfo> files[6];
+    std::atomic<uint64_t> total{ 0 };
+
+    void add(int, const std::string& path, uint64_t size, int slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        char* copy = new char[path.size() + 1];
+        memcpy(copy, path.c_str(), path.size() + 1);
+        files[slot].push_back(FileInfo{ copy, size, CATEGORY_VIDEO });
+        total += size;
+    }
+
+    ~BaselineCollector() {
+        for (auto& v : files) for (auto& f : v) delete[] f.path;
+    }
+};
+
+// --- 分片写法：每个线程一把只有自己会拿的锁、按块分配的名字存储和本地计数 (按缓存行对齐，避免伪共享) ---
+struct alignas(64) Shard {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t used = 1 << 20;
+    std::vector<const char*> names[6];
+    std::vector<uint64_t> sizes[6];
+    std::atomic<uint64_t> total{ 0 };
+
+    const char* store(const std::string& s) {
+        if (used + s.size() + 1 > (1u << 20)) {
+            blocks.emplace_back(new char[1 << 20]);
+            used = 0;
+        }
+        char* p = blocks.back().get() + used;
+        memcpy(p, s.c_str(), s.size() + 1);
+        used += s.size() + 1;
+        return p;
+    }
+};
+
+struct ShardedCollector {
+    std::vector<std::unique_ptr<Shard>> shards;
+    explicit ShardedCollector(int n) { for (int i = 0; i < n; ++i) shards.emplace_back(new Shard()); }
+
+    void add(int thread, const std::string& name, uint64_t size, int slot) {
+        Shard& s = *shards[thread];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.names[slot].push_back(s.store(name));
+        s.sizes[slot].push_back(size);
+        s.total.store(s.total.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+    }
+};
+
+template <typename Collector>
+static double run_collect(Collector& collector, int threads, size_t per_thread) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&collector, t, per_thread]() {
+            std::string path = "/home/user/project/module/file_000000.mp4";
+            for (size_t i = 0; i < per_thread; ++i) {
+                path[path.size() - 7] = static_cast<char>('0' + i % 10);
+                collector.add(t, path, i, static_cast<int>(i % 6));
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(per_thread) * threads / seconds;
+}
+
+// 合成目录树：dirs 个目录，每个目录 files_per_dir 个文件，其中一半命中分类
+static void make_tree(const fs::path& root, int dirs, int files_per_dir) {
+    static const char* exts[] = { ".mp4", ".txt", ".jpg", ".cpp", ".pdf", ".o", ".zip", ".json" };
+    for (int d = 0; d < dirs; ++d) {
+        fs::path dir = root / ("group_" + std::to_string(d % 16)) / ("dir_" + std::to_string(d));
+        fs::create_directories(dir);
+        for (int f = 0; f < files_per_dir; ++f) {
+            std::ofstream(dir / ("file_" + std::to_string(f) + exts[f % 8]));
+        }
+    }
+}
+
+static double run_scan(const fs::path& root, int threads, int& found) {
+    SetScanWorkerCount(threads);
+    SetScanBackend(SCAN_BACKEND_GETDENTS);
+    auto start = std::chrono::steady_clock::now();
+    StartScan(root.c_str(), nullptr);
+    while (!IsScanFinished()) usleep(500);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    found = 0;
+    for (FileCategory c : { CATEGORY_PACKAGES, CATEGORY_COMPRESSED, CATEGORY_VIDEO, CATEGORY_AUDIO,
+                            CATEGORY_IMAGE, CATEGORY_DOCUMENT }) {
+        ScanSnapshot* snap = AcquireScanSnapshot(c);
+        found += static_cast<int>(GetScanSnapshotCount(snap));
+        ReleaseScanSnapshot(snap);
+    }
+    return seconds;
+}
+
+int main(int argc, char** argv) {
+    size_t per_thread = argc > 1 ? std::stoul(argv[1]) : 200000;
+    int dirs = argc > 2 ? std::stoi(argv[2]) : 2000;
+    const int thread_counts[] = { 1, 4, 16 };
+
+    std::cout << "CPU 核心数: " << std::thread::hardware_concurrency() << "\n";
+    std::cout << "[写入路径] 每线程 " << per_thread << " 条记录 (百万条/秒)\n";
+    for (int threads : thread_counts) {
+        double baseline, sharded;
+        {
+            BaselineCollector c;
+            baseline = run_collect(c, threads, per_thread);
+        }
+        {
+            ShardedCollector c(threads);
+            sharded = run_collect(c, threads, per_thread);
+        }
+        std::cout << "  threads " << threads << ": 全局锁 " << baseline / 1e6 << ", 分片 " << sharded / 1e6
+                  << " (" << sharded / baseline << "x)\n";
+    }
+
+    fs::path base = fs::exists("/dev/shm") ? fs::path("/dev/shm") : fs::temp_directory_path();
+    fs::path root = base / ("disk-cleaner-bench-" + std::to_string(getpid()));
+    make_tree(root, dirs, 100);
+    std::cout << "[端到端扫描] " << root << ": " << dirs << " 个目录, " << dirs * 100 << " 个文件\n";
+    for (int threads : thread_counts) {
+        int found = 0;
+        run_scan(root, threads, found); // 预热目录缓存
+        double seconds = run_scan(root, threads, found);
+        std::cout << "  threads " << threads << ": " << seconds * 1000 << " ms, "
+                  << dirs * 100 / seconds / 1e6 << " M files/s, 命中 " << found << "\n";
+    }
+    CleanupScanner();
+    fs::remove_all(root);
+    return 0;
+}
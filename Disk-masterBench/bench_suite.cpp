@@ -0,0 +1,480 @@
+// Disk-masterBench/bench_suite.cpp
+// 回归基准套件：用固定种子生成一棵模拟主目录的合成目录树，依次测量
+//   get_file_category / ClassifyFileName、StartScan (各遍历后端及 inode 顺序)、GetScanResults、
+//   CleanupCategories、MigrateCategories、CleanupDirectory，
+// 每项输出每秒文件数、每个文件的系统调用数 (库内部计数，只有扫描有) 和峰值 RSS，结果写成 JSON 便于比较。
+//
+// 用法: bench_suite [--root DIR] [--depth N] [--fanout N] [--files N] [--hidden-ratio R]
+//                   [--ext-mix video=2,image=4,...,other=20] [--movefiles N] [--cache-files N]
+//                   [--max-size BYTES] [--write-data] [--cold] [--seed N] [--repeat N] [--threads N] [--json FILE]
+// 默认在 /dev/shm (tmpfs) 下生成，--root 可指定其它文件系统上的目录 (会被清空后使用)。
+// --cold 在每次计时扫描前清空页缓存 (需要 root)，用于在磁盘 (或 loop 挂载的 ext4 镜像) 上比较冷缓存下的遍历顺序。
+// 破坏性的测试 (清理、搬迁) 之前都会用同一种子重新生成目录树，生成时间不计入结果。
+#include "disk_cleaner.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+namespace fs = std::filesystem;
+
+// 库中按路径分类的 C++ 接口 (扫描 std::filesystem 后端使用)，头文件中没有声明
+FileCategory get_file_category(const fs::path& path, const fs::path& trash_path);
+
+struct Config {
+    fs::path root;
+    int depth = 3;              // 目录层数 (不含根目录)
+    int fanout = 6;             // 每个目录的子目录数
+    int files = 40;             // 每个目录的文件数
+    double hidden_ratio = 0.1;  // 子目录为隐藏目录的比例 (扫描时整棵剪枝)
+    std::string ext_mix = "packages=1,compressed=1,video=2,audio=2,image=4,document=3,other=20";
+    int movefiles = 500;        // MoveFiles 子树中的文件数 (搬迁时应被排除)
+    int cache_files = 2000;     // .cache 和回收站中的文件数
+    uint64_t max_size = 64 * 1024;
+    bool write_data = false;    // 默认用 ftruncate 生成稀疏文件，只有大小没有数据
+    bool cold = false;          // 每次计时扫描前清空页缓存
+    uint64_t seed = 20240601;
+    int repeat = 3;
+    int threads = 0;
+    std::string json = "bench_suite.json";
+};
+
+struct TreeStats {
+    uint64_t files = 0;          // 生成的全部文件
+    uint64_t visible_files = 0;  // 扫描可见的文件 (不在隐藏目录下)
+    uint64_t dirs = 0;
+    uint64_t bytes = 0;
+    std::vector<std::string> names; // 所有文件名，用于分类微基准
+};
+
+// --- 扩展名组合 ---
+struct ExtGroup {
+    const char* name;
+    std::vector<const char*> exts;
+    int weight;
+};
+
+static std::vector<ExtGroup> parse_ext_mix(const std::string& spec) {
+    std::vector<ExtGroup> groups = {
+        { "packages", { ".deb", ".rpm", ".AppImage" }, 0 },
+        { "compressed", { ".zip", ".tar.gz", ".7z", ".tar.xz" }, 0 },
+        { "video", { ".mp4", ".mkv", ".MOV" }, 0 },
+        { "audio", { ".mp3", ".flac", ".ogg" }, 0 },
+        { "image", { ".jpg", ".png", ".webp", ".JPG" }, 0 },
+        { "document", { ".pdf", ".docx", ".xlsx" }, 0 },
+        { "other", { ".txt", ".cpp", ".h", ".json", ".log", ".o", ".so", "" }, 0 },
+    };
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) continue;
+        for (auto& g : groups) {
+            if (item.compare(0, eq, g.name) == 0) g.weight = std::max(0, std::stoi(item.substr(eq + 1)));
+        }
+    }
+    return groups;
+}
+
+// --- 合成目录树生成 ---
+class TreeGenerator {
+public:
+    explicit TreeGenerator(const Config& config)
+        : config_(config), groups_(parse_ext_mix(config.ext_mix)) {
+        for (const auto& g : groups_) total_weight_ += g.weight;
+        if (total_weight_ == 0) throw std::runtime_error("--ext-mix 的权重之和不能为 0");
+    }
+
+    TreeStats generate() {
+        rng_.seed(config_.seed);
+        stats_ = TreeStats();
+        std::error_code ec;
+        fs::remove_all(config_.root, ec);
+        fs::create_directories(config_.root);
+        make_dir(config_.root, 0, true);
+
+        // 已经搬迁过的文件 (MoveFiles 下的文件不参与搬迁)
+        fill_flat(config_.root / "MoveFiles" / "old", config_.movefiles, true, "moved");
+        // 应用缓存、缩略图和回收站 (隐藏目录，扫描不可见，但会被 CleanupCategories 删除)
+        int per_bucket = config_.cache_files / 4;
+        fill_flat(config_.root / ".cache" / "app-a" / "blobs", per_bucket, false, "cache");
+        fill_flat(config_.root / ".cache" / "app-b", per_bucket, false, "cache");
+        fill_flat(config_.root / ".cache" / "thumbnails" / "normal", per_bucket, false, "thumb");
+        fill_flat(config_.root / ".local" / "share" / "Trash" / "files", config_.cache_files - 3 * per_bucket, false, "trash");
+        fs::create_directories(config_.root / ".local" / "share" / "Trash" / "info");
+        return stats_;
+    }
+
+private:
+    void make_dir(const fs::path& dir, int level, bool visible) {
+        fs::create_directories(dir);
+        // 文件名带上目录序号：搬迁到同一目标目录时不会因重名而失败
+        const std::string prefix = "file_" + std::to_string(stats_.dirs++) + "_";
+        for (int i = 0; i < config_.files; ++i) {
+            make_file(dir / (prefix + std::to_string(i) + random_ext()), visible);
+        }
+        if (level >= config_.depth) return;
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        for (int i = 0; i < config_.fanout; ++i) {
+            bool hidden = coin(rng_) < config_.hidden_ratio;
+            std::string name = (hidden ? ".hidden_" : "dir_") + std::to_string(level) + "_" + std::to_string(i);
+            make_dir(dir / name, level + 1, visible && !hidden);
+        }
+    }
+
+    void fill_flat(const fs::path& dir, int count, bool visible, const char* prefix) {
+        fs::create_directories(dir);
+        for (int i = 0; i < count; ++i) {
+            make_file(dir / (std::string(prefix) + "_" + std::to_string(i) + random_ext()), visible);
+        }
+    }
+
+    std::string random_ext() {
+        std::uniform_int_distribution<int> pick(0, total_weight_ - 1);
+        int r = pick(rng_);
+        for (const auto& g : groups_) {
+            if (r < g.weight) {
+                std::uniform_int_distribution<size_t> e(0, g.exts.size() - 1);
+                return g.exts[e(rng_)];
+            }
+            r -= g.weight;
+        }
+        return "";
+    }
+
+    void make_file(const fs::path& path, bool visible) {
+        std::uniform_int_distribution<uint64_t> size_dist(0, config_.max_size);
+        uint64_t size = size_dist(rng_);
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) throw std::runtime_error("无法创建 " + path.string() + ": " + strerror(errno));
+        if (config_.write_data) {
+            std::vector<char> buffer(static_cast<size_t>(std::min<uint64_t>(size, 1 << 20)), 'x');
+            for (uint64_t left = size; left > 0;) {
+                ssize_t n = write(fd, buffer.data(), static_cast<size_t>(std::min<uint64_t>(left, buffer.size())));
+                if (n <= 0) break;
+                left -= static_cast<uint64_t>(n);
+            }
+        } else if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            size = 0;
+        }
+        close(fd);
+        stats_.files++;
+        stats_.bytes += size;
+        if (visible) stats_.visible_files++;
+        stats_.names.push_back(path.filename().string());
+    }
+
+    const Config& config_;
+    std::vector<ExtGroup> groups_;
+    int total_weight_ = 0;
+    std::mt19937_64 rng_;
+    TreeStats stats_;
+};
+
+// --- 计时与资源统计 ---
+struct Result {
+    std::string name;
+    uint64_t files = 0;
+    double seconds = 0;
+    double syscalls_per_file = -1; // < 0 表示没有计数
+    long peak_rss_kb = 0;
+    std::string extra;             // 附加的 JSON 字段 (以逗号开头)
+};
+
+// 清零峰值 RSS (Linux 4.0+ 支持写入 5)，失败时退回整个进程生命周期的峰值
+static void reset_peak_rss() {
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+static long peak_rss_kb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) return std::stol(line.substr(6));
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static double now_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 写回脏页后丢弃页缓存、dentry 和 inode 缓存
+static bool drop_caches() {
+    sync();
+    std::ofstream out("/proc/sys/vm/drop_caches");
+    out << "3";
+    out.flush();
+    return static_cast<bool>(out);
+}
+
+static void wait_scan() {
+    while (!IsScanFinished()) usleep(200);
+}
+
+static const FileCategory kScanned[] = { CATEGORY_PACKAGES, CATEGORY_COMPRESSED, CATEGORY_VIDEO,
+                                         CATEGORY_AUDIO, CATEGORY_IMAGE, CATEGORY_DOCUMENT };
+
+static uint64_t result_count(unsigned int mask) {
+    uint64_t total = 0;
+    for (FileCategory c : kScanned) {
+        if (!(mask & c)) continue;
+        ScanSnapshot* snap = AcquireScanSnapshot(c);
+        total += GetScanSnapshotCount(snap);
+        ReleaseScanSnapshot(snap);
+    }
+    return total;
+}
+
+// --- 各项测试 ---
+static Result bench_classify(const TreeStats& tree, bool by_path) {
+    Result r;
+    r.name = by_path ? "get_file_category" : "ClassifyFileName";
+    std::vector<fs::path> paths;
+    if (by_path) {
+        for (const auto& n : tree.names) paths.emplace_back("/home/bench/dir/" + n);
+    }
+    unsigned sink = 0;
+    reset_peak_rss();
+    double start = now_seconds();
+    int rounds = 0;
+    do {
+        if (by_path) {
+            for (const auto& p : paths) sink += get_file_category(p, fs::path());
+        } else {
+            for (const auto& n : tree.names) sink += ClassifyFileName(n.c_str());
+        }
+        ++rounds;
+    } while (now_seconds() - start < 0.3);
+    r.seconds = now_seconds() - start;
+    r.files = tree.names.size() * static_cast<uint64_t>(rounds);
+    r.peak_rss_kb = peak_rss_kb();
+    r.extra = ",\"checksum\":" + std::to_string(sink);
+    return r;
+}
+
+static Result bench_scan(const Config& config, const TreeStats& tree, const char* name, ScanBackend backend, int io_uring,
+                         ScanInodeOrder order = SCAN_INODE_ORDER_OFF) {
+    Result r;
+    r.name = name;
+    SetScanBackend(backend);
+    SetScanIoUring(io_uring);
+    SetScanInodeOrder(order);
+    if (!config.cold) {
+        StartScan(config.root.c_str(), nullptr); // 预热目录缓存
+        wait_scan();
+    }
+    std::vector<double> times;
+    ScanSyscallStats stats;
+    reset_peak_rss();
+    for (int i = 0; i < config.repeat; ++i) {
+        if (config.cold && !drop_caches()) {
+            std::cerr << "[bench_suite] 无法写入 /proc/sys/vm/drop_caches，--cold 需要 root 权限" << std::endl;
+        }
+        double start = now_seconds();
+        StartScan(config.root.c_str(), nullptr);
+        wait_scan();
+        times.push_back(now_seconds() - start);
+    }
+    GetScanSyscallStats(&stats);
+    std::sort(times.begin(), times.end());
+    r.seconds = times[times.size() / 2]; // 中位数
+    r.files = tree.visible_files;
+    r.syscalls_per_file = tree.visible_files ? static_cast<double>(stats.total_syscalls) / tree.visible_files : 0;
+    r.peak_rss_kb = peak_rss_kb();
+    r.extra = ",\"dirs_scanned\":" + std::to_string(stats.dirs_scanned) +
+              ",\"results\":" + std::to_string(result_count(~0u)) +
+              ",\"min_seconds\":" + std::to_string(times.front());
+    return r;
+}
+
+static Result bench_get_results(const Config& config) {
+    Result r;
+    r.name = "GetScanResults";
+    StartScan(config.root.c_str(), nullptr);
+    wait_scan();
+    std::vector<double> times;
+    reset_peak_rss();
+    for (int i = 0; i < config.repeat; ++i) {
+        uint64_t files = 0;
+        double start = now_seconds();
+        for (FileCategory c : kScanned) {
+            int count = 0;
+            FileInfo* results = GetScanResults(c, &count);
+            files += static_cast<uint64_t>(count);
+            FreeScanResults(results, count);
+        }
+        times.push_back(now_seconds() - start);
+        r.files = files;
+    }
+    std::sort(times.begin(), times.end());
+    r.seconds = times[times.size() / 2];
+    r.peak_rss_kb = peak_rss_kb();
+    return r;
+}
+
+static Result bench_cleanup_categories(const Config& config, TreeGenerator& generator) {
+    Result r;
+    r.name = "CleanupCategories";
+    generator.generate();
+    StartScan(config.root.c_str(), nullptr);
+    wait_scan();
+    const unsigned int mask = CATEGORY_PACKAGES | CATEGORY_COMPRESSED | CATEGORY_TRASH |
+                              CATEGORY_THUMBNAIL_CACHE | CATEGORY_OTHER_APP_CACHE;
+    r.files = result_count(mask) + static_cast<uint64_t>(config.cache_files);
+    reset_peak_rss();
+    double start = now_seconds();
+    uint64_t freed = CleanupCategories(mask);
+    r.seconds = now_seconds() - start;
+    r.peak_rss_kb = peak_rss_kb();
+    r.extra = ",\"bytes_freed\":" + std::to_string(freed);
+    return r;
+}
+
+static Result bench_migrate(const Config& config, TreeGenerator& generator) {
+    Result r;
+    r.name = "MigrateCategories";
+    generator.generate();
+    StartScan(config.root.c_str(), nullptr);
+    wait_scan();
+    const unsigned int mask = CATEGORY_VIDEO | CATEGORY_AUDIO | CATEGORY_IMAGE | CATEGORY_DOCUMENT;
+    std::string dest = (config.root / "MoveFiles" / "bench").string();
+    reset_peak_rss();
+    double start = now_seconds();
+    int rc = MigrateCategories(mask, dest.c_str());
+    r.seconds = now_seconds() - start;
+    r.peak_rss_kb = peak_rss_kb();
+    MigrationStats stats;
+    GetLastMigrationStats(&stats);
+    r.files = stats.files_moved; // 只计实际搬走的文件，失败的不计入吞吐量
+    r.extra = ",\"status\":" + std::to_string(rc) + ",\"files_moved\":" + std::to_string(stats.files_moved) +
+              ",\"files_failed\":" + std::to_string(stats.files_failed) + ",\"bytes_moved\":" + std::to_string(stats.bytes_moved);
+    return r;
+}
+
+static Result bench_cleanup_directory(const Config& config, TreeGenerator& generator) {
+    Result r;
+    r.name = "CleanupDirectory";
+    TreeStats tree = generator.generate();
+    r.files = tree.files;
+    reset_peak_rss();
+    double start = now_seconds();
+    uint64_t freed = CleanupDirectory(config.root.c_str());
+    r.seconds = now_seconds() - start;
+    r.peak_rss_kb = peak_rss_kb();
+    r.extra = ",\"bytes_freed\":" + std::to_string(freed);
+    return r;
+}
+
+static void write_json(const Config& config, const TreeStats& tree, const std::vector<Result>& results) {
+    std::ofstream out(config.json);
+    out << "{\n  \"config\": {\"root\":\"" << config.root.string() << "\",\"depth\":" << config.depth
+        << ",\"fanout\":" << config.fanout << ",\"files_per_dir\":" << config.files
+        << ",\"hidden_ratio\":" << config.hidden_ratio << ",\"ext_mix\":\"" << config.ext_mix
+        << "\",\"movefiles\":" << config.movefiles << ",\"cache_files\":" << config.cache_files
+        << ",\"max_size\":" << config.max_size << ",\"write_data\":" << (config.write_data ? "true" : "false")
+        << ",\"cold\":" << (config.cold ? "true" : "false")
+        << ",\"seed\":" << config.seed << ",\"repeat\":" << config.repeat << ",\"threads\":" << config.threads << "},\n";
+    out << "  \"tree\": {\"files\":" << tree.files << ",\"visible_files\":" << tree.visible_files
+        << ",\"dirs\":" << tree.dirs << ",\"bytes\":" << tree.bytes << "},\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        out << "    {\"name\":\"" << r.name << "\",\"files\":" << r.files << ",\"seconds\":" << r.seconds
+            << ",\"files_per_sec\":" << (r.seconds > 0 ? r.files / r.seconds : 0) << ",\"syscalls_per_file\":";
+        if (r.syscalls_per_file < 0) out << "null"; else out << r.syscalls_per_file;
+        out << ",\"peak_rss_kb\":" << r.peak_rss_kb << r.extra << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+static bool parse_args(int argc, char** argv, Config& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--write-data") {
+            config.write_data = true;
+            continue;
+        }
+        if (arg == "--cold") {
+            config.cold = true;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--root") config.root = value;
+        else if (arg == "--depth") config.depth = std::stoi(value);
+        else if (arg == "--fanout") config.fanout = std::stoi(value);
+        else if (arg == "--files") config.files = std::stoi(value);
+        else if (arg == "--hidden-ratio") config.hidden_ratio = std::stod(value);
+        else if (arg == "--ext-mix") config.ext_mix = value;
+        else if (arg == "--movefiles") config.movefiles = std::stoi(value);
+        else if (arg == "--cache-files") config.cache_files = std::stoi(value);
+        else if (arg == "--max-size") config.max_size = std::stoull(value);
+        else if (arg == "--seed") config.seed = std::stoull(value);
+        else if (arg == "--repeat") config.repeat = std::max(1, std::stoi(value));
+        else if (arg == "--threads") config.threads = std::stoi(value);
+        else if (arg == "--json") config.json = value;
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Config config;
+    if (!parse_args(argc, argv, config)) {
+        std::cerr << "用法见 bench_suite.cpp 文件头注释" << std::endl;
+        return 2;
+    }
+    if (config.root.empty()) {
+        fs::path base = fs::exists("/dev/shm") ? fs::path("/dev/shm") : fs::temp_directory_path();
+        config.root = base / ("disk-cleaner-suite-" + std::to_string(getpid()));
+    }
+    // 生成的目录树充当主目录：缓存、回收站清理和 CleanupDirectory 的安全检查都以 HOME 为准
+    setenv("HOME", config.root.c_str(), 1);
+    SetScanWorkerCount(config.threads);
+    SetCleanupMode(CLEANUP_MODE_IMMEDIATE);
+
+    TreeGenerator generator(config);
+    TreeStats tree = generator.generate();
+    std::cerr << "[bench_suite] " << config.root << ": " << tree.dirs << " 个目录, " << tree.files << " 个文件 ("
+              << tree.visible_files << " 个可见)" << std::endl;
+
+    std::vector<Result> results;
+    auto run = [&](Result r) {
+        std::cerr << "  " << r.name << ": " << r.files << " files, " << r.seconds * 1000 << " ms, "
+                  << (r.seconds > 0 ? r.files / r.seconds : 0) << " files/s" << std::endl;
+        results.push_back(std::move(r));
+    };
+    run(bench_classify(tree, true));
+    run(bench_classify(tree, false));
+    run(bench_scan(config, tree, "StartScan/std_filesystem", SCAN_BACKEND_STD_FILESYSTEM, 0));
+    run(bench_scan(config, tree, "StartScan/getdents", SCAN_BACKEND_GETDENTS, 0));
+    run(bench_scan(config, tree, "StartScan/getdents+inode_order", SCAN_BACKEND_GETDENTS, 0, SCAN_INODE_ORDER_ON));
+    if (IsIoUringSupported()) {
+        run(bench_scan(config, tree, "StartScan/getdents+io_uring", SCAN_BACKEND_GETDENTS, 1));
+        run(bench_scan(config, tree, "StartScan/getdents+io_uring+inode_order", SCAN_BACKEND_GETDENTS, 1, SCAN_INODE_ORDER_ON));
+    }
+    run(bench_get_results(config));
+    run(bench_cleanup_categories(config, generator));
+    run(bench_migrate(config, generator));
+    run(bench_cleanup_directory(config, generator));
+
+    write_json(config, tree, results);
+    std::cerr << "[bench_suite] 结果已写入 " << config.json << std::endl;
+    CleanupScanner();
+    std::error_code ec;
+    fs::remove_all(config.root, ec);
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Disk-masterTest/migrate_collision_test.cpp
+// 回归测试：不同目录下的同名文件搬迁到同一目标目录时，不能互相覆盖，也不能丢失任何一个文件。
+//   1. 同一文件系统 (rename 路径)
+//   2. 跨文件系统 (复制路径，目标放在 /dev/shm；与测试目录在同一设备时跳过)
+// 用法: migrate_collision_test [工作目录]，默认在系统临时目录下创建
+#include "disk_cleaner.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <filesystem>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static int g_failures = 0;
+
+static void check(bool condition, const std::string& message) {
+    if (!condition) {
+        std::cerr << "  [失败] " << message << std::endl;
+        ++g_failures;
+    }
+}
+
+static void write_file(const fs::path& path, const std::string& content) {
+    fs::create_directories(path.parent_path());
+    std::ofstream(path, std::ios::binary) << content;
+}
+
+static std::string read_file(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static void scan(const fs::path& root) {
+    StartScan(root.c_str(), nullptr);
+    while (!IsScanFinished()) usleep(1000);
+}
+
+// 两个同名文件 + 目标目录中已有一个同名文件：三份内容都必须保留
+static void run_case(const std::string& title, const fs::path& home, const fs::path& dest) {
+    std::cout << title << ": " << home << " -> " << dest << std::endl;
+    fs::remove_all(home);
+    fs::remove_all(dest);
+    write_file(home / "a" / "IMG_0001.jpg", "first");
+    write_file(home / "b" / "IMG_0001.jpg", "second");
+    write_file(home / "c" / "IMG_0002.jpg", "third");
+    write_file(dest / "IMG_0002.jpg", "existing");
+
+    scan(home);
+    MigrateCategories(CATEGORY_IMAGE, dest.c_str());
+    MigrationStats stats;
+    GetLastMigrationStats(&stats);
+
+    // IMG_0001.jpg：恰好一个搬走，另一个留在原处；两份内容都还在
+    const bool a_left = fs::exists(home / "a" / "IMG_0001.jpg");
+    const bool b_left = fs::exists(home / "b" / "IMG_0001.jpg");
+    check(a_left != b_left, "同名文件应当恰好搬走一个");
+    const std::string moved = read_file(dest / "IMG_0001.jpg");
+    const std::string kept = read_file(home / (a_left ? "a" : "b") / "IMG_0001.jpg");
+    check((moved == "first" && kept == "second") || (moved == "second" && kept == "first"),
+          "同名文件的内容丢失或被覆盖: 目标 '" + moved + "', 源 '" + kept + "'");
+
+    // IMG_0002.jpg：目标中已有的文件不被覆盖，源文件保留
+    check(read_file(dest / "IMG_0002.jpg") == "existing", "目标目录中已有的文件被覆盖");
+    check(read_file(home / "c" / "IMG_0002.jpg") == "third", "目标已存在时源文件不应被删除");
+
+    check(stats.files_moved == 1, "应当只搬迁 1 个文件，实际 " + std::to_string(stats.files_moved));
+    check(stats.files_failed == 2, "应当有 2 个文件因目标已存在而失败，实际 " + std::to_string(stats.files_failed));
+
+    // 目标目录中不应残留临时文件
+    for (const auto& entry : fs::directory_iterator(dest)) {
+        const std::string name = entry.path().filename().string();
+        check(name == "IMG_0001.jpg" || name == "IMG_0002.jpg", "目标目录中残留了 " + name);
+    }
+    fs::remove_all(home);
+    fs::remove_all(dest);
+}
+
+int main(int argc, char** argv) {
+    fs::path base = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path();
+    const std::string tag = "disk-cleaner-collision-" + std::to_string(getpid());
+    fs::path home = base / tag / "home";
+
+    run_case("同一文件系统", home, base / tag / "dest");
+
+    struct stat home_st, shm_st;
+    fs::create_directories(home);
+    if (stat("/dev/shm", &shm_st) == 0 && stat(home.c_str(), &home_st) == 0 && shm_st.st_dev != home_st.st_dev) {
+        run_case("跨文件系统", home, fs::path("/dev/shm") / tag);
+    } else {
+        std::cout << "跨文件系统: 跳过 (/dev/shm 不可用或与工作目录在同一设备)" << std::endl;
+    }
+
+    CleanupScanner();
+    fs::remove_all(base / tag);
+    std::cout << (g_failures == 0 ? "通过" : "失败") << std::endl;
+    return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+// Disk-masterTest/migrate_rate_test.cpp
+// 回归测试：跨文件系统搬迁 (read/write 复制路径) 的实际速率应当接近带宽上限，而不是远低于上限。
+//   小文件只按实际复制的字节申请带宽：不为整块缓冲区、读到文件末尾的那次 read 或失败的 copy_file_range 付费。
+//   目标放在 /dev/shm；与测试目录在同一设备时跳过。
+// 用法: migrate_rate_test [工作目录]，默认在系统临时目录下创建
+#include "disk_cleaner.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <filesystem>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static const int kFileCount = 100;
+static const size_t kFileSize = 20 << 10;
+static const uint64_t kRateLimit = 2 << 20; // 总量约 1 秒
+
+int main(int argc, char** argv) {
+    fs::path base = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path();
+    const std::string tag = "disk-cleaner-rate-" + std::to_string(getpid());
+    fs::path home = base / tag / "home";
+    fs::path dest = fs::path("/dev/shm") / tag;
+    fs::create_directories(home);
+
+    struct stat home_st, shm_st;
+    if (stat("/dev/shm", &shm_st) != 0 || stat(home.c_str(), &home_st) != 0 || shm_st.st_dev == home_st.st_dev) {
+        std::cout << "跳过 (/dev/shm 不可用或与工作目录在同一设备)" << std::endl;
+        fs::remove_all(base / tag);
+        return 0;
+    }
+
+    const std::string content(kFileSize, 'v');
+    for (int i = 0; i < kFileCount; ++i) {
+        std::ofstream(home / ("clip_" + std::to_string(i) + ".mp4"), std::ios::binary) << content;
+    }
+    StartScan(home.c_str(), nullptr);
+    while (!IsScanFinished()) usleep(1000);
+
+    auto start = std::chrono::steady_clock::now();
+    MigrationJob* job = StartMigrationJob(CATEGORY_VIDEO, dest.c_str(), kRateLimit);
+    if (!job) {
+        std::cerr << "  [失败] 无法启动搬迁任务" << std::endl;
+        return 1;
+    }
+    WaitMigrationJob(job, -1);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    MigrationJobProgress progress;
+    GetMigrationJobProgress(job, &progress);
+    ReleaseMigrationJob(job);
+
+    int failures = 0;
+    const double expected = static_cast<double>(kFileCount) * kFileSize / kRateLimit;
+    const double rate = progress.bytes_done / seconds;
+    std::cout << progress.files_done << " 个文件, " << seconds << " 秒, " << rate / (1 << 20) << " MB/s (上限 "
+              << kRateLimit / (1 << 20) << " MB/s)" << std::endl;
+    if (progress.files_done != static_cast<uint64_t>(kFileCount)) {
+        std::cerr << "  [失败] 应当搬迁 " << kFileCount << " 个文件，实际 " << progress.files_done << std::endl;
+        ++failures;
+    }
+    // 令牌桶允许第一块立即开始，耗时略短于 expected；明显更慢说明带宽被多算了
+    if (seconds > expected * 1.5 + 0.2) {
+        std::cerr << "  [失败] 速率远低于上限: 预计约 " << expected << " 秒" << std::endl;
+        ++failures;
+    }
+    if (seconds < expected * 0.7) {
+        std::cerr << "  [失败] 速率超过上限: 预计约 " << expected << " 秒" << std::endl;
+        ++failures;
+    }
+
+    CleanupScanner();
+    fs::remove_all(base / tag);
+    fs::remove_all(dest);
+    std::cout << (failures == 0 ? "通过" : "失败") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -8,294 +8,5581 @@
 #include <mutex>
 #include <filesystem>
 #include <unordered_set>
+#include <unordered_map>
+#include <map>
 #include <cstring>
+#include <cstdio>
 #include <algorithm> // <--- 添加此行
 #include <cctype>    // <--- 添加此行
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+#include <sstream>
+#include <cerrno>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sysmacros.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <signal.h>
+#include <setjmp.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// io_uring 只需要内核头文件，不依赖 liburing。IORING_OP_STATX 是枚举值无法直接检测，
+// 用同在 5.6 引入的 IORING_FEAT_RW_CUR_POS 判断头文件版本
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(STATX_SIZE)
+#define DISK_CLEANER_HAVE_IO_URING 1
+#endif
+#endif
 
 namespace fs = std::filesystem;
 
-// --- 新增：线程安全的停止标志 ---
-static std::atomic<bool> g_stop_scan_flag(false);
+// --- 新增：线程安全的停止标志 ---
+static std::atomic<bool> g_stop_scan_flag(false);
+
+// --- 内部数据结构和状态变量 ---
+static std::thread g_scan_thread;
+static std::atomic<bool> g_scan_finished(true);
+static std::mutex g_results_mutex;
+static std::mutex g_callback_mutex; // 多线程扫描时保证回调仍然是串行调用的
+static std::atomic<uint64_t> g_results_generation(0); // 结果每发生一次变化加一
+
+// --- 扫描会话：路径 arena + 紧凑的结果记录 ---
+// 路径按 "所在目录 + 文件名" 保存，同一目录下的文件共享目录路径；名字的字节统一放在按块分配的
+// arena 中，不再为每个文件单独 new。结果按分类以列式 (struct-of-arrays) 保存，并按扫描线程分片。
+// 开始新扫描时整个会话 (arena、目录表、结果) 一次性释放；仍被快照引用的 arena 和结果块在快照释放后才回收。
+
+// 通过扫描得到的分类，下标即该分类在会话中的槽位
+static const FileCategory kScannedCategories[] = {
+    CATEGORY_PACKAGES, CATEGORY_COMPRESSED, CATEGORY_VIDEO, CATEGORY_AUDIO, CATEGORY_IMAGE, CATEGORY_DOCUMENT
+};
+static const int kScannedCategoryCount = sizeof(kScannedCategories) / sizeof(kScannedCategories[0]);
+
+static int category_slot(FileCategory category) {
+    switch (category) {
+        case CATEGORY_PACKAGES:   return 0;
+        case CATEGORY_COMPRESSED: return 1;
+        case CATEGORY_VIDEO:      return 2;
+        case CATEGORY_AUDIO:      return 3;
+        case CATEGORY_IMAGE:      return 4;
+        case CATEGORY_DOCUMENT:   return 5;
+        default:                  return -1; // 回收站等特殊类别不通过扫描得到
+    }
+}
+
+// 只追加的 bump 分配器，按 1MB 分块，随会话一起整体释放
+class PathArena {
+public:
+    const char* store(const char* s, size_t len) {
+        if (len + 1 > remaining_) {
+            grow(len + 1);
+        }
+        char* p = cursor_;
+        memcpy(p, s, len);
+        p[len] = '\0';
+        cursor_ += len + 1;
+        remaining_ -= len + 1;
+        used_ += len + 1;
+        return p;
+    }
+
+    size_t bytes_reserved() const { return reserved_; }
+    size_t bytes_used() const { return used_; }
+
+private:
+    void grow(size_t min_size) {
+        size_t block = std::max(kBlockSize, min_size);
+        blocks_.emplace_back(new char[block]);
+        cursor_ = blocks_.back().get();
+        remaining_ = block;
+        reserved_ += block;
+    }
+
+    static constexpr size_t kBlockSize = 1 << 20;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* cursor_ = nullptr;
+    size_t remaining_ = 0;
+    size_t reserved_ = 0;
+    size_t used_ = 0;
+};
+
+struct SessionDir;
+
+// 某个目录 (或子树) 的统计值，无符号回绕表示减少
+struct DirTotals {
+    uint64_t bytes = 0;
+    uint64_t files = 0;
+    uint64_t category_bytes[kScannedCategoryCount] = {};
+
+    DirTotals negated() const {
+        DirTotals n;
+        n.bytes = 0 - bytes;
+        n.files = 0 - files;
+        for (int i = 0; i < kScannedCategoryCount; ++i) n.category_bytes[i] = 0 - category_bytes[i];
+        return n;
+    }
+};
+
+// 目录树节点：文件只记入所在目录，整棵子树扫描完毕 (pending 归零) 时才把汇总值一次性加到父目录，
+// 扫描线程之间不会争抢上层目录的计数。子目录以单链表挂在父目录下，读者无需加锁即可遍历。
+struct DirTreeNode {
+    std::atomic<uint64_t> bytes{ 0 };
+    std::atomic<uint64_t> files{ 0 };
+    std::atomic<uint64_t> category_bytes[kScannedCategoryCount] = {};
+    std::atomic<int32_t> pending{ 0 };  // 自身的遍历 + 未完成的子目录 + 未完成的 statx，0 表示子树已汇总
+    std::atomic<uint32_t> child_count{ 0 };
+    std::atomic<const SessionDir*> first_child{ nullptr };
+    const SessionDir* next_sibling = nullptr; // 挂入父目录的链表之前写入，之后不再修改
+
+    void add_file(int slot, uint64_t size) {
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        files.fetch_add(1, std::memory_order_relaxed);
+        if (slot >= 0) category_bytes[slot].fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void add(const DirTotals& t) {
+        bytes.fetch_add(t.bytes, std::memory_order_relaxed);
+        files.fetch_add(t.files, std::memory_order_relaxed);
+        for (int i = 0; i < kScannedCategoryCount; ++i) {
+            if (t.category_bytes[i]) category_bytes[i].fetch_add(t.category_bytes[i], std::memory_order_relaxed);
+        }
+    }
+
+    DirTotals load() const {
+        DirTotals t;
+        t.bytes = bytes.load(std::memory_order_relaxed);
+        t.files = files.load(std::memory_order_relaxed);
+        for (int i = 0; i < kScannedCategoryCount; ++i) t.category_bytes[i] = category_bytes[i].load(std::memory_order_relaxed);
+        return t;
+    }
+};
+
+struct SessionDir {
+    SessionDir(const SessionDir* parent, const char* path, size_t path_len, uint32_t name_len)
+        : parent(parent), path(path), path_len(path_len), name_len(name_len) {}
+
+    const SessionDir* parent; // nullptr 表示根目录
+    const char* path;         // 目录的完整路径 (目录数远少于文件数，按完整路径保存)，名字是它的末尾部分
+    size_t path_len;
+    uint32_t name_len;
+    mutable std::atomic<bool> detached{ false }; // 监视模式下已被删除或移出
+    mutable DirTreeNode tree;
+
+    const char* name() const { return path + path_len - name_len; }
+};
+
+// 目录自身的遍历 (或一个 statx) 完成：pending 归零的目录把整棵子树的汇总加到父目录，并继续向上检查
+static void finish_tree_node(const SessionDir* dir) {
+    while (dir->tree.pending.fetch_sub(1, std::memory_order_acq_rel) == 1 && dir->parent) {
+        dir->parent->tree.add(dir->tree.load());
+        dir = dir->parent;
+    }
+}
+
+// 扫描结束后的增量变化 (监视、清理、搬迁)：从所在目录向上调整，直到一个尚未汇总到父目录的节点为止
+// (它完成时会把这次变化一并带上)
+static void adjust_tree(const SessionDir* dir, const DirTotals& delta) {
+    for (const SessionDir* p = dir; p; p = p->parent) {
+        p->tree.add(delta);
+        if (p->tree.pending.load(std::memory_order_acquire) > 0) break;
+    }
+}
+
+// 一个分类的结果按固定容量的块保存，块内按列 (struct-of-arrays) 存放。
+// 块一经发布给快照就不会再被修改已有的元素：追加只写入快照可见范围之外的位置，
+// 修改或删除时复制 (copy-on-write)，因此读者无需加锁。
+struct RecordChunk {
+    static constexpr size_t kCapacity = 4096;
+    const char* dirs[kCapacity];      // 所在目录的完整路径 (指向 arena)，同时作为目录的标识
+    const char* names[kCapacity];
+    uint16_t name_lens[kCapacity];    // NAME_MAX 为 255，16 位足够
+    uint64_t sizes[kCapacity];
+};
+
+// 某个分类在某一时刻的不可变快照，由写入方发布，读者通过原子加载的 shared_ptr 持有。
+// 每个结果分片各自发布，读取时再把各分片的快照拼接起来 (只拼接块的引用，不拷贝记录)
+struct ResultSnapshot {
+    struct Segment {
+        std::shared_ptr<const RecordChunk> chunk;
+        size_t count; // 本段中有效的记录数
+    };
+
+    FileCategory category;
+    uint64_t generation;
+    size_t count = 0;
+    uint64_t total_bytes = 0;
+    std::vector<Segment> segments;
+    std::vector<size_t> starts; // 各段第一条记录的下标，用于二分定位
+    std::vector<std::shared_ptr<const PathArena>> arenas; // 保证快照存活期间名字不被释放
+
+    void add_segment(const std::shared_ptr<const RecordChunk>& chunk, size_t n) {
+        starts.push_back(count);
+        segments.push_back(Segment{ chunk, n });
+        count += n;
+    }
+
+    void append(const ResultSnapshot& other) {
+        for (const auto& seg : other.segments) add_segment(seg.chunk, seg.count);
+        total_bytes += other.total_bytes;
+        arenas.insert(arenas.end(), other.arenas.begin(), other.arenas.end());
+    }
+
+    // 下标 i 所在的段
+    size_t segment_of(size_t i) const {
+        return static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), i) - starts.begin()) - 1;
+    }
+};
+
+// 每个分类保留的最大文件数量 (SetLargestFileCount)
+static std::atomic<int> g_largest_file_count(100);
+
+// 最大文件榜中的一项：指针指向会话的路径存储，随会话一起失效
+struct LargestFileEntry {
+    uint64_t size;
+    const char* dir;
+    const char* name;
+    uint16_t name_len;
+};
+
+class CategoryRecords {
+public:
+    size_t size() const { return count_; }
+    uint64_t total_bytes() const { return total_bytes_; }
+
+    const char* dir(size_t i) const { return chunk(i).dirs[i % RecordChunk::kCapacity]; }
+    const char* name(size_t i) const { return chunk(i).names[i % RecordChunk::kCapacity]; }
+    uint16_t name_len(size_t i) const { return chunk(i).name_lens[i % RecordChunk::kCapacity]; }
+    uint64_t file_size(size_t i) const { return chunk(i).sizes[i % RecordChunk::kCapacity]; }
+
+    void push(const char* dir, const char* name, size_t name_len, uint64_t size) {
+        size_t slot = count_ % RecordChunk::kCapacity;
+        if (slot == 0) {
+            chunks_.emplace_back(new RecordChunk); // 不做零初始化，页面在写入时才真正分配
+        }
+        RecordChunk& c = *chunks_.back();
+        c.dirs[slot] = dir;
+        c.names[slot] = name;
+        c.name_lens[slot] = static_cast<uint16_t>(name_len);
+        c.sizes[slot] = size;
+        ++count_;
+        total_bytes_ += size;
+        if (!largest_dirty_) offer_largest(LargestFileEntry{ size, dir, name, static_cast<uint16_t>(name_len) });
+    }
+
+    void set_size(size_t i, uint64_t size) {
+        std::shared_ptr<RecordChunk>& c = chunks_[i / RecordChunk::kCapacity];
+        if (c.use_count() > 1) {
+            c.reset(new RecordChunk(*c)); // 已被快照引用，先复制
+        }
+        total_bytes_ += size - c->sizes[i % RecordChunk::kCapacity];
+        c->sizes[i % RecordChunk::kCapacity] = size;
+        largest_dirty_ = true; // 堆中无法定位该记录，下次读取时重建
+    }
+
+    void clear() {
+        chunks_.clear();
+        count_ = 0;
+        total_bytes_ = 0;
+        largest_.clear();
+        largest_dirty_ = false;
+    }
+
+    // 追加本分片最大的若干个文件 (未排序)；上限变化或记录被改写后先从全部记录重建小顶堆
+    void collect_largest(std::vector<LargestFileEntry>& out) {
+        if (largest_dirty_ || largest_capacity_ != static_cast<size_t>(g_largest_file_count.load())) {
+            largest_.clear();
+            largest_dirty_ = false;
+            largest_capacity_ = static_cast<size_t>(g_largest_file_count.load());
+            for (size_t i = 0; i < count_; ++i) {
+                offer_largest(LargestFileEntry{ file_size(i), dir(i), name(i), name_len(i) });
+            }
+        }
+        out.insert(out.end(), largest_.begin(), largest_.end());
+    }
+
+    // 删除 pred(i) 为 true 的记录，保持其余记录的顺序；结果写入新的块，已发布的快照不受影响
+    template <typename Pred>
+    void remove_if(Pred pred) {
+        CategoryRecords kept;
+        for (size_t i = 0; i < count_; ++i) {
+            if (!pred(i)) kept.push(dir(i), name(i), name_len(i), file_size(i));
+        }
+        if (kept.count_ != count_) {
+            *this = std::move(kept);
+        }
+    }
+
+    std::shared_ptr<const ResultSnapshot> snapshot(FileCategory category, uint64_t generation,
+                                                   const std::shared_ptr<const PathArena>& arena) const {
+        std::shared_ptr<ResultSnapshot> snap(new ResultSnapshot());
+        snap->category = category;
+        snap->generation = generation;
+        for (size_t i = 0; i < chunks_.size(); ++i) {
+            snap->add_segment(chunks_[i], std::min(RecordChunk::kCapacity, count_ - i * RecordChunk::kCapacity));
+        }
+        snap->total_bytes = total_bytes_;
+        snap->arenas.push_back(arena);
+        return snap;
+    }
+
+    size_t memory_bytes() const { return chunks_.size() * sizeof(RecordChunk); }
+
+private:
+    const RecordChunk& chunk(size_t i) const { return *chunks_[i / RecordChunk::kCapacity]; }
+
+    static bool larger(const LargestFileEntry& a, const LargestFileEntry& b) { return a.size > b.size; }
+
+    // 堆未满时直接加入，否则只有比堆顶 (当前第 K 大) 更大的文件才替换堆顶
+    void offer_largest(const LargestFileEntry& e) {
+        if (largest_.size() < largest_capacity_) {
+            largest_.push_back(e);
+            std::push_heap(largest_.begin(), largest_.end(), larger);
+        } else if (largest_capacity_ > 0 && e.size > largest_.front().size) {
+            std::pop_heap(largest_.begin(), largest_.end(), larger);
+            largest_.back() = e;
+            std::push_heap(largest_.begin(), largest_.end(), larger);
+        }
+    }
+
+    std::vector<std::shared_ptr<RecordChunk>> chunks_;
+    size_t count_ = 0;
+    uint64_t total_bytes_ = 0;
+    std::vector<LargestFileEntry> largest_; // 以文件大小为键的小顶堆
+    size_t largest_capacity_ = static_cast<size_t>(g_largest_file_count.load());
+    bool largest_dirty_ = false;
+};
+
+// 拼出文件的完整路径
+static void join_record_path(const char* dir, const char* name, size_t name_len, std::string& out) {
+    out.assign(dir);
+    if (out.empty() || out.back() != '/') out.push_back('/');
+    out.append(name, name_len);
+}
+
+// 扫描遥测计数。每个扫描线程一份 (放在自己的结果分片中)，只由所属线程写入：
+// relaxed 的 load + store 在 x86 上就是普通读写，不需要原子加；读取时把各线程的计数相加。
+struct alignas(64) TelemetryCounters {
+    std::atomic<uint64_t> dirs_visited{ 0 };
+    std::atomic<uint64_t> files_visited{ 0 };
+    std::atomic<uint64_t> files_classified[kScannedCategoryCount] = {};
+    std::atomic<uint64_t> bytes_found{ 0 };
+    std::atomic<uint64_t> errors{ 0 };
+    std::atomic<uint64_t> permission_skips{ 0 };
+    std::atomic<uint64_t> traversal_ns{ 0 };      // 读目录 (getdents / directory_iterator) 及其余的循环开销
+    std::atomic<uint64_t> classification_ns{ 0 }; // 按文件名分类 (每 kClassifySampleRate 次计时一次再按比例放大)
+    std::atomic<uint64_t> size_lookup_ns{ 0 };    // stat / fstatat / io_uring statx
+    std::atomic<uint64_t> callback_ns{ 0 };       // 扫描回调和进度投递
+    std::atomic<uint64_t> throttle_ns{ 0 };       // 后台模式退让和目录项预算造成的休眠 (不计入以上各阶段)
+
+    static constexpr unsigned kClassifySampleRate = 32;
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t delta = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    // 记录一次失败：权限不足单独计数
+    void count_error(int error) {
+        bump(error == EACCES || error == EPERM ? permission_skips : errors);
+    }
+};
+
+static uint64_t telemetry_now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// 批量进度回调的一段记录：路径首尾相接、各自以 '\0' 结尾
+struct ProgressRecord {
+    size_t path_offset;
+    size_t path_len;
+    uint64_t size;
+    FileCategory category;
+};
+
+struct ProgressBuffer {
+    std::string paths;
+    std::vector<ProgressRecord> records;
+    std::chrono::steady_clock::time_point started; // 第一条记录的时间
+
+    void clear() {
+        paths.clear();
+        records.clear();
+    }
+};
+
+// 一个结果分片：自己的 arena、目录表、各分类的记录和垃圾大小计数。
+// 扫描时每个工作线程只写自己的分片，分片锁只有所属线程会去拿，单文件的热路径上没有共享写入；
+// 清理、搬迁和监视模式先持有 g_results_mutex，再逐个锁住分片进行修改。
+struct ResultShard {
+    std::mutex mutex;
+    std::shared_ptr<PathArena> arena{ new PathArena() };
+    std::deque<SessionDir> dirs; // deque 保证地址稳定
+    CategoryRecords records[kScannedCategoryCount];
+    std::atomic<uint64_t> junk_bytes{ 0 }; // 只在持有 mutex 时写入，读取时把各分片相加
+    size_t published_count[kScannedCategoryCount] = {};
+    std::chrono::steady_clock::time_point last_publish[kScannedCategoryCount];
+    std::shared_ptr<const ResultSnapshot> published[kScannedCategoryCount]; // 只通过 atomic_load / atomic_store 访问
+    std::string scratch;
+    TelemetryCounters telemetry; // 只由对应的扫描线程写入，不受 mutex 保护
+    ProgressBuffer progress;     // 尚未交给投递线程的进度记录，同样只由对应的扫描线程访问
+
+    ResultShard() {
+        for (auto& t : last_publish) t = std::chrono::steady_clock::now();
+    }
+
+    // 以下函数的调用方都必须持有 mutex
+    SessionDir* add_dir(const SessionDir* parent, const char* name, size_t name_len) {
+        if (parent) {
+            join_record_path(parent->path, name, name_len, scratch);
+        } else {
+            scratch.assign(name, name_len);
+        }
+        dirs.emplace_back(parent, arena->store(scratch.data(), scratch.size()), scratch.size(),
+                          static_cast<uint32_t>(name_len));
+        SessionDir* dir = &dirs.back();
+        if (parent) {
+            // 同一父目录可能同时被扫描线程和监视线程 (不同分片) 添加子目录
+            const SessionDir* head = parent->tree.first_child.load(std::memory_order_relaxed);
+            do {
+                dir->tree.next_sibling = head;
+            } while (!parent->tree.first_child.compare_exchange_weak(head, dir, std::memory_order_release,
+                                                                     std::memory_order_relaxed));
+            parent->tree.child_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        return dir;
+    }
+
+    void add_file(int slot, const SessionDir* dir, const char* name, size_t name_len, uint64_t size) {
+        records[slot].push(dir->path, arena->store(name, name_len), name_len, size);
+        add_junk_bytes(size);
+    }
+
+    // 无符号回绕：某个分片删除了其它分片记入的文件时，本分片的计数可能 "为负"，但总和依然正确
+    void add_junk_bytes(uint64_t delta) {
+        junk_bytes.store(junk_bytes.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    // 扫描过程中每积累 kSnapshotBatch 个文件或每隔 kSnapshotInterval 发布一次
+    bool snapshot_due(int slot) const {
+        size_t pending = records[slot].size() - published_count[slot];
+        return pending >= kSnapshotBatch
+            || (pending > 0 && std::chrono::steady_clock::now() - last_publish[slot] >= kSnapshotInterval);
+    }
+
+    void publish(int slot, uint64_t generation) {
+        published_count[slot] = records[slot].size();
+        last_publish[slot] = std::chrono::steady_clock::now();
+        std::atomic_store(&published[slot], records[slot].snapshot(kScannedCategories[slot], generation, arena));
+    }
+
+    static constexpr size_t kSnapshotBatch = 1024;
+    static constexpr std::chrono::milliseconds kSnapshotInterval{ 100 };
+};
+
+// 一次扫描的全部结果，由若干分片组成 (每个扫描线程一个，监视模式的增量变化写入 0 号分片)
+class ScanSession {
+public:
+    ScanSession(const std::string& root_path, size_t shard_count) {
+        for (size_t i = 0; i < std::max<size_t>(shard_count, 1); ++i) {
+            shards_.emplace_back(new ResultShard());
+        }
+        SessionDir* root = shards_[0]->add_dir(nullptr, root_path.data(), root_path.size());
+        root->tree.pending.store(1, std::memory_order_relaxed); // 由扫描根目录的遍历完成
+        root_ = root;
+        started_ns_ = telemetry_now_ns();
+    }
+
+    // 扫描开始的时间和结束的时间 (0 表示仍在扫描)，用于遥测
+    uint64_t started_ns() const { return started_ns_; }
+    uint64_t finished_ns() const { return finished_ns_.load(std::memory_order_acquire); }
+    void mark_finished() { finished_ns_.store(telemetry_now_ns(), std::memory_order_release); }
+
+    const SessionDir* root() const { return root_; }
+    size_t shard_count() const { return shards_.size(); }
+    ResultShard& shard(size_t i) { return *shards_[i]; }
+    const ResultShard& shard(size_t i) const { return *shards_[i]; }
+
+    uint64_t junk_bytes() const {
+        uint64_t total = 0;
+        for (const auto& s : shards_) total += s->junk_bytes.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    // 以下函数只在持有 g_results_mutex 时调用，内部逐个锁住分片
+
+    // 按名字查找子目录：沿父目录的子目录链表查找，只与该目录的子目录数有关
+    const SessionDir* find_child_dir(const SessionDir* parent, const char* name, size_t name_len) const {
+        const SessionDir* child = parent->tree.first_child.load(std::memory_order_acquire);
+        while (child && (child->detached || child->name_len != name_len || memcmp(child->name(), name, name_len) != 0)) {
+            child = child->tree.next_sibling;
+        }
+        return child;
+    }
+
+    // 目录被删除或移出：标记该目录，返回整棵子树中各目录的路径指针 (即记录中的目录标识)。
+    // 沿子目录链表收集，只访问这棵子树 (此前已被移除的子目录不再重复收集)
+    std::unordered_set<const char*> detach_subtree(const SessionDir* dir) {
+        dir->detached = true;
+        if (dir->parent) {
+            adjust_tree(dir->parent, dir->tree.load().negated());
+            dir->parent->tree.child_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+        std::unordered_set<const char*> removed;
+        std::vector<const SessionDir*> stack{ dir };
+        while (!stack.empty()) {
+            const SessionDir* d = stack.back();
+            stack.pop_back();
+            removed.insert(d->path);
+            for (const SessionDir* c = d->tree.first_child.load(std::memory_order_acquire); c; c = c->tree.next_sibling) {
+                if (!c->detached) stack.push_back(c);
+            }
+        }
+        return removed;
+    }
+
+    // 依次锁住每个分片，对其中的每个目录调用 fn
+    template <typename Fn>
+    void for_each_dir(Fn fn) {
+        for (auto& s : shards_) {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            for (const SessionDir& d : s->dirs) fn(d);
+        }
+    }
+
+    // 依次锁住每个分片，对其中某个分类的记录调用 fn
+    template <typename Fn>
+    void for_each_records(int slot, Fn fn) {
+        for (auto& s : shards_) {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            fn(s->records[slot]);
+        }
+    }
+
+    // 发布 mask 中各分类在所有分片上的快照
+    void publish(unsigned int mask, uint64_t generation) {
+        for (auto& s : shards_) {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            for (int slot = 0; slot < kScannedCategoryCount; ++slot) {
+                if (mask & kScannedCategories[slot]) s->publish(slot, generation);
+            }
+        }
+    }
+
+    void memory_stats(ScanMemoryStats& stats) {
+        for (auto& s : shards_) {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            stats.dirs_recorded += s->dirs.size();
+            stats.arena_bytes += s->arena->bytes_reserved();
+            stats.record_bytes += s->dirs.size() * sizeof(SessionDir);
+            for (const auto& r : s->records) {
+                stats.files_recorded += r.size();
+                stats.record_bytes += r.memory_bytes();
+            }
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<ResultShard>> shards_;
+    const SessionDir* root_;
+    uint64_t started_ns_;
+    std::atomic<uint64_t> finished_ns_{ 0 };
+};
+
+// 当前的扫描会话。写入方持有 g_results_mutex 并通过 std::atomic_store 替换，
+// 读取快照的一方只通过 std::atomic_load 获取，不需要 g_results_mutex
+static std::shared_ptr<ScanSession> g_session;
+
+// 发布 mask 中各分类的最新快照，调用方必须持有 g_results_mutex
+static void publish_snapshots(unsigned int mask) {
+    if (g_session) {
+        g_session->publish(mask, g_results_generation.load(std::memory_order_acquire));
+    }
+}
+
+// 从目录树中扣除被清理或搬走的文件：先按目录累计，最后每个目录只向上调整一次。调用方持有 g_results_mutex
+class DirTreeRemoval {
+public:
+    void add(const char* dir, int slot, uint64_t size) {
+        DirTotals& t = dirs_[dir];
+        t.bytes -= size;
+        t.files -= 1;
+        t.category_bytes[slot] -= size;
+    }
+
+    void apply(ScanSession& session) {
+        if (dirs_.empty()) return;
+        session.for_each_dir([&](const SessionDir& d) {
+            auto it = dirs_.find(d.path);
+            if (it != dirs_.end()) adjust_tree(&d, it->second);
+        });
+        dirs_.clear();
+    }
+
+private:
+    std::unordered_map<const char*, DirTotals> dirs_; // 键为记录中的目录路径指针
+};
+
+// 把各分片最新发布的快照拼接为一个快照 (读取时才合并)
+static std::shared_ptr<const ResultSnapshot> merged_snapshot(int slot) {
+    std::shared_ptr<ResultSnapshot> merged(new ResultSnapshot());
+    merged->category = kScannedCategories[slot];
+    merged->generation = g_results_generation.load(std::memory_order_acquire);
+    std::shared_ptr<ScanSession> session = std::atomic_load(&g_session);
+    if (session) {
+        for (size_t i = 0; i < session->shard_count(); ++i) {
+            std::shared_ptr<const ResultSnapshot> piece = std::atomic_load(&session->shard(i).published[slot]);
+            if (piece) merged->append(*piece);
+        }
+    }
+    return merged;
+}
+
+// --- 文件类型定义 ---
+// 默认扩展名表同时用于初始化下面的运行时集合和编译期生成的后缀树
+constexpr const char* kDefaultPackageExts[] = {".deb", ".rpm", ".pkg", ".appimage"};
+constexpr const char* kDefaultVideoExts[] = {".mp4", ".mkv", ".avi", ".mov", ".wmv", ".flv", ".webm",
+                                             ".3gp", ".m4v", ".mpg", ".rmvb", ".rm", ".vob", ".mpeg"};
+constexpr const char* kDefaultAudioExts[] = {".mp3", ".wav", ".flac", ".aac", ".ogg", ".m4a", ".wma"};
+constexpr const char* kDefaultImageExts[] = {".jpg", ".jpeg", ".png", ".gif", ".bmp", ".tiff", ".svg", ".webp"};
+constexpr const char* kDefaultDocumentExts[] = {".pdf", ".doc", ".docx", ".xls", ".xlsx", ".ppt", ".pptx"};
+constexpr const char* kDefaultCompressedEndings[] = {
+    ".tar.gz", ".tar.bz2", ".tar.xz", ".tgz",
+    ".zip", ".rar", ".7z", ".gz", ".bz2", ".xz", ".tar"
+};
+
+std::unordered_set<std::string> g_package_exts(std::begin(kDefaultPackageExts), std::end(kDefaultPackageExts));
+std::unordered_set<std::string> g_video_exts(std::begin(kDefaultVideoExts), std::end(kDefaultVideoExts));
+std::unordered_set<std::string> g_audio_exts(std::begin(kDefaultAudioExts), std::end(kDefaultAudioExts));
+std::unordered_set<std::string> g_image_exts(std::begin(kDefaultImageExts), std::end(kDefaultImageExts));
+std::unordered_set<std::string> g_document_exts(std::begin(kDefaultDocumentExts), std::end(kDefaultDocumentExts));//文档类别
+
+// --- 核心修改：使用一个有序的 vector 来检查文件名结尾 ---
+// 把更长的、更精确的后缀放在前面
+std::vector<std::string> g_compressed_endings(std::begin(kDefaultCompressedEndings), std::end(kDefaultCompressedEndings));
+
+// --- 反向后缀树分类器 ---
+// 所有压缩包后缀和扩展名按字符逆序插入一棵树，分类时从文件名末尾向前走一遍即可，
+// 不区分大小写，也不需要任何堆分配。默认规则在编译期生成，SetExtensions 后在运行时重建。
+struct SuffixTrieNode {
+    uint32_t first_child = 0;    // 0 表示没有子节点 (根节点不会是任何节点的子节点)
+    uint32_t next_sibling = 0;
+    uint16_t ending_category = 0; // 非 0：从根到此节点构成一个压缩包后缀，匹配任意位置的文件名结尾
+    uint16_t ext_category = 0;    // 非 0：从根到此节点构成一个扩展名，只在最后一个 '.' 处匹配
+    unsigned char ch = 0;
+};
+
+constexpr unsigned char ascii_lower(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + ('a' - 'A')) : c;
+}
+
+constexpr size_t const_strlen(const char* s) {
+    size_t n = 0;
+    while (s[n]) ++n;
+    return n;
+}
+
+// 在 nodes 中插入一条规则 (编译期和运行时共用)。扩展名按 package > video > audio > image > document
+// 的优先级插入，已被更高优先级占用的扩展名不会被覆盖，与原先依次查询各集合的结果一致。
+template <typename Nodes>
+constexpr void trie_insert(Nodes& nodes, uint32_t& size, const char* pattern, size_t len, FileCategory category, bool is_ending) {
+    if (len == 0) return;
+    uint32_t node = 0;
+    for (size_t i = len; i-- > 0;) {
+        unsigned char c = ascii_lower(static_cast<unsigned char>(pattern[i]));
+        uint32_t child = nodes[node].first_child;
+        while (child != 0 && nodes[child].ch != c) {
+            child = nodes[child].next_sibling;
+        }
+        if (child == 0) {
+            child = size++;
+            nodes[child].ch = c;
+            nodes[child].next_sibling = nodes[node].first_child;
+            nodes[node].first_child = child;
+        }
+        node = child;
+    }
+    if (is_ending) {
+        nodes[node].ending_category = static_cast<uint16_t>(category);
+    } else if (nodes[node].ext_category == 0 && pattern[0] == '.') {
+        // 与 fs::path::extension() 一致，扩展名总是以 '.' 开头，不以 '.' 开头的规则永远不会匹配
+        nodes[node].ext_category = static_cast<uint16_t>(category);
+    }
+}
+
+// 从文件名末尾向前匹配。压缩包后缀优先于扩展名，与原先的判断顺序一致。
+constexpr FileCategory trie_classify(const SuffixTrieNode* nodes, const char* name, size_t len) {
+    uint32_t node = 0;
+    uint16_t ext_category = 0;
+    bool seen_dot = false;
+    for (size_t i = len; i-- > 0;) {
+        unsigned char c = ascii_lower(static_cast<unsigned char>(name[i]));
+        uint32_t child = nodes[node].first_child;
+        while (child != 0 && nodes[child].ch != c) {
+            child = nodes[child].next_sibling;
+        }
+        if (c == '.' && !seen_dot) {
+            seen_dot = true;
+            // 最后一个 '.' 在开头 (如 ".bashrc") 时不算扩展名
+            if (child != 0 && i > 0) ext_category = nodes[child].ext_category;
+        }
+        if (child == 0) break;
+        node = child;
+        if (nodes[node].ending_category != 0) {
+            return static_cast<FileCategory>(nodes[node].ending_category);
+        }
+    }
+    return static_cast<FileCategory>(ext_category);
+}
+
+template <size_t N>
+struct StaticSuffixTrie {
+    SuffixTrieNode nodes[N];
+    uint32_t size;
+};
+
+template <size_t N>
+constexpr size_t total_pattern_length(const char* const (&patterns)[N]) {
+    size_t total = 0;
+    for (size_t i = 0; i < N; ++i) total += const_strlen(patterns[i]);
+    return total;
+}
+
+constexpr size_t kDefaultTrieCapacity = 1 + total_pattern_length(kDefaultCompressedEndings)
+    + total_pattern_length(kDefaultPackageExts) + total_pattern_length(kDefaultVideoExts)
+    + total_pattern_length(kDefaultAudioExts) + total_pattern_length(kDefaultImageExts)
+    + total_pattern_length(kDefaultDocumentExts);
+
+template <size_t N, size_t M>
+constexpr void trie_insert_all(SuffixTrieNode (&nodes)[N], uint32_t& size, const char* const (&patterns)[M],
+                               FileCategory category, bool is_ending) {
+    for (size_t i = 0; i < M; ++i) {
+        trie_insert(nodes, size, patterns[i], const_strlen(patterns[i]), category, is_ending);
+    }
+}
+
+constexpr StaticSuffixTrie<kDefaultTrieCapacity> build_default_trie() {
+    StaticSuffixTrie<kDefaultTrieCapacity> trie{};
+    trie.size = 1; // 0 号节点为根
+    trie_insert_all(trie.nodes, trie.size, kDefaultCompressedEndings, CATEGORY_COMPRESSED, true);
+    trie_insert_all(trie.nodes, trie.size, kDefaultPackageExts, CATEGORY_PACKAGES, false);
+    trie_insert_all(trie.nodes, trie.size, kDefaultVideoExts, CATEGORY_VIDEO, false);
+    trie_insert_all(trie.nodes, trie.size, kDefaultAudioExts, CATEGORY_AUDIO, false);
+    trie_insert_all(trie.nodes, trie.size, kDefaultImageExts, CATEGORY_IMAGE, false);
+    trie_insert_all(trie.nodes, trie.size, kDefaultDocumentExts, CATEGORY_DOCUMENT, false);
+    return trie;
+}
+
+static constexpr StaticSuffixTrie<kDefaultTrieCapacity> kDefaultTrie = build_default_trie();
+
+constexpr FileCategory classify_default(const char* name) {
+    return trie_classify(kDefaultTrie.nodes, name, const_strlen(name));
+}
+static_assert(classify_default("movie.MP4") == CATEGORY_VIDEO, "extension match is case-insensitive");
+static_assert(classify_default("backup.Tar.Gz") == CATEGORY_COMPRESSED, "multi-part endings win over extensions");
+static_assert(classify_default("x.tar.mp4") == CATEGORY_VIDEO, "only the last extension counts");
+static_assert(classify_default("notes.gz.txt") == CATEGORY_UNKNOWN, "endings must be at the end of the name");
+static_assert(classify_default(".mp4") == CATEGORY_UNKNOWN, "a leading dot is not an extension");
+static_assert(classify_default("mp4") == CATEGORY_UNKNOWN, "extension needs a dot");
+
+// 当前生效的分类树。SetExtensions 后指向运行时重建的树；旧树不释放，保证并发扫描中的读取者安全
+static std::atomic<const SuffixTrieNode*> g_classifier_nodes(kDefaultTrie.nodes);
+static std::mutex g_classifier_mutex;
+static std::vector<std::unique_ptr<SuffixTrieNode[]>> g_classifier_storage;
+
+// 根据当前的扩展名配置重建分类树 (调用方需保证配置不被并发修改)
+static void rebuild_classifier() {
+    size_t capacity = 1;
+    for (const auto& v : g_compressed_endings) capacity += v.size();
+    for (const auto* set : { &g_package_exts, &g_video_exts, &g_audio_exts, &g_image_exts, &g_document_exts }) {
+        for (const auto& v : *set) capacity += v.size();
+    }
+    std::unique_ptr<SuffixTrieNode[]> nodes(new SuffixTrieNode[capacity]);
+    uint32_t size = 1;
+    for (const auto& v : g_compressed_endings) {
+        trie_insert(nodes, size, v.data(), v.size(), CATEGORY_COMPRESSED, true);
+    }
+    auto insert_set = [&](const std::unordered_set<std::string>& set, FileCategory category) {
+        for (const auto& v : set) trie_insert(nodes, size, v.data(), v.size(), category, false);
+    };
+    insert_set(g_package_exts, CATEGORY_PACKAGES);
+    insert_set(g_video_exts, CATEGORY_VIDEO);
+    insert_set(g_audio_exts, CATEGORY_AUDIO);
+    insert_set(g_image_exts, CATEGORY_IMAGE);
+    insert_set(g_document_exts, CATEGORY_DOCUMENT);
+
+    std::lock_guard<std::mutex> lock(g_classifier_mutex);
+    g_classifier_nodes.store(nodes.get(), std::memory_order_release);
+    g_classifier_storage.push_back(std::move(nodes));
+}
+
+// --- 内部辅助函数 ---
+// --- 按文件名分类：不依赖 fs::path，供 getdents64 后端直接传入 d_name 使用 ---
+static FileCategory classify_file_name(const char* name, size_t name_len) {
+    return trie_classify(g_classifier_nodes.load(std::memory_order_acquire), name, name_len);
+}
+
+// --- 扩展名配置的哈希，用于判断持久化索引是否仍然有效 ---
+static uint64_t classifier_config_hash() {
+    uint64_t hash = 1469598103934665603ULL; // FNV-1a
+    auto mix = [&hash](const std::string& v) {
+        for (unsigned char c : v) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        hash ^= 0xFF; // 分隔符，避免 {"ab","c"} 与 {"a","bc"} 冲突
+        hash *= 1099511628211ULL;
+    };
+    auto mix_set = [&](const std::unordered_set<std::string>& set) {
+        std::vector<std::string> sorted(set.begin(), set.end());
+        std::sort(sorted.begin(), sorted.end());
+        for (const auto& v : sorted) mix(v);
+        mix("|");
+    };
+    for (const auto& v : g_compressed_endings) mix(v);
+    mix("|");
+    mix_set(g_package_exts);
+    mix_set(g_video_exts);
+    mix_set(g_audio_exts);
+    mix_set(g_image_exts);
+    mix_set(g_document_exts);
+    return hash;
+}
+
+// --- 更新 get_file_category 函数以支持新枚举和图片 ---
+FileCategory get_file_category(const fs::path& path, const fs::path& trash_path) {
+    std::string filename = path.filename().string();
+    return classify_file_name(filename.data(), filename.size());
+}
+// --- 批量进度投递 ---
+// 扫描线程先把记录追加到自己分片的缓冲区，每攒够一段 (或缓冲时间过长) 才持有一次投递锁，把整段并入当前批次；
+// 由独立的投递线程按 "每 N 个文件或每 M 毫秒" 调用批量回调。
+// 待投递的批次数量有上限：调用方处理过慢、队列已满时不会阻塞扫描，而是丢弃本批的逐文件记录，
+// 只累计到合计值中 (records_dropped)，合计值始终准确。
+class ProgressDispatcher {
+public:
+    void configure(ScanBatchCallback callback, int max_files, int max_interval_ms) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        callback_ = callback;
+        max_files_ = max_files > 0 ? static_cast<size_t>(max_files) : 1024;
+        max_interval_ = std::chrono::milliseconds(max_interval_ms > 0 ? max_interval_ms : 200);
+    }
+
+    // 快速判断是否需要上报，未注册批量回调时扫描线程不做任何额外工作
+    bool active() const { return running_.load(std::memory_order_relaxed); }
+
+    void start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!callback_ || thread_.joinable()) return;
+        active_callback_ = callback_;
+        // 缓冲区最多停留投递间隔的四分之一，记录的延迟仍在约 max_interval_ms 之内
+        handoff_after_ns_.store(std::chrono::duration_cast<std::chrono::nanoseconds>(max_interval_).count() / 4,
+                                std::memory_order_relaxed);
+        stopping_ = false;
+        running_.store(true);
+        thread_ = std::thread(&ProgressDispatcher::deliver_loop, this);
+    }
+
+    // 投递完队列中剩余的批次后结束投递线程
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!thread_.joinable()) return;
+            running_.store(false);
+            seal(false);
+            stopping_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    // 新一轮扫描开始，合计值清零
+    void begin_scan() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        files_reported_ = 0;
+        bytes_reported_ = 0;
+        records_dropped_ = 0;
+    }
+
+    // 记录追加到调用线程自己的缓冲区，不持有任何共享的锁
+    void report(ProgressBuffer& buffer, const std::string& path, uint64_t size, FileCategory category) {
+        if (buffer.records.empty()) {
+            buffer.started = std::chrono::steady_clock::now();
+        }
+        buffer.records.push_back(ProgressRecord{ buffer.paths.size(), path.size(), size, category });
+        buffer.paths.append(path.data(), path.size() + 1); // 连同结尾的 '\0'
+        if (buffer.records.size() >= kHandoffRecords) {
+            handoff(buffer);
+        }
+    }
+
+    // 缓冲时间超过上限时交出 (扫描线程每处理完一个目录调用一次)
+    void handoff_if_stale(ProgressBuffer& buffer) {
+        if (!buffer.records.empty()
+            && std::chrono::steady_clock::now() - buffer.started
+                   >= std::chrono::nanoseconds(handoff_after_ns_.load(std::memory_order_relaxed))) {
+            handoff(buffer);
+        }
+    }
+
+    // 把缓冲区整段并入当前批次，只持有一次投递锁
+    void handoff(ProgressBuffer& buffer) {
+        if (buffer.records.empty()) return;
+        bool sealed = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (running_.load(std::memory_order_relaxed)) {
+                for (const ProgressRecord& r : buffer.records) {
+                    ++files_reported_;
+                    bytes_reported_ += r.size;
+                    if (pending_.records.empty()) {
+                        pending_.started = buffer.started;
+                    }
+                    pending_.records.push_back(ProgressRecord{ pending_.paths.size(), r.path_len, r.size, r.category });
+                    pending_.paths.append(buffer.paths, r.path_offset, r.path_len + 1);
+                    if (pending_.records.size() >= max_files_) {
+                        sealed = seal(false) || sealed;
+                    }
+                }
+            }
+        }
+        buffer.clear();
+        if (sealed) cv_.notify_one();
+    }
+
+    // 一轮扫描结束：立即投递剩余记录，并在合计值中标记 finished
+    void finish_scan() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_.load(std::memory_order_relaxed)) return;
+            seal(true);
+        }
+        cv_.notify_one();
+    }
+
+private:
+    struct Batch {
+        std::string paths; // 本批所有路径首尾相接，各自以 '\0' 结尾
+        std::vector<ProgressRecord> records;
+        std::chrono::steady_clock::time_point started;
+        ScanProgressTotals totals;
+    };
+
+    static const size_t kMaxQueuedBatches = 4;
+    static const size_t kHandoffRecords = 64; // 扫描线程每攒够这么多条记录持有一次投递锁
+
+    // 把当前批次移入投递队列，调用方持有 mutex_。队列已满时丢弃逐文件记录 (合并到下一批)，
+    // 扫描结束的批次 (finished) 总是入队，保证调用方能收到最终的合计值
+    bool seal(bool finished) {
+        if (pending_.records.empty() && !finished) return false;
+        if (queue_.size() >= kMaxQueuedBatches) {
+            records_dropped_ += pending_.records.size();
+            pending_.records.clear();
+            pending_.paths.clear();
+            if (!finished) return false;
+        }
+        pending_.totals.files_reported = files_reported_;
+        pending_.totals.bytes_reported = bytes_reported_;
+        pending_.totals.records_dropped = records_dropped_;
+        pending_.totals.finished = finished ? 1 : 0;
+        queue_.push_back(std::move(pending_));
+        pending_ = Batch();
+        return true;
+    }
+
+    void deliver_loop() {
+        std::vector<ScanProgressRecord> out;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            if (queue_.empty()) {
+                if (stopping_) break;
+                cv_.wait_for(lock, max_interval_);
+                // 文件较少时按时间间隔投递
+                if (queue_.empty() && !pending_.records.empty()
+                    && std::chrono::steady_clock::now() - pending_.started >= max_interval_) {
+                    seal(false);
+                }
+                continue;
+            }
+            Batch batch = std::move(queue_.front());
+            queue_.pop_front();
+            ScanBatchCallback callback = active_callback_;
+            lock.unlock();
+
+            out.resize(batch.records.size());
+            for (size_t i = 0; i < batch.records.size(); ++i) {
+                const ProgressRecord& r = batch.records[i];
+                out[i] = ScanProgressRecord{ batch.paths.c_str() + r.path_offset, r.size, r.category };
+            }
+            callback(out.data(), static_cast<int>(out.size()), &batch.totals);
+
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+    std::atomic<bool> running_{ false };
+    bool stopping_ = false;
+    ScanBatchCallback callback_ = nullptr;        // 由 SetScanProgressCallback 设置，对下一次扫描生效
+    ScanBatchCallback active_callback_ = nullptr; // 投递线程正在使用的回调
+    size_t max_files_ = 1024;
+    std::chrono::milliseconds max_interval_{ 200 };
+    std::atomic<int64_t> handoff_after_ns_{ 50000000 };
+    Batch pending_;
+    std::deque<Batch> queue_;
+    uint64_t files_reported_ = 0;
+    uint64_t bytes_reported_ = 0;
+    uint64_t records_dropped_ = 0;
+};
+
+static ProgressDispatcher g_progress;
+
+// --- 在扫描线程自己的分片中登记一个目录 ---
+// 子目录入队前计入父目录的 pending，子树完成后才会汇总到父目录
+static const SessionDir* add_scan_dir(ResultShard& shard, const SessionDir* parent, const char* name, size_t name_len) {
+    parent->tree.pending.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    SessionDir* dir = shard.add_dir(parent, name, name_len);
+    dir->tree.pending.store(1, std::memory_order_relaxed);
+    return dir;
+}
+
+// --- 将一个已分类且已知大小的文件写入扫描线程自己的分片并通知回调 ---
+// full_path 只用于回调，结果中只保存所在目录和文件名
+static void add_scan_result(ScanSession& session, ResultShard& shard, const SessionDir* dir, const char* name,
+                            size_t name_len, const std::string& full_path, uint64_t file_size, FileCategory category,
+                            ScanCallback callback) {
+    int slot = category_slot(category);
+    dir->tree.add_file(slot, file_size); // 统计所有文件时，未分类的文件只记入目录树
+    if (slot < 0) return;
+    TelemetryCounters::bump(shard.telemetry.files_classified[slot]);
+    TelemetryCounters::bump(shard.telemetry.bytes_found, file_size);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.add_file(slot, dir, name, name_len, file_size);
+        if (shard.snapshot_due(slot)) {
+            shard.publish(slot, g_results_generation.load(std::memory_order_relaxed));
+        }
+    }
+
+    if (!g_progress.active() && !callback) return;
+    uint64_t start = telemetry_now_ns();
+    if (g_progress.active()) {
+        g_progress.report(shard.progress, full_path, file_size, category);
+    }
+    if (callback) {
+        uint64_t total = session.junk_bytes(); // 各分片计数之和，只在需要回调时计算
+        std::lock_guard<std::mutex> lock(g_callback_mutex);
+        callback(full_path.c_str(), file_size, total, category);
+    }
+    TelemetryCounters::bump(shard.telemetry.callback_ns, telemetry_now_ns() - start);
+}
+
+// --- 系统调用计数 ---
+// 每个工作线程先在本地累加，处理完一个目录后再合并到全局计数，避免每个文件都写共享变量。
+struct SyscallCounters {
+    uint64_t dirs_scanned = 0;
+    uint64_t entries_seen = 0;
+    uint64_t open_calls = 0;
+    uint64_t getdents_calls = 0;
+    uint64_t stat_calls = 0;
+    uint64_t close_calls = 0;
+    uint64_t uring_enter_calls = 0;
+    uint64_t uring_statx_ops = 0;
+    uint64_t dirs_from_index = 0;
+};
+
+static std::atomic<uint64_t> g_stat_dirs_scanned(0);
+static std::atomic<uint64_t> g_stat_entries_seen(0);
+static std::atomic<uint64_t> g_stat_open_calls(0);
+static std::atomic<uint64_t> g_stat_getdents_calls(0);
+static std::atomic<uint64_t> g_stat_stat_calls(0);
+static std::atomic<uint64_t> g_stat_close_calls(0);
+static std::atomic<uint64_t> g_stat_uring_enter_calls(0);
+static std::atomic<uint64_t> g_stat_uring_statx_ops(0);
+static std::atomic<uint64_t> g_stat_dirs_from_index(0);
+
+static void flush_syscall_counters(SyscallCounters& c) {
+    g_stat_dirs_scanned.fetch_add(c.dirs_scanned, std::memory_order_relaxed);
+    g_stat_entries_seen.fetch_add(c.entries_seen, std::memory_order_relaxed);
+    g_stat_open_calls.fetch_add(c.open_calls, std::memory_order_relaxed);
+    g_stat_getdents_calls.fetch_add(c.getdents_calls, std::memory_order_relaxed);
+    g_stat_stat_calls.fetch_add(c.stat_calls, std::memory_order_relaxed);
+    g_stat_close_calls.fetch_add(c.close_calls, std::memory_order_relaxed);
+    g_stat_uring_enter_calls.fetch_add(c.uring_enter_calls, std::memory_order_relaxed);
+    g_stat_uring_statx_ops.fetch_add(c.uring_statx_ops, std::memory_order_relaxed);
+    g_stat_dirs_from_index.fetch_add(c.dirs_from_index, std::memory_order_relaxed);
+    c = SyscallCounters();
+}
+
+static void reset_syscall_counters() {
+    g_stat_dirs_scanned = 0;
+    g_stat_entries_seen = 0;
+    g_stat_open_calls = 0;
+    g_stat_getdents_calls = 0;
+    g_stat_stat_calls = 0;
+    g_stat_close_calls = 0;
+    g_stat_uring_enter_calls = 0;
+    g_stat_uring_statx_ops = 0;
+    g_stat_dirs_from_index = 0;
+}
+
+// getdents64 返回的目录项布局 (glibc 2.30 之前没有提供该结构体和包装函数)
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static const size_t kDirentBufferSize = 64 * 1024;
+
+// --- io_uring 批量 statx ---
+// 分类命中的文件先攒成一批，一次 io_uring_enter 提交整批 IORING_OP_STATX (相对父目录 fd)，
+// 冷缓存/机械盘上可以让几百个元数据请求同时在途，而不是逐个阻塞等待。
+static std::atomic<bool> g_scan_use_io_uring(false);
+static const unsigned kStatxBatchSize = 256;
+static const size_t kMaxHeldDirFds = 64; // 批次未完成前需要保持打开的目录 fd 上限
+
+#ifdef DISK_CLEANER_HAVE_IO_URING
+// 最小化的 io_uring 封装，直接使用 io_uring_setup/io_uring_enter 系统调用
+class IoUring {
+public:
+    IoUring() = default;
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+    ~IoUring() { release(); }
+
+    // 内核不支持或被 seccomp 禁用时返回 false，调用方应退回同步路径
+    bool init(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd_ < 0) {
+            return false;
+        }
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) { sq_ring_ = nullptr; release(); return false; }
+        if (single_mmap) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) { cq_ring_ = nullptr; release(); return false; }
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) { release(); return false; }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+        char* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    unsigned capacity() const { return sq_entries_; }
+
+    // 填充一个 IORING_OP_STATX 提交项 (语义同 statx(dir_fd, name, flags, mask, out))
+    void prep_statx(int dir_fd, const char* name, int flags, unsigned mask, struct statx* out, uint64_t user_data) {
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = dir_fd;
+        sqe->addr = reinterpret_cast<uint64_t>(name);
+        sqe->len = mask;
+        sqe->off = reinterpret_cast<uint64_t>(out);
+        sqe->statx_flags = static_cast<uint32_t>(flags);
+        sqe->user_data = user_data;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++unsubmitted_;
+    }
+
+    // 提交所有待提交项，并至少等待 wait_nr 个完成事件
+    int submit_and_wait(unsigned wait_nr) {
+        int ret;
+        do {
+            ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, unsubmitted_, wait_nr,
+                                           IORING_ENTER_GETEVENTS, nullptr, 0));
+        } while (ret < 0 && errno == EINTR);
+        if (ret >= 0) {
+            unsubmitted_ -= std::min<unsigned>(unsubmitted_, static_cast<unsigned>(ret));
+        }
+        return ret;
+    }
+
+    bool pop_completion(uint64_t& user_data, int& result) {
+        unsigned head = *cq_head_;
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        user_data = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    void release() {
+        if (sqes_) munmap(sqes_, sqes_size_);
+        if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+        if (ring_fd_ >= 0) close(ring_fd_);
+        sqes_ = nullptr;
+        sq_ring_ = cq_ring_ = nullptr;
+        ring_fd_ = -1;
+    }
+
+    int ring_fd_ = -1;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned unsubmitted_ = 0;
+};
+#endif // DISK_CLEANER_HAVE_IO_URING
+
+// 等待元数据的一个分类命中文件
+struct PendingStat {
+    int dir_fd;
+    std::string name;  // 相对 dir_fd 的文件名，提交后到完成前必须保持有效
+    std::string path;  // 完整路径，回调时使用
+    const SessionDir* dir; // 所在目录在扫描会话中的记录
+    FileCategory category;
+    struct DirRecord* record; // 启用索引时，结果同时记入该目录的索引记录
+    bool done;
+#ifdef DISK_CLEANER_HAVE_IO_URING
+    struct statx stx;
+#endif
+};
+
+// --- 持久化扫描索引 (增量重扫) ---
+// 索引文件记录上次扫描的目录树：每个目录的 dev/ino/mtime/ctime、子目录以及其下已分类的文件。
+// 重扫时只需 stat 一次目录，时间戳未变就直接复用索引中的结果，只有变化的目录才重新读取。
+// 注意：修改文件内容不会改变目录的 mtime，因此复用目录中的文件大小可能是旧值。
+static std::mutex g_scan_index_mutex;
+static std::string g_scan_index_path; // 为空表示不使用索引
+
+static const char kScanIndexMagic[8] = { 'D', 'C', 'S', 'C', 'I', 'D', 'X', '1' };
+static const uint32_t kScanIndexVersion = 3;
+static const uint32_t kNoIndex = 0xFFFFFFFFu;
+
+// 索引中一段数据的校验和，seed 为前面各段的结果 (定义在重复文件检测的哈希函数之后)
+static uint64_t scan_index_checksum(uint64_t seed, const void* data, size_t len);
+
+// 以下结构体直接映射到索引文件，成员按 8 字节对齐
+struct ScanIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t home_path_len;
+    uint64_t config_hash;   // 扩展名配置的哈希，配置变化后索引失效
+    uint64_t dir_count;
+    uint64_t child_count;
+    uint64_t file_count;
+    uint64_t string_bytes;
+    uint64_t home_path_offset;
+    uint64_t checksum;      // 依次覆盖目录、子目录、文件和字符串各段，不一致时整个索引作废
+};
+
+struct ScanIndexDir {
+    uint64_t path_offset;
+    uint32_t path_len;
+    uint32_t excluded_categories; // 规则排除的类别
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    int64_t ctime_nsec;
+    uint64_t first_child;
+    uint64_t first_file;
+    uint32_t child_count;
+    uint32_t file_count;
+};
+
+struct ScanIndexChild {     // 同一目录下的子目录按名称排序，便于二分查找
+    uint64_t name_offset;
+    uint32_t name_len;
+    uint32_t dir_index;     // kNoIndex 表示上次扫描未能进入该目录
+};
+
+struct ScanIndexFile {
+    uint64_t name_offset;
+    uint64_t size;
+    uint32_t name_len;
+    uint32_t category;
+};
+
+// 扫描过程中为每个目录记录的数据，扫描结束后写入新的索引
+struct IndexedFile {
+    std::string name;
+    uint64_t size;
+    FileCategory category;
+};
+
+struct DirRecord {
+    std::string path;
+    uint32_t excluded_categories;
+    struct stat st;
+    std::vector<IndexedFile> files;
+    std::vector<std::string> subdirs;
+};
+
+static bool same_directory_stamp(const struct stat& st, const ScanIndexDir& d) {
+    return static_cast<uint64_t>(st.st_dev) == d.dev && static_cast<uint64_t>(st.st_ino) == d.ino
+        && st.st_mtim.tv_sec == d.mtime_sec && st.st_mtim.tv_nsec == d.mtime_nsec
+        && st.st_ctim.tv_sec == d.ctime_sec && st.st_ctim.tv_nsec == d.ctime_nsec;
+}
+
+// 只读方式 mmap 的索引文件
+class MappedScanIndex {
+public:
+    MappedScanIndex() = default;
+    MappedScanIndex(const MappedScanIndex&) = delete;
+    MappedScanIndex& operator=(const MappedScanIndex&) = delete;
+    ~MappedScanIndex() {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+    }
+
+    // 文件不存在、格式不符 (包括任何越界的偏移或计数)、校验和不符、记录内容无效、主目录或扩展名配置不一致时返回 false，
+    // 调用方随后完整遍历
+    bool open(const std::string& file, const std::string& home_path, uint64_t config_hash) {
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(ScanIndexHeader))) {
+            close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) return false;
+        data_ = static_cast<const char*>(p);
+        size_ = st.st_size;
+
+        const auto* h = reinterpret_cast<const ScanIndexHeader*>(data_);
+        if (memcmp(h->magic, kScanIndexMagic, sizeof(kScanIndexMagic)) != 0 || h->version != kScanIndexVersion
+            || h->config_hash != config_hash || h->dir_count == 0 || h->dir_count >= kNoIndex) {
+            return false;
+        }
+        // 各段依次排列：先确认每个计数都放得下，再推进偏移，求和不会溢出
+        uint64_t offset = sizeof(ScanIndexHeader);
+        auto take = [&](uint64_t count, size_t item_size) {
+            if (count > (size_ - offset) / item_size) return false;
+            offset += count * item_size;
+            return true;
+        };
+        dirs_ = reinterpret_cast<const ScanIndexDir*>(data_ + offset);
+        if (!take(h->dir_count, sizeof(ScanIndexDir))) return false;
+        children_ = reinterpret_cast<const ScanIndexChild*>(data_ + offset);
+        if (!take(h->child_count, sizeof(ScanIndexChild))) return false;
+        files_ = reinterpret_cast<const ScanIndexFile*>(data_ + offset);
+        if (!take(h->file_count, sizeof(ScanIndexFile))) return false;
+        strings_ = data_ + offset;
+        if (h->string_bytes != size_ - offset || !string_in_range(h, h->home_path_offset, h->home_path_len)
+            || std::string(strings_ + h->home_path_offset, h->home_path_len) != home_path
+            || checksum(h) != h->checksum || !records_valid(h)) {
+            return false;
+        }
+        header_ = h;
+        return true;
+    }
+
+    bool valid() const { return header_ != nullptr; }
+    uint32_t root() const { return 0; }
+
+    const ScanIndexDir* dir(uint32_t index) const {
+        return (header_ && index < header_->dir_count) ? &dirs_[index] : nullptr;
+    }
+    const ScanIndexChild* children(const ScanIndexDir& d) const { return children_ + d.first_child; }
+    const ScanIndexFile* files(const ScanIndexDir& d) const { return files_ + d.first_file; }
+    const char* str(uint64_t offset) const { return strings_ + offset; }
+
+    // 在目录 d 的子目录中按名称查找上次扫描时的目录编号
+    uint32_t find_child(const ScanIndexDir& d, const char* name, size_t name_len) const {
+        const ScanIndexChild* first = children(d);
+        const ScanIndexChild* last = first + d.child_count;
+        auto cmp = [&](const ScanIndexChild& c) {
+            int r = memcmp(str(c.name_offset), name, std::min<size_t>(c.name_len, name_len));
+            return r != 0 ? r : (c.name_len < name_len ? -1 : (c.name_len > name_len ? 1 : 0));
+        };
+        while (first < last) {
+            const ScanIndexChild* mid = first + (last - first) / 2;
+            int r = cmp(*mid);
+            if (r == 0) return mid->dir_index;
+            if (r < 0) first = mid + 1; else last = mid;
+        }
+        return kNoIndex;
+    }
+
+private:
+    static bool range_ok(uint64_t first, uint64_t count, uint64_t total) {
+        return first <= total && count <= total - first;
+    }
+    static bool string_in_range(const ScanIndexHeader* h, uint64_t offset, uint64_t len) {
+        return range_ok(offset, len, h->string_bytes);
+    }
+
+    uint64_t checksum(const ScanIndexHeader* h) const {
+        uint64_t sum = scan_index_checksum(0, dirs_, h->dir_count * sizeof(ScanIndexDir));
+        sum = scan_index_checksum(sum, children_, h->child_count * sizeof(ScanIndexChild));
+        sum = scan_index_checksum(sum, files_, h->file_count * sizeof(ScanIndexFile));
+        return scan_index_checksum(sum, strings_, h->string_bytes);
+    }
+
+    // 名字会直接拼接到目录路径后面：不能为空、不能是 "." 或 ".."，也不能含 '/' 或 NUL，否则可能指向主目录之外
+    bool name_valid(const ScanIndexHeader* h, uint64_t offset, uint32_t len) const {
+        if (!string_in_range(h, offset, len) || len == 0) return false;
+        const char* name = strings_ + offset;
+        if (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.'))) return false;
+        return memchr(name, '/', len) == nullptr && memchr(name, '\0', len) == nullptr;
+    }
+
+    // 某一个扫描类别，或 CATEGORY_UNKNOWN (统计所有文件时只记入目录树的文件)
+    static bool category_valid(uint32_t category) {
+        if (category == CATEGORY_UNKNOWN) return true;
+        for (FileCategory c : kScannedCategories) {
+            if (category == static_cast<uint32_t>(c)) return true;
+        }
+        return false;
+    }
+
+    // 逐条检查目录、子目录和文件记录引用的范围以及名字和类别，之后的访问不再做检查
+    bool records_valid(const ScanIndexHeader* h) const {
+        for (uint64_t i = 0; i < h->dir_count; ++i) {
+            const ScanIndexDir& d = dirs_[i];
+            if (!string_in_range(h, d.path_offset, d.path_len) || !range_ok(d.first_child, d.child_count, h->child_count)
+                || !range_ok(d.first_file, d.file_count, h->file_count)) {
+                return false;
+            }
+        }
+        for (uint64_t i = 0; i < h->child_count; ++i) {
+            const ScanIndexChild& c = children_[i];
+            if (!name_valid(h, c.name_offset, c.name_len) || (c.dir_index != kNoIndex && c.dir_index >= h->dir_count)) {
+                return false;
+            }
+        }
+        for (uint64_t i = 0; i < h->file_count; ++i) {
+            const ScanIndexFile& f = files_[i];
+            if (!name_valid(h, f.name_offset, f.name_len) || !category_valid(f.category)) return false;
+        }
+        return true;
+    }
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    const ScanIndexHeader* header_ = nullptr;
+    const ScanIndexDir* dirs_ = nullptr;
+    const ScanIndexChild* children_ = nullptr;
+    const ScanIndexFile* files_ = nullptr;
+    const char* strings_ = nullptr;
+};
+
+// 将本次扫描的目录记录写成新的索引文件 (先写临时文件再 rename，保证原子替换)
+static bool write_scan_index(const std::string& file, const std::string& home_path, uint64_t config_hash,
+                             std::vector<const DirRecord*>& records) {
+    if (records.empty()) return false;
+    // 根目录必须是 0 号目录
+    for (size_t i = 0; i < records.size(); ++i) {
+        if (records[i]->path == home_path) {
+            std::swap(records[0], records[i]);
+            break;
+        }
+    }
+    if (records[0]->path != home_path) return false;
+
+    std::unordered_map<std::string, uint32_t> dir_index;
+    dir_index.reserve(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        dir_index.emplace(records[i]->path, static_cast<uint32_t>(i));
+    }
+
+    std::vector<ScanIndexDir> dirs(records.size());
+    std::vector<ScanIndexChild> children;
+    std::vector<ScanIndexFile> files;
+    std::string strings;
+    auto add_string = [&](const std::string& v) {
+        uint64_t offset = strings.size();
+        strings.append(v);
+        return offset;
+    };
+
+    ScanIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kScanIndexMagic, sizeof(kScanIndexMagic));
+    header.version = kScanIndexVersion;
+    header.config_hash = config_hash;
+    header.home_path_offset = add_string(home_path);
+    header.home_path_len = static_cast<uint32_t>(home_path.size());
+
+    std::vector<const std::string*> sorted_subdirs;
+    std::string child_path;
+    for (size_t i = 0; i < records.size(); ++i) {
+        const DirRecord& r = *records[i];
+        ScanIndexDir& d = dirs[i];
+        memset(&d, 0, sizeof(d));
+        d.path_offset = add_string(r.path);
+        d.path_len = static_cast<uint32_t>(r.path.size());
+        d.excluded_categories = r.excluded_categories;
+        d.dev = r.st.st_dev;
+        d.ino = r.st.st_ino;
+        d.mtime_sec = r.st.st_mtim.tv_sec;
+        d.mtime_nsec = r.st.st_mtim.tv_nsec;
+        d.ctime_sec = r.st.st_ctim.tv_sec;
+        d.ctime_nsec = r.st.st_ctim.tv_nsec;
+
+        sorted_subdirs.clear();
+        for (const auto& name : r.subdirs) sorted_subdirs.push_back(&name);
+        std::sort(sorted_subdirs.begin(), sorted_subdirs.end(),
+                  [](const std::string* a, const std::string* b) { return *a < *b; });
+        d.first_child = children.size();
+        d.child_count = static_cast<uint32_t>(sorted_subdirs.size());
+        for (const std::string* name : sorted_subdirs) {
+            child_path.assign(r.path);
+            if (child_path.back() != '/') child_path.push_back('/');
+            child_path.append(*name);
+            auto it = dir_index.find(child_path);
+            ScanIndexChild c;
+            c.name_offset = add_string(*name);
+            c.name_len = static_cast<uint32_t>(name->size());
+            c.dir_index = it != dir_index.end() ? it->second : kNoIndex;
+            children.push_back(c);
+        }
+
+        d.first_file = files.size();
+        d.file_count = static_cast<uint32_t>(r.files.size());
+        for (const auto& f : r.files) {
+            ScanIndexFile e;
+            e.name_offset = add_string(f.name);
+            e.name_len = static_cast<uint32_t>(f.name.size());
+            e.size = f.size;
+            e.category = f.category;
+            files.push_back(e);
+        }
+    }
+    header.dir_count = dirs.size();
+    header.child_count = children.size();
+    header.file_count = files.size();
+    header.string_bytes = strings.size();
+    header.checksum = scan_index_checksum(0, dirs.data(), dirs.size() * sizeof(ScanIndexDir));
+    header.checksum = scan_index_checksum(header.checksum, children.data(), children.size() * sizeof(ScanIndexChild));
+    header.checksum = scan_index_checksum(header.checksum, files.data(), files.size() * sizeof(ScanIndexFile));
+    header.checksum = scan_index_checksum(header.checksum, strings.data(), strings.size());
+
+    std::error_code ec;
+    fs::path target(file);
+    if (target.has_parent_path()) fs::create_directories(target.parent_path(), ec);
+    std::string tmp_file = file + ".tmp";
+    // 索引中是主目录的文件清单：只允许本用户读写，不跟随符号链接，也不写入别人预先放好的文件
+    unlink(tmp_file.c_str()); // 上次中断留下的临时文件
+    int fd = ::open(tmp_file.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    FILE* fp = fd >= 0 ? fdopen(fd, "wb") : nullptr;
+    if (!fp) {
+        std::cerr << "Failed to write scan index " << tmp_file << ": " << strerror(errno) << std::endl;
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+        && (dirs.empty() || fwrite(dirs.data(), sizeof(ScanIndexDir), dirs.size(), fp) == dirs.size())
+        && (children.empty() || fwrite(children.data(), sizeof(ScanIndexChild), children.size(), fp) == children.size())
+        && (files.empty() || fwrite(files.data(), sizeof(ScanIndexFile), files.size(), fp) == files.size())
+        && (strings.empty() || fwrite(strings.data(), 1, strings.size(), fp) == strings.size());
+    // 先落盘再替换：崩溃后不会出现空的或只写了一半的索引取代原来完好的索引
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+    if (ok) {
+        fs::rename(tmp_file, target, ec);
+        ok = !ec;
+    }
+    if (!ok) {
+        std::cerr << "Failed to write scan index " << file << std::endl;
+        fs::remove(tmp_file, ec);
+    }
+    return ok;
+}
+
+// --- 扫描规则 (排除 / 包含) ---
+// 规则按目录生效：子目录入队时求值一次，结果 (被排除的类别、是否作为通道进入) 随任务传给子目录，
+// 被剪枝的子树不再产生任何系统调用，目录中的文件也无需逐个比较路径。
+//   不含 '/' 的模式 ("node_modules"、"*.git") 匹配任意深度的目录名，可以含通配符 * ? [...]；
+//   路径规则 ("~/a/b"、主目录下的绝对路径或相对主目录的 "a/b") 编译成按路径分量的前缀树，逐级下行时顺带匹配；
+//   含通配符的路径匹配相对主目录的完整路径 (分量 "**" 匹配任意层)。
+// 通配模式在编译时就转换成自动机：目录名通配是位并行的 NFA (每个字符查一次表)，
+// 所有路径通配规则合成一个按路径分量推进的 NFA，其状态随 RuleState 传给子目录，求值时只看新的一级目录名。
+// 同一目录命中多条规则时按添加顺序依次应用，后添加的覆盖先添加的。
+// 排除规则的类别为 0 时剪掉整棵子树；剪掉的子树 (包括不扫描的隐藏目录) 之下若有路径形式的包含规则，
+// 该子树只作为通道进入：不记录其中的文件，只进入前缀树上的子目录。
+struct ScanRuleSpec {
+    std::string pattern;
+    unsigned int categories; // 0 表示全部类别
+    ScanRuleAction action;
+};
+
+// 默认规则：MoveFiles 是搬迁的目标目录，其中的文件不再作为搬迁候选
+static std::vector<ScanRuleSpec> default_scan_rules() {
+    return { ScanRuleSpec{ "~/MoveFiles", CATEGORY_ALL_MIGRATE, SCAN_RULE_EXCLUDE } };
+}
+
+static std::mutex g_scan_rules_mutex;
+static std::vector<ScanRuleSpec> g_scan_rules = default_scan_rules(); // 受 g_scan_rules_mutex 保护
+static std::atomic<int> g_scan_hidden_policy(SCAN_HIDDEN_SKIP);
+
+static const uint32_t kNoRuleNode = UINT32_MAX;
+static const uint32_t kAllRuleCategories = CATEGORY_ALL_CLEANUP | CATEGORY_ALL_MIGRATE;
+static const uint32_t kScannedCategoryMask = CATEGORY_PACKAGES | CATEGORY_COMPRESSED | CATEGORY_ALL_MIGRATE;
+
+// 所有路径通配规则的状态位合计上限：每条规则占用 "分量数 + 1" 个状态位
+static const uint32_t kMaxPathGlobStates = 64;
+
+// 一个目录的规则求值结果，由父目录的结果加上命中该目录的规则得到
+struct RuleState {
+    uint32_t node = kNoRuleNode; // 在前缀树中的位置，不在树上时为 kNoRuleNode
+    uint32_t excluded = 0;       // 被排除的类别 (FileCategory 位)
+    bool transit = false;        // 只为到达其下的包含规则而进入
+    uint64_t path_globs = 0;     // 路径通配 NFA 的当前状态
+};
+
+// 通配模式中的一个字符位置
+struct GlobToken {
+    enum Kind : uint8_t { kChar, kAny, kStar, kClass } kind;
+    char c;
+    bool negate;               // [!...] / [^...]
+    std::vector<char> ranges;  // 字符类：成对的闭区间端点
+};
+
+// 编译后的单个名字的通配匹配器。不含通配符时直接比较字符串；否则是位并行的 NFA：
+// 状态位 i 表示已匹配前 i 个记号，每读一个字符查一次表做几次位运算，不回溯
+class GlobMatcher {
+public:
+    static const size_t kMaxTokens = 63;
+
+    // 记号数超过 kMaxTokens 时返回 false
+    bool compile(const std::string& pattern) {
+        std::vector<GlobToken> tokens = parse(pattern);
+        literal_ = std::all_of(tokens.begin(), tokens.end(), [](const GlobToken& t) { return t.kind == GlobToken::kChar; });
+        if (literal_) {
+            text_.clear();
+            for (const GlobToken& t : tokens) text_.push_back(t.c);
+            return true;
+        }
+        if (tokens.size() > kMaxTokens) return false;
+        accept_.assign(256, 0);
+        star_ = 0;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            const uint64_t next = 1ULL << (i + 1);
+            if (tokens[i].kind == GlobToken::kStar) {
+                star_ |= next;
+                continue;
+            }
+            for (int c = 0; c < 256; ++c) {
+                if (token_matches(tokens[i], static_cast<char>(c))) accept_[c] |= next;
+            }
+        }
+        final_ = 1ULL << tokens.size();
+        return true;
+    }
+
+    bool match(const char* s, size_t n) const {
+        if (literal_) return n == text_.size() && memcmp(s, text_.data(), n) == 0;
+        uint64_t state = close(1);
+        for (size_t i = 0; i < n && state; ++i) {
+            // 普通记号前进一位；'*' 之后的位置读任意字符都停留
+            state = close(((state << 1) & accept_[static_cast<unsigned char>(s[i])]) | (state & star_));
+        }
+        return (state & final_) != 0;
+    }
+
+    // 模式中的记号数 (字符串比较时为 0)
+    static size_t token_count(const std::string& pattern) {
+        std::vector<GlobToken> tokens = parse(pattern);
+        bool literal = std::all_of(tokens.begin(), tokens.end(), [](const GlobToken& t) { return t.kind == GlobToken::kChar; });
+        return literal ? 0 : tokens.size();
+    }
+
+private:
+    // '*' 可以匹配空串 (连续的 '*' 在解析时已合并，一步即可闭合)
+    uint64_t close(uint64_t state) const { return state | ((state << 1) & star_); }
+
+    static std::vector<GlobToken> parse(const std::string& pattern) {
+        std::vector<GlobToken> tokens;
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            GlobToken t{ GlobToken::kChar, pattern[i], false, {} };
+            if (pattern[i] == '*') {
+                if (!tokens.empty() && tokens.back().kind == GlobToken::kStar) continue;
+                t.kind = GlobToken::kStar;
+            } else if (pattern[i] == '?') {
+                t.kind = GlobToken::kAny;
+            } else if (pattern[i] == '[') {
+                size_t j = i + 1;
+                if (j < pattern.size() && (pattern[j] == '!' || pattern[j] == '^')) { t.negate = true; ++j; }
+                size_t first = j;
+                while (j < pattern.size() && (pattern[j] != ']' || j == first)) {
+                    char lo = pattern[j];
+                    char hi = lo;
+                    if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+                        hi = pattern[j + 2];
+                        j += 2;
+                    }
+                    t.ranges.push_back(lo);
+                    t.ranges.push_back(hi);
+                    ++j;
+                }
+                if (j < pattern.size()) { // 找到了 ']'；否则 '[' 按普通字符处理
+                    t.kind = GlobToken::kClass;
+                    i = j;
+                } else {
+                    t.ranges.clear();
+                    t.negate = false;
+                }
+            } else if (pattern[i] == '\\' && i + 1 < pattern.size()) {
+                t.c = pattern[++i];
+            }
+            tokens.push_back(std::move(t));
+        }
+        return tokens;
+    }
+
+    static bool token_matches(const GlobToken& t, char c) {
+        switch (t.kind) {
+            case GlobToken::kChar: return t.c == c;
+            case GlobToken::kAny: return true;
+            case GlobToken::kClass: {
+                bool in = false;
+                for (size_t i = 0; i + 1 < t.ranges.size() && !in; i += 2) {
+                    in = c >= t.ranges[i] && c <= t.ranges[i + 1];
+                }
+                return in != t.negate;
+            }
+            default: return false;
+        }
+    }
+
+    bool literal_ = true;
+    std::string text_;
+    std::vector<uint64_t> accept_; // 按字符索引：读入该字符后可以到达的状态位
+    uint64_t star_ = 0;            // '*' 之后的状态位
+    uint64_t final_ = 0;
+};
+
+class ScanRules {
+public:
+    static std::shared_ptr<const ScanRules> compile(const std::string& home, const std::vector<ScanRuleSpec>& specs,
+                                                    ScanHiddenPolicy hidden_policy) {
+        std::shared_ptr<ScanRules> rules(new ScanRules());
+        rules->include_hidden_ = hidden_policy == SCAN_HIDDEN_INCLUDE;
+        rules->nodes_.emplace_back();
+        rules->hash_ = 1469598103934665603ULL; // FNV-1a
+        auto mix = [&](const void* data, size_t len) {
+            for (size_t i = 0; i < len; ++i) {
+                rules->hash_ ^= static_cast<const unsigned char*>(data)[i];
+                rules->hash_ *= 1099511628211ULL;
+            }
+        };
+        mix(&hidden_policy, sizeof(hidden_policy));
+        for (const ScanRuleSpec& spec : specs) {
+            std::string relative;
+            if (!relative_pattern(home, spec.pattern, relative)) continue; // 主目录之外的路径与扫描无关
+            const uint32_t index = static_cast<uint32_t>(rules->rules_.size());
+            Rule rule;
+            rule.categories = spec.categories & kAllRuleCategories;
+            rule.action = spec.action;
+            const bool name_rule = is_name_pattern(spec.pattern);
+            if (name_rule) {
+                if (!rule.name.compile(relative)) continue;
+                rule.kind = Rule::kName;
+                rules->glob_rules_.push_back(index);
+            } else if (relative.find_first_of("*?[") == std::string::npos) {
+                rule.node = rules->add_path(relative, index, spec.action == SCAN_RULE_INCLUDE);
+            } else {
+                if (!rules->add_path_glob(relative, rule)) continue; // 超出状态位上限 (AddScanRule 已拒绝)
+                rule.kind = Rule::kPathGlob;
+                rules->glob_rules_.push_back(index);
+            }
+            rules->rules_.push_back(std::move(rule));
+            mix(&name_rule, sizeof(name_rule));
+            mix(relative.data(), relative.size() + 1);
+            mix(&rules->rules_.back().categories, sizeof(uint32_t));
+            mix(&spec.action, sizeof(spec.action));
+        }
+        // 主目录处于每条路径通配规则的起点
+        for (const Rule& rule : rules->rules_) {
+            if (rule.kind == Rule::kPathGlob) rules->root_globs_ |= 1ULL << rule.glob_first;
+        }
+        rules->root_globs_ = rules->close_path_globs(rules->root_globs_);
+        return rules;
+    }
+
+    // 不含 '/' 的模式按目录名匹配
+    static bool is_name_pattern(const std::string& pattern) {
+        return pattern != "~" && pattern.find('/') == std::string::npos;
+    }
+
+    // 检查模式能否编译：每个带通配符的名字不超过 GlobMatcher::kMaxTokens 个记号；
+    // states 返回路径通配规则占用的状态位数 (其它规则为 0)
+    static bool check_pattern(const std::string& pattern, uint32_t& states) {
+        states = 0;
+        if (is_name_pattern(pattern)) return GlobMatcher::token_count(pattern) <= GlobMatcher::kMaxTokens;
+        if (pattern.find_first_of("*?[") == std::string::npos) return true;
+        size_t start = pattern.rfind("~/", 0) == 0 ? 2 : 0;
+        uint32_t segments = 0;
+        while (start <= pattern.size()) {
+            size_t end = pattern.find('/', start);
+            if (end == std::string::npos) end = pattern.size();
+            if (end > start) {
+                if (GlobMatcher::token_count(pattern.substr(start, end - start)) > GlobMatcher::kMaxTokens) return false;
+                ++segments;
+            }
+            start = end + 1;
+        }
+        states = segments + 1;
+        return true;
+    }
+
+    // 参与持久化索引的配置哈希：规则变化后索引失效
+    uint64_t hash() const { return hash_; }
+    bool include_hidden() const { return include_hidden_; }
+
+    // 扫描根目录 (主目录) 的状态："~" 本身也可以是规则的目标
+    RuleState root() const {
+        RuleState state;
+        state.node = 0;
+        state.path_globs = root_globs_;
+        bool pruned = false;
+        for (uint32_t r : nodes_[0].rules) apply(rules_[r], state, pruned);
+        return state;
+    }
+
+    // 隐藏的目录项是否要交给后续判断："." 和 ".." 总是跳过；不扫描隐藏项时，
+    // 只有父目录在前缀树上 (可能通向包含规则) 的隐藏目录才需要求值 (DT_UNKNOWN 的类型要 stat 后才知道)
+    bool visit_hidden(const RuleState& parent, const char* name, unsigned char type) const {
+        if (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')) return false;
+        if (include_hidden_) return true;
+        return parent.node != kNoRuleNode && (type == DT_DIR || type == DT_UNKNOWN);
+    }
+
+    // 子目录的状态；返回 false 表示整棵子树被剪枝，不需要入队。
+    // apply_hidden 为 false 时不按隐藏目录处理 (清理缓存时使用)
+    bool enter(const RuleState& parent, const char* name, size_t name_len, RuleState& out,
+               bool apply_hidden = true) const {
+        out.node = parent.node != kNoRuleNode ? find_child(parent.node, name, name_len) : kNoRuleNode;
+        if (parent.transit && out.node == kNoRuleNode) return false;
+        out.excluded = parent.excluded;
+        out.path_globs = step_path_globs(parent.path_globs, name, name_len);
+        bool pruned = parent.transit || (apply_hidden && name[0] == '.' && !include_hidden_);
+
+        // 前缀树节点上的规则与通配规则都按下标升序，归并后即为添加顺序
+        static const std::vector<uint32_t> kNone;
+        const std::vector<uint32_t>& node_rules = out.node != kNoRuleNode ? nodes_[out.node].rules : kNone;
+        size_t a = 0, b = 0;
+        while (a < node_rules.size() || b < glob_rules_.size()) {
+            uint32_t r;
+            if (b == glob_rules_.size() || (a < node_rules.size() && node_rules[a] < glob_rules_[b])) {
+                r = node_rules[a++];
+            } else {
+                r = glob_rules_[b++];
+                const Rule& rule = rules_[r];
+                const bool matched = rule.kind == Rule::kName ? rule.name.match(name, name_len)
+                                                               : (out.path_globs >> rule.glob_last) & 1;
+                if (!matched) continue;
+            }
+            apply(rules_[r], out, pruned);
+        }
+
+        out.transit = false;
+        if (pruned) return make_transit(out);
+        return true;
+    }
+
+    // 把被剪枝的目录改为通道：其下没有包含规则时返回 false
+    bool make_transit(RuleState& state) const {
+        if (state.node == kNoRuleNode || !nodes_[state.node].include_below) return false;
+        state.transit = true;
+        return true;
+    }
+
+private:
+    struct Rule {
+        enum Kind : uint8_t { kPath, kName, kPathGlob } kind = kPath;
+        uint32_t categories = 0;
+        ScanRuleAction action = SCAN_RULE_EXCLUDE;
+        uint32_t node = kNoRuleNode; // 路径规则在前缀树中的节点
+        GlobMatcher name;            // 目录名规则
+        uint32_t glob_first = 0;     // 路径通配规则在 NFA 中的起始和接受状态位
+        uint32_t glob_last = 0;
+    };
+
+    // 路径通配 NFA 的一个状态位：从该位读入一级目录名的方式
+    struct GlobState {
+        bool any = false;    // "**"：停留在本位，也可以不消耗目录直接前进
+        bool accept = false; // 规则的接受位，不再前进
+        GlobMatcher segment;
+    };
+
+    struct Node {
+        std::vector<std::pair<std::string, uint32_t>> children; // 分量名 -> 节点下标
+        std::vector<uint32_t> rules;                            // 恰好终止于此的规则 (下标升序)
+        bool include_below = false;                             // 子孙节点上有包含规则
+    };
+
+    ScanRules() = default;
+
+    // 转换为相对主目录的形式，去掉多余的 '/'；"~" 或主目录本身得到空串
+    static bool relative_pattern(const std::string& home, const std::string& pattern, std::string& out) {
+        std::string p = pattern;
+        if (p == "~" || p.rfind("~/", 0) == 0) {
+            p = p.size() > 1 ? p.substr(2) : std::string();
+        } else if (!p.empty() && p[0] == '/') {
+            if (p.compare(0, home.size(), home) != 0 || (p.size() > home.size() && p[home.size()] != '/')) return false;
+            p = p.substr(std::min(p.size(), home.size() + 1));
+        }
+        out.clear();
+        for (char c : p) {
+            if (c == '/' && (out.empty() || out.back() == '/')) continue;
+            out.push_back(c);
+        }
+        if (!out.empty() && out.back() == '/') out.pop_back();
+        return true;
+    }
+
+    uint32_t add_path(const std::string& relative, uint32_t rule, bool include) {
+        uint32_t node = 0;
+        size_t start = 0;
+        while (start < relative.size()) {
+            size_t end = relative.find('/', start);
+            if (end == std::string::npos) end = relative.size();
+            if (include) nodes_[node].include_below = true;
+            uint32_t child = find_child(node, relative.data() + start, end - start);
+            if (child == kNoRuleNode) {
+                child = static_cast<uint32_t>(nodes_.size());
+                nodes_[node].children.emplace_back(relative.substr(start, end - start), child);
+                nodes_.emplace_back(); // 可能使 nodes_[node] 失效，之后不再使用该引用
+            }
+            node = child;
+            start = end + 1;
+        }
+        nodes_[node].rules.push_back(rule);
+        return node;
+    }
+
+    // 把路径通配规则的各个分量接到 NFA 上 (相邻的 "**" 合并)
+    bool add_path_glob(const std::string& relative, Rule& rule) {
+        std::vector<GlobState> states;
+        size_t start = 0;
+        while (start <= relative.size()) {
+            size_t end = relative.find('/', start);
+            if (end == std::string::npos) end = relative.size();
+            std::string segment = relative.substr(start, end - start);
+            start = end + 1;
+            GlobState state;
+            state.any = segment == "**";
+            if (state.any && !states.empty() && states.back().any) continue;
+            if (!state.any && !state.segment.compile(segment)) return false;
+            states.push_back(std::move(state));
+        }
+        states.emplace_back();
+        states.back().accept = true;
+        if (glob_states_.size() + states.size() > kMaxPathGlobStates) return false;
+        rule.glob_first = static_cast<uint32_t>(glob_states_.size());
+        rule.glob_last = rule.glob_first + static_cast<uint32_t>(states.size()) - 1;
+        for (uint32_t i = 0; i + 1 < states.size(); ++i) {
+            if (states[i].any) glob_any_ |= 1ULL << (rule.glob_first + i + 1);
+        }
+        for (auto& state : states) glob_states_.push_back(std::move(state));
+        return true;
+    }
+
+    // "**" 可以匹配零级目录
+    uint64_t close_path_globs(uint64_t state) const { return state | ((state << 1) & glob_any_); }
+
+    // 进入名为 name 的子目录后的 NFA 状态：只对当前活跃的状态位匹配一次目录名
+    uint64_t step_path_globs(uint64_t state, const char* name, size_t name_len) const {
+        uint64_t next = 0;
+        while (state) {
+            const int i = __builtin_ctzll(state);
+            state &= state - 1;
+            const GlobState& g = glob_states_[i];
+            if (g.accept) continue;
+            if (g.any) {
+                next |= 1ULL << i;
+            } else if (g.segment.match(name, name_len)) {
+                next |= 1ULL << (i + 1);
+            }
+        }
+        return close_path_globs(next);
+    }
+
+    uint32_t find_child(uint32_t node, const char* name, size_t name_len) const {
+        for (const auto& child : nodes_[node].children) {
+            if (child.first.size() == name_len && memcmp(child.first.data(), name, name_len) == 0) return child.second;
+        }
+        return kNoRuleNode;
+    }
+
+    static void apply(const Rule& rule, RuleState& state, bool& pruned) {
+        const uint32_t categories = rule.categories ? rule.categories : kAllRuleCategories;
+        if (rule.action == SCAN_RULE_EXCLUDE) {
+            if (rule.categories) state.excluded |= categories;
+            else pruned = true;
+        } else if (pruned) {
+            // 包含规则重新打开被剪枝的目录时，只有它列出的类别有效
+            state.excluded = kAllRuleCategories & ~categories;
+            pruned = false;
+        } else {
+            state.excluded &= ~categories;
+        }
+    }
+
+    std::vector<Rule> rules_;
+    std::vector<Node> nodes_;            // 0 号为主目录
+    std::vector<uint32_t> glob_rules_;   // 目录名规则和路径通配规则的下标 (升序)
+    std::vector<GlobState> glob_states_; // 所有路径通配规则共用的 NFA
+    uint64_t glob_any_ = 0;              // "**" 之后的状态位
+    uint64_t root_globs_ = 0;            // 主目录的 NFA 状态
+    bool include_hidden_ = false;
+    uint64_t hash_ = 0;
+};
+
+static std::shared_ptr<const ScanRules> compile_scan_rules(const std::string& home) {
+    std::lock_guard<std::mutex> lock(g_scan_rules_mutex);
+    return ScanRules::compile(home, g_scan_rules, static_cast<ScanHiddenPolicy>(g_scan_hidden_policy.load()));
+}
+
+// --- 监视模式：目录 watch 登记表 ---
+// 扫描时为每个访问到的目录登记 inotify watch，之后由监视线程根据事件增量更新结果。
+struct WatchedDir {
+    std::string path;
+    RuleState rules;
+    const SessionDir* dir; // 在扫描会话中的目录记录
+};
+
+class WatchRegistry {
+public:
+    WatchRegistry() = default;
+    WatchRegistry(const WatchRegistry&) = delete;
+    WatchRegistry& operator=(const WatchRegistry&) = delete;
+    ~WatchRegistry() { shutdown(); }
+
+    bool init() {
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        return fd_ >= 0;
+    }
+
+    int fd() const { return fd_; }
+
+    // watch 数量达到 max_user_watches 上限后返回 true，监视模式需要降级为定期增量重扫
+    bool exhausted() const { return exhausted_.load(); }
+
+    // 可被多个扫描线程并发调用
+    void add_directory(const std::string& path, const RuleState& rules, const SessionDir* dir) {
+        if (fd_ < 0 || exhausted_.load(std::memory_order_relaxed)) return;
+        int wd = inotify_add_watch(fd_, path.c_str(), kWatchMask);
+        if (wd < 0) {
+            if (errno == ENOSPC) {
+                std::cerr << "[警告] inotify watch 数量已达上限，监视模式将降级为定期重扫。" << std::endl;
+                exhausted_.store(true);
+            }
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto old = dirs_.find(wd); // 同一目录再次登记 (inotify 返回同一个 wd)，路径可能已经变化
+        if (old != dirs_.end()) unindex(old->first, old->second.path);
+        dirs_[wd] = WatchedDir{ path, rules, dir };
+        by_path_[path] = wd;
+    }
+
+    bool lookup(int wd, WatchedDir& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = dirs_.find(wd);
+        if (it == dirs_.end()) return false;
+        out = it->second;
+        return true;
+    }
+
+    void forget(int wd) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = dirs_.find(wd);
+        if (it == dirs_.end()) return;
+        unindex(wd, it->second.path);
+        dirs_.erase(it);
+    }
+
+    // 目录被移出或删除时，移除它及其所有子目录的 watch。
+    // 按路径有序的索引中，子树是 "dir/" 开头的一段连续区间，只访问这棵子树
+    void remove_subtree(const std::string& dir_path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const std::string prefix = dir_path + "/";
+        auto it = by_path_.find(dir_path);
+        if (it != by_path_.end()) it = remove_indexed(it);
+        for (it = by_path_.lower_bound(prefix); it != by_path_.end() && it->first.compare(0, prefix.size(), prefix) == 0;) {
+            it = remove_indexed(it);
+        }
+    }
+
+    void shutdown() {
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+        std::lock_guard<std::mutex> lock(mutex_);
+        dirs_.clear();
+        by_path_.clear();
+    }
+
+    static const uint32_t kWatchMask = IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_CLOSE_WRITE
+                                     | IN_DELETE_SELF | IN_EXCL_UNLINK | IN_ONLYDIR;
+
+private:
+    // 以下函数的调用方都必须持有 mutex_
+    void unindex(int wd, const std::string& path) {
+        auto it = by_path_.find(path);
+        if (it != by_path_.end() && it->second == wd) by_path_.erase(it); // 该路径可能已由新目录的 wd 占用
+    }
+
+    std::map<std::string, int>::iterator remove_indexed(std::map<std::string, int>::iterator it) {
+        inotify_rm_watch(fd_, it->second);
+        dirs_.erase(it->second);
+        return by_path_.erase(it);
+    }
+
+    int fd_ = -1;
+    std::atomic<bool> exhausted_{ false };
+    std::mutex mutex_;
+    std::unordered_map<int, WatchedDir> dirs_;
+    std::map<std::string, int> by_path_; // 路径 -> wd，有序，用于按子树移除
+};
+
+// 速率上限 (令牌桶)：每次处理前按数量预约时间片，所有工作线程共用一个实例。
+// 搬迁按字节限制复制带宽 (rename 和 reflink 不受限制)，扫描按目录项数限制遍历速度。
+class BandwidthLimiter {
+public:
+    void set_rate(uint64_t units_per_second) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rate_ = units_per_second;
+    }
+
+    // 复制限速时使用较小的块，让速率更平滑、取消更及时
+    size_t chunk_size(size_t max_chunk) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (rate_ == 0) return max_chunk;
+        return static_cast<size_t>(std::min<uint64_t>(max_chunk, std::max<uint64_t>(64 << 10, rate_ / 8)));
+    }
+
+    // 等待到可以处理 units 个单位为止；cancel 置位时提前返回 false
+    bool acquire(uint64_t units, const std::atomic<bool>* cancel) {
+        std::chrono::steady_clock::time_point start;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (rate_ == 0) return true;
+            auto now = std::chrono::steady_clock::now();
+            if (next_ < now) next_ = now; // 空闲时间不累积成突发流量
+            start = next_;
+            next_ += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(static_cast<double>(units) / rate_));
+        }
+        while (std::chrono::steady_clock::now() < start) {
+            if (cancel && cancel->load()) return false;
+            auto remaining = start - std::chrono::steady_clock::now();
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(remaining, std::chrono::milliseconds(50)));
+        }
+        return true;
+    }
+
+    // 归还预约了却没有用掉的单位 (短读、调用失败)，后续的预约相应提前
+    void release(uint64_t units) {
+        if (units == 0) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (rate_ == 0) return;
+        next_ -= std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(units) / rate_));
+    }
+
+private:
+    std::mutex mutex_;
+    uint64_t rate_ = 0; // 单位/秒，0 表示不限速
+    std::chrono::steady_clock::time_point next_;
+};
+
+// 只作用于当前线程：nice 19 + IOPRIO_CLASS_IDLE (只有磁盘空闲时才会被调度 I/O)
+static void lower_thread_priority() {
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    setpriority(PRIO_PROCESS, static_cast<id_t>(tid), 19);
+#ifdef SYS_ioprio_set
+    const int kIoprioWhoProcess = 1;
+    const int kIoprioClassIdle = 3;
+    const int kIoprioClassShift = 13;
+    syscall(SYS_ioprio_set, kIoprioWhoProcess, tid, kIoprioClassIdle << kIoprioClassShift);
+#endif
+}
+
+// --- 后台扫描策略 ---
+// 后台模式下扫描线程使用最低的 CPU 和 I/O 优先级，并在系统调用变慢或系统 I/O 压力升高时主动休眠：
+// 每处理完一个目录，按 "退让级别 × 该目录的耗时" 休眠，级别在拥塞时翻倍、恢复后逐步降低。
+// 每秒目录项预算在任何模式下都生效。
+static std::atomic<int> g_scan_policy(SCAN_POLICY_NORMAL);
+static std::atomic<uint64_t> g_scan_max_entries_per_second(0); // 0 表示不限制
+
+// /proc/pressure/io 的 "some avg10"：最近 10 秒内至少有一个任务在等待 I/O 的时间百分比；不支持 PSI 时返回 -1
+static double read_io_pressure() {
+    FILE* f = fopen("/proc/pressure/io", "re");
+    if (!f) return -1;
+    double avg10 = -1;
+    if (fscanf(f, "some avg10=%lf", &avg10) != 1) avg10 = -1;
+    fclose(f);
+    return avg10;
+}
+
+class ScanThrottle {
+public:
+    // 每个工作线程各自的退让状态
+    struct WorkerState {
+        unsigned level = 0;        // 退让级别：每个目录之后休眠 level 倍的处理耗时
+        double latency_ewma = 0;   // 每个目录项的系统调用耗时 (纳秒) 的滑动平均
+    };
+
+    ScanThrottle(bool adaptive, uint64_t max_entries_per_second)
+        : adaptive_(adaptive), limited_(max_entries_per_second > 0) {
+        budget_.set_rate(max_entries_per_second);
+    }
+
+    bool active() const { return adaptive_ || limited_; }
+
+    // 每处理完一个目录调用一次。busy_ns: 处理该目录的总耗时；syscall_ns: 其中读目录和取大小的耗时；
+    // entries: 该目录的目录项数。返回休眠的纳秒数
+    uint64_t after_directory(WorkerState& state, uint64_t busy_ns, uint64_t syscall_ns, uint64_t entries) {
+        const uint64_t start = telemetry_now_ns();
+        if (limited_ && !budget_.acquire(entries + 1, &g_stop_scan_flag)) {
+            return telemetry_now_ns() - start;
+        }
+        if (adaptive_) {
+            if (congested(state, static_cast<double>(syscall_ns) / static_cast<double>(entries + 1))) {
+                state.level = state.level ? std::min(state.level * 2, kMaxLevel) : 1;
+            } else {
+                state.level -= (state.level + 3) / 4;
+            }
+            if (state.level > 0) {
+                sleep_interruptible(std::min<uint64_t>(busy_ns * state.level, kMaxSleepNs));
+            }
+        }
+        return telemetry_now_ns() - start;
+    }
+
+private:
+    static constexpr unsigned kMaxLevel = 16;
+    static constexpr uint64_t kMaxSleepNs = 200000000ULL;        // 单次最多休眠 200 毫秒
+    static constexpr uint64_t kPressureIntervalNs = 1000000000ULL; // 每秒读取一次 PSI
+    static constexpr double kPressureThreshold = 10.0;           // some avg10 超过 10% 视为 I/O 拥塞
+    static constexpr double kLatencyFactor = 4.0;                // 延迟超过基线 4 倍视为拥塞
+
+    // 延迟基线取各线程观察到的最低滑动平均，并缓慢上浮，避免一次偶然的快速目录把基线压得过低
+    bool congested(WorkerState& state, double latency) {
+        state.latency_ewma = state.latency_ewma > 0 ? state.latency_ewma + (latency - state.latency_ewma) / 8 : latency;
+        double baseline = latency_baseline_.load(std::memory_order_relaxed);
+        if (baseline <= 0 || state.latency_ewma < baseline) {
+            baseline = state.latency_ewma;
+        } else {
+            baseline += (state.latency_ewma - baseline) / 1024;
+        }
+        latency_baseline_.store(baseline, std::memory_order_relaxed);
+        return state.latency_ewma > baseline * kLatencyFactor || io_pressure_high();
+    }
+
+    // 由恰好到期的那个线程读取一次，其余线程沿用结果
+    bool io_pressure_high() {
+        uint64_t now = telemetry_now_ns();
+        uint64_t last = pressure_checked_ns_.load(std::memory_order_relaxed);
+        if (now - last >= kPressureIntervalNs
+            && pressure_checked_ns_.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+            pressure_high_.store(read_io_pressure() >= kPressureThreshold, std::memory_order_relaxed);
+        }
+        return pressure_high_.load(std::memory_order_relaxed);
+    }
+
+    // 分段休眠，StopScan 后尽快返回
+    static void sleep_interruptible(uint64_t ns) {
+        const uint64_t deadline = telemetry_now_ns() + ns;
+        for (uint64_t now = telemetry_now_ns(); now < deadline && !g_stop_scan_flag.load(); now = telemetry_now_ns()) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<uint64_t>(deadline - now, 10000000ULL)));
+        }
+    }
+
+    const bool adaptive_;
+    const bool limited_;
+    BandwidthLimiter budget_;
+    std::atomic<double> latency_baseline_{ 0 };
+    std::atomic<uint64_t> pressure_checked_ns_{ 0 };
+    std::atomic<bool> pressure_high_{ false };
+};
+
+// --- 多线程工作窃取扫描引擎 ---
+// 每个工作线程持有一个待扫描目录的双端队列：自己从队尾取 (LIFO，保持局部性)，
+// 空闲时从其它线程的队首窃取 (FIFO，窃取到的通常是较大的子树)。
+static std::atomic<int> g_scan_worker_count(0); // 0 表示使用 hardware_concurrency
+static std::atomic<int> g_scan_backend(SCAN_BACKEND_STD_FILESYSTEM);
+static std::atomic<int> g_directory_tree_mode(DIRECTORY_TREE_SCANNED_FILES);
+
+// --- 按设备调度 ---
+// 扫描不进入指向目录的符号链接，设备只会在挂载点处变化：开始扫描时从 /proc/self/mountinfo 取出主目录之下的挂载点，
+// 入队子目录时查表即可知道它属于哪个设备，不需要额外的 stat。每个设备有自己的一组任务队列和并发上限，
+// 机械盘 (或慢速 U 盘) 上同时只有少数线程在读，其余线程继续处理固态盘上的目录，不会被拖住。
+static std::atomic<int> g_scan_rotational_concurrency(2);
+static std::atomic<int> g_scan_solid_state_concurrency(0); // 0 表示不限制 (等于扫描线程数)
+static std::atomic<bool> g_scan_one_file_system(false);
+static std::atomic<int> g_scan_inode_order(SCAN_INODE_ORDER_AUTO);
+
+struct MountPoint {
+    std::string path;
+    dev_t dev;
+};
+
+// mountinfo 中的路径把空格、制表符、换行和反斜杠转义为 \ooo
+static std::string unescape_mount_path(const char* s) {
+    std::string out;
+    for (; *s; ++s) {
+        if (s[0] == '\\' && s[1] >= '0' && s[1] <= '7' && s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+            out.push_back(static_cast<char>((s[1] - '0') * 64 + (s[2] - '0') * 8 + (s[3] - '0')));
+            s += 3;
+        } else {
+            out.push_back(*s);
+        }
+    }
+    return out;
+}
+
+// 每行: "36 35 98:0 /mnt1 /mnt/parent rw,noatime master:1 - ext3 /dev/root rw"，取设备号 (第 3 列) 和挂载点 (第 5 列)；
+// 同一路径被多次挂载时以最后一次为准
+static std::vector<MountPoint> read_mount_points() {
+    std::vector<MountPoint> mounts;
+    FILE* f = fopen("/proc/self/mountinfo", "re");
+    if (!f) return mounts;
+    char line[4096];
+    char mount_path[4096];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned major_id = 0, minor_id = 0;
+        if (sscanf(line, "%*d %*d %u:%u %*s %4095s", &major_id, &minor_id, mount_path) == 3) {
+            mounts.push_back(MountPoint{ unescape_mount_path(mount_path), makedev(major_id, minor_id) });
+        }
+    }
+    fclose(f);
+    return mounts;
+}
+
+// 1 表示机械盘，0 表示固态盘，-1 表示未知 (tmpfs、网络文件系统等没有块设备的文件系统)。
+// 分区本身没有 queue 目录，需要到所属磁盘 (sysfs 中的上一级目录) 读取
+static int device_rotational(dev_t dev) {
+    if (major(dev) == 0) return -1;
+    const std::string block = "/sys/dev/block/" + std::to_string(major(dev)) + ":" + std::to_string(minor(dev));
+    std::vector<std::string> candidates{ block + "/queue/rotational" };
+    std::error_code ec;
+    fs::path resolved = fs::canonical(block, ec);
+    if (!ec) candidates.push_back((resolved.parent_path() / "queue/rotational").native());
+    for (const std::string& queue : candidates) {
+        FILE* f = fopen(queue.c_str(), "re");
+        if (!f) continue;
+        int value = fgetc(f);
+        fclose(f);
+        if (value == '0' || value == '1') return value - '0';
+    }
+    return -1;
+}
+
+struct ScanTask {
+    fs::path path;
+    RuleState rules;       // 该目录的规则求值结果
+    uint32_t index_hint;   // 该目录在上次扫描索引中的编号，kNoIndex 表示没有
+    const SessionDir* dir; // 该目录在扫描会话中的记录
+    uint32_t device;       // 该目录所在设备在扫描器设备表中的下标
+};
+
+class WorkStealingScanner {
+public:
+    // 工作线程数等于会话的分片数，i 号线程只写 i 号分片
+    WorkStealingScanner(ScanSession& session, ScanBackend backend, ScanCallback callback, const ScanRules& rules,
+                        const MappedScanIndex* index, bool record_index, WatchRegistry* watch, bool size_all_files)
+        : session_(session), backend_(backend), use_io_uring_(g_scan_use_io_uring.load()), size_all_files_(size_all_files),
+          background_(g_scan_policy.load() == SCAN_POLICY_BACKGROUND),
+          throttle_(background_, g_scan_max_entries_per_second.load()), callback_(callback),
+          rules_(rules), index_(index), record_index_(record_index),
+          index_changed_(false), watch_(watch), one_file_system_(g_scan_one_file_system.load()), pending_(0) {
+        for (size_t i = 0; i < session.shard_count(); ++i) {
+            workers_.emplace_back(new WorkerContext());
+            workers_.back()->shard = &session.shard(i);
+        }
+    }
+
+    // 阻塞直到整棵目录树扫描完毕或收到停止请求
+    void run(const fs::path& root) {
+        uint32_t root_device = init_devices(root.native());
+        push(0, ScanTask{ root, rules_.root(), index_ ? index_->root() : kNoIndex, session_.root(), root_device });
+        std::vector<std::thread> threads;
+        // 后台模式要降低线程优先级，0 号工作线程也单独创建，调用线程 (扫描线程或监视线程) 的优先级保持不变
+        for (size_t i = background_ ? 0 : 1; i < workers_.size(); ++i) {
+            threads.emplace_back(&WorkStealingScanner::worker_loop, this, static_cast<int>(i));
+        }
+        if (!background_) {
+            worker_loop(0); // 当前线程作为 0 号工作线程参与扫描
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    // 与上次索引相比是否有目录发生了变化 (没有变化时无需重写索引文件)
+    bool index_changed() const { return index_changed_.load(); }
+
+    void collect_records(std::vector<const DirRecord*>& out) const {
+        for (const auto& w : workers_) {
+            for (const auto& r : w->records) out.push_back(&r);
+        }
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<ScanTask> tasks;
+    };
+
+    // 一个块设备：每个工作线程在其上各有一个任务队列，同时处理该设备目录的线程数不超过 limit
+    struct ScanDevice {
+        dev_t dev;
+        int limit;
+        bool unlimited;   // limit 不小于线程数时无需计数
+        bool inode_order; // 按 inode 顺序处理目录项 (机械盘)
+        std::atomic<int> active{ 0 };
+        std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+        bool try_acquire() {
+            if (unlimited) return true;
+            int n = active.load(std::memory_order_relaxed);
+            while (n < limit) {
+                if (active.compare_exchange_weak(n, n + 1, std::memory_order_acquire)) return true;
+            }
+            return false;
+        }
+
+        void release() {
+            if (!unlimited) active.fetch_sub(1, std::memory_order_release);
+        }
+    };
+
+    // 按 inode 顺序处理时暂存的目录项
+    struct SortedDirent {
+        uint64_t ino;
+        uint32_t name_offset;
+        uint32_t name_len;
+        unsigned char type;
+    };
+
+    // 每个工作线程私有的状态，只被所属线程访问
+    struct WorkerContext {
+        std::vector<char> dirent_buffer;
+        SyscallCounters counters;
+#ifdef DISK_CLEANER_HAVE_IO_URING
+        std::unique_ptr<IoUring> ring;
+#endif
+        bool ring_unavailable = false;
+        std::vector<PendingStat> stat_batch; // 预分配后重复使用，字符串容量也会被复用
+        size_t stat_batch_count = 0;
+        std::vector<int> held_dir_fds;       // 本批次 statx 完成前不能关闭的目录 fd
+        std::deque<DirRecord> records;       // 启用索引时本线程扫描过的目录 (deque 保证地址稳定)
+        DirRecord* current_record = nullptr;
+        const ScanIndexDir* current_old = nullptr;
+        ResultShard* shard = nullptr;        // 本线程独占写入的结果分片
+        unsigned classify_count = 0;         // 用于抽样计时分类
+        ScanThrottle::WorkerState throttle;  // 后台模式的退让状态
+        size_t device = 0;                   // 上一个目录所在的设备，下次优先从这里取任务
+        std::vector<SortedDirent> sorted;    // 按 inode 排序时暂存整个目录的目录项
+        std::string sorted_names;            // 以上目录项的文件名 (以 '\0' 分隔)
+    };
+
+    // 建立设备表并返回根目录所在的设备。主目录之外的挂载点与本次扫描无关；
+    // 同一设备的多个挂载点 (例如 bind mount) 共用一个设备项
+    uint32_t init_devices(const std::string& root) {
+        const int workers = static_cast<int>(workers_.size());
+        auto device_index = [&](dev_t dev) {
+            for (size_t i = 0; i < devices_.size(); ++i) {
+                if (devices_[i]->dev == dev) return static_cast<uint32_t>(i);
+            }
+            std::unique_ptr<ScanDevice> d(new ScanDevice());
+            d->dev = dev;
+            int rotational = device_rotational(dev);
+            const int order = g_scan_inode_order.load();
+            d->inode_order = order == SCAN_INODE_ORDER_ON || (order == SCAN_INODE_ORDER_AUTO && rotational == 1);
+            int limit = rotational == 1 ? g_scan_rotational_concurrency.load()
+                      : rotational == 0 ? g_scan_solid_state_concurrency.load() : 0;
+            d->limit = limit > 0 ? std::min(limit, workers) : workers;
+            d->unlimited = d->limit >= workers;
+            for (int i = 0; i < workers; ++i) d->queues.emplace_back(new WorkerQueue());
+            devices_.push_back(std::move(d));
+            return static_cast<uint32_t>(devices_.size() - 1);
+        };
+
+        dev_t root_dev = 0;
+        size_t root_match = 0;
+        std::vector<MountPoint> inside;
+        for (MountPoint& m : read_mount_points()) {
+            if (m.path.size() > root.size() && m.path.compare(0, root.size(), root) == 0
+                && (root.back() == '/' || m.path[root.size()] == '/')) {
+                inside.push_back(std::move(m));
+            } else if (root.compare(0, m.path.size(), m.path) == 0 && m.path.size() >= root_match
+                       && (m.path.size() == root.size() || m.path.back() == '/' || root[m.path.size()] == '/')) {
+                root_dev = m.dev;
+                root_match = m.path.size();
+            }
+        }
+        uint32_t root_device = device_index(root_dev);
+        for (const MountPoint& m : inside) {
+            mount_devices_[m.path] = device_index(m.dev);
+        }
+        return root_device;
+    }
+
+    // 子目录所在的设备；不跨文件系统时遇到其它设备的挂载点返回 -1，该子目录不入队
+    int64_t child_device(const ScanTask& parent, const std::string& child_path) const {
+        if (mount_devices_.empty()) return parent.device;
+        auto it = mount_devices_.find(child_path);
+        if (it == mount_devices_.end()) return parent.device;
+        if (one_file_system_ && it->second != parent.device) return -1;
+        return it->second;
+    }
+
+    void push(int id, ScanTask task) {
+        // 必须先增加计数再入队，否则其它线程可能误判扫描已结束
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        WorkerQueue& q = *devices_[task.device]->queues[id];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(std::move(task));
+    }
+
+    // 取一个目录：先看上一次处理的设备 (局部性)，再依次看其它设备；跳过并发已满的设备。
+    // 成功时已占用该设备的一个并发名额，处理完后由调用方释放
+    bool take(int id, ScanTask& out) {
+        WorkerContext& ctx = *workers_[id];
+        const size_t n = devices_.size();
+        for (size_t k = 0; k < n; ++k) {
+            const size_t d = (ctx.device + k) % n;
+            ScanDevice& device = *devices_[d];
+            if (!device.try_acquire()) continue;
+            if (pop_local(device, id, out) || steal(device, id, out)) {
+                ctx.device = d;
+                return true;
+            }
+            device.release();
+        }
+        return false;
+    }
+
+    bool pop_local(ScanDevice& device, int id, ScanTask& out) {
+        WorkerQueue& q = *device.queues[id];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) return false;
+        out = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(ScanDevice& device, int id, ScanTask& out) {
+        const size_t n = device.queues.size();
+        for (size_t k = 1; k < n; ++k) {
+            WorkerQueue& victim = *device.queues[(id + k) % n];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                out = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_loop(int id) {
+        if (background_) {
+            lower_thread_priority();
+        }
+        steal_and_visit(id);
+        // 退出前必须处理完剩余的批次，并关闭仍被持有的目录 fd
+        flush_stat_batch(*workers_[id]);
+        flush_syscall_counters(workers_[id]->counters);
+        g_progress.handoff(workers_[id]->shard->progress);
+    }
+
+    void steal_and_visit(int id) {
+        int idle_rounds = 0;
+        ScanTask task;
+        while (pending_.load(std::memory_order_acquire) > 0) {
+            // --- 关键：每处理一个目录前检查停止标志 ---
+            if (g_stop_scan_flag.load()) {
+                return;
+            }
+            if (take(id, task)) {
+                idle_rounds = 0;
+                if (watch_) {
+                    // 先登记 watch 再读取目录，读取过程中发生的变化也不会丢失
+                    watch_->add_directory(task.path.native(), task.rules, task.dir);
+                }
+                TelemetryCounters& telemetry = workers_[id]->shard->telemetry;
+                const uint64_t visit_start = telemetry_now_ns();
+                const uint64_t measured_before = measured_phase_ns(telemetry);
+                const uint64_t size_lookup_before = telemetry.size_lookup_ns.load(std::memory_order_relaxed);
+                if (!visit_from_index(id, task)) {
+                    // std::filesystem 不提供 d_ino，按 inode 排序的设备总是使用 getdents64 后端
+                    if (backend_ == SCAN_BACKEND_GETDENTS || devices_[task.device]->inode_order) {
+                        visit_directory_raw(id, task);
+                    } else {
+                        visit_directory(id, task);
+                    }
+                }
+                // 遍历时间 = 整个目录的耗时减去其中已单独计时的分类、取大小和回调
+                uint64_t elapsed = telemetry_now_ns() - visit_start;
+                uint64_t measured = measured_phase_ns(telemetry) - measured_before;
+                TelemetryCounters::bump(telemetry.traversal_ns, elapsed > measured ? elapsed - measured : 0);
+                TelemetryCounters::bump(telemetry.dirs_visited);
+                workers_[id]->current_record = nullptr;
+                workers_[id]->current_old = nullptr;
+                finish_tree_node(task.dir);
+                devices_[task.device]->release();
+                const uint64_t entries = workers_[id]->counters.entries_seen;
+                flush_syscall_counters(workers_[id]->counters);
+                g_progress.handoff_if_stale(workers_[id]->shard->progress);
+                // 子目录已全部入队后才减少计数
+                pending_.fetch_sub(1, std::memory_order_acq_rel);
+                if (throttle_.active()) {
+                    // 系统调用耗时 = 遍历 + 取大小 (不含分类和回调这类纯 CPU 开销)
+                    uint64_t syscall_ns = (elapsed > measured ? elapsed - measured : 0)
+                        + (telemetry.size_lookup_ns.load(std::memory_order_relaxed) - size_lookup_before);
+                    TelemetryCounters::bump(telemetry.throttle_ns,
+                                            throttle_.after_directory(workers_[id]->throttle, elapsed, syscall_ns, entries));
+                }
+                continue;
+            }
+            // 暂时没有可窃取的任务：先把攒着的 statx 批次处理掉，再稍后重试
+            if (workers_[id]->stat_batch_count > 0) {
+                flush_stat_batch(*workers_[id]);
+                flush_syscall_counters(workers_[id]->counters);
+                continue;
+            }
+            g_progress.handoff(workers_[id]->shard->progress); // 空闲等待期间不让记录滞留
+
+            if (++idle_rounds < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+    }
+
+    // 启用索引时先 stat 目录：时间戳与上次扫描一致则直接复用索引中的子目录和文件，返回 true；
+    // 否则为该目录建立新的记录并返回 false，由遍历后端重新读取
+    bool visit_from_index(int id, const ScanTask& task) {
+        if (!record_index_) {
+            return false;
+        }
+        WorkerContext& ctx = *workers_[id];
+        struct stat st;
+        ctx.counters.stat_calls++;
+        if (stat(task.path.c_str(), &st) != 0) {
+            return false; // 由遍历后端报告错误
+        }
+        ctx.records.emplace_back();
+        DirRecord& record = ctx.records.back();
+        record.path = task.path.native();
+        record.excluded_categories = task.rules.excluded;
+        record.st = st;
+
+        const ScanIndexDir* old = index_ ? index_->dir(task.index_hint) : nullptr;
+        if (!old || !same_directory_stamp(st, *old) || old->excluded_categories != task.rules.excluded) {
+            ctx.current_record = &record;
+            ctx.current_old = old;
+            index_changed_.store(true, std::memory_order_relaxed);
+            return false;
+        }
+
+        ctx.counters.dirs_from_index++;
+        TelemetryCounters::bump(ctx.shard->telemetry.files_visited, task.rules.transit ? 0 : old->file_count);
+        std::string child_path;
+        const ScanIndexChild* children = index_->children(*old);
+        for (uint32_t i = 0; i < old->child_count; ++i) {
+            const ScanIndexChild& c = children[i];
+            record.subdirs.emplace_back(index_->str(c.name_offset), c.name_len);
+            join_path(task.path.native(), record.subdirs.back().data(), c.name_len, child_path);
+            int64_t device = child_device(task, child_path);
+            RuleState rules;
+            if (device < 0 || !enter_child(task, index_->str(c.name_offset), c.name_len, rules)) continue;
+            const SessionDir* child = add_scan_dir(*ctx.shard, task.dir, index_->str(c.name_offset), c.name_len);
+            push(id, ScanTask{ fs::path(child_path), rules, c.dir_index, child, static_cast<uint32_t>(device) });
+        }
+        const ScanIndexFile* files = index_->files(*old);
+        for (uint32_t i = 0; i < old->file_count; ++i) {
+            const ScanIndexFile& f = files[i];
+            FileCategory category = static_cast<FileCategory>(f.category);
+            record.files.push_back(IndexedFile{ std::string(index_->str(f.name_offset), f.name_len), f.size, category });
+            join_path(task.path.native(), index_->str(f.name_offset), f.name_len, child_path);
+            add_scan_result(session_, *ctx.shard, task.dir, index_->str(f.name_offset), f.name_len, child_path, f.size,
+                            category, callback_);
+        }
+        return true;
+    }
+
+    // 子目录的规则状态；返回 false 表示跳过整棵子树。
+    // 全部扫描类别都被排除、又不统计所有文件时，该子树不会产生任何结果，同样剪枝 (其下有包含规则时作为通道进入)
+    bool enter_child(const ScanTask& task, const char* name, size_t name_len, RuleState& out) const {
+        if (!rules_.enter(task.rules, name, name_len, out)) return false;
+        if (!size_all_files_ && !out.transit && (out.excluded & kScannedCategoryMask) == kScannedCategoryMask) {
+            return rules_.make_transit(out);
+        }
+        return true;
+    }
+
+    static uint64_t measured_phase_ns(const TelemetryCounters& t) {
+        return t.classification_ns.load(std::memory_order_relaxed) + t.size_lookup_ns.load(std::memory_order_relaxed)
+             + t.callback_ns.load(std::memory_order_relaxed);
+    }
+
+    // 分类只需几十纳秒，逐个计时的开销比分类本身还大：每 kClassifySampleRate 次计时一次，再按比例放大
+    template <typename Fn>
+    static FileCategory classify_sampled(WorkerContext& ctx, Fn classify) {
+        if (++ctx.classify_count % TelemetryCounters::kClassifySampleRate != 0) return classify();
+        uint64_t start = telemetry_now_ns();
+        FileCategory category = classify();
+        TelemetryCounters::bump(ctx.shard->telemetry.classification_ns,
+                                (telemetry_now_ns() - start) * TelemetryCounters::kClassifySampleRate);
+        return category;
+    }
+
+    // 同步的 stat 类调用：计入取大小的时间，失败时按 errno 计入错误
+    template <typename Fn>
+    static bool timed_stat(WorkerContext& ctx, Fn stat_fn) {
+        uint64_t start = telemetry_now_ns();
+        bool ok = stat_fn();
+        int error = errno;
+        TelemetryCounters::bump(ctx.shard->telemetry.size_lookup_ns, telemetry_now_ns() - start);
+        if (!ok) ctx.shard->telemetry.count_error(error);
+        return ok;
+    }
+
+    static void join_path(const std::string& dir, const char* name, size_t name_len, std::string& out) {
+        out.assign(dir);
+        if (out.empty() || out.back() != '/') out.push_back('/');
+        out.append(name, name_len);
+    }
+
+    uint32_t old_child_index(const WorkerContext& ctx, const char* name, size_t name_len) const {
+        return ctx.current_old ? index_->find_child(*ctx.current_old, name, name_len) : kNoIndex;
+    }
+
+    // 写入一个分类命中的文件；启用索引时同时记入当前目录的记录
+    void emit_file(WorkerContext& ctx, DirRecord* record, const SessionDir* dir, const std::string& path,
+                   const char* name, size_t name_len, uint64_t size, FileCategory category) {
+        if (record) {
+            record->files.push_back(IndexedFile{ std::string(name, name_len), size, category });
+        }
+        add_scan_result(session_, *ctx.shard, dir, name, name_len, path, size, category, callback_);
+    }
+
+    // std::filesystem 后端。系统调用数按库调用估算：opendir/closedir 各一次，
+    // getdents64 按两次计 (一次读取 + 一次读到末尾，实际次数无法观测)，每个分类命中的文件 fs::file_size 一次 stat。
+    void visit_directory(int id, const ScanTask& task) {
+        WorkerContext& ctx = *workers_[id];
+        SyscallCounters& counters = ctx.counters;
+        counters.dirs_scanned++;
+        counters.open_calls++;
+        counters.getdents_calls += 2;
+        counters.close_calls++;
+        std::error_code ec;
+        fs::directory_iterator it(task.path, ec);
+        if (ec) {
+            // 与 skip_permission_denied 一致：没有权限的目录直接跳过，只计数不报错
+            ctx.shard->telemetry.count_error(ec.value());
+            if (ec != std::errc::permission_denied) {
+                std::cerr << "Error opening " << task.path << ": " << ec.message() << std::endl;
+            }
+            return;
+        }
+        for (fs::directory_iterator end; it != end; it.increment(ec)) {
+            if (g_stop_scan_flag.load()) {
+                return;
+            }
+            const auto& entry = *it;
+            const auto& current_path = entry.path();
+            const std::string filename = current_path.filename().string();
+            // --- 隐藏文件或目录：默认不扫描，隐藏目录不会入队，相当于整棵子树被剪枝 ---
+            const bool hidden = filename[0] == '.';
+            if (hidden && !rules_.visit_hidden(task.rules, filename.c_str(), DT_UNKNOWN)) {
+                continue;
+            }
+            counters.entries_seen++;
+            std::error_code type_ec;
+            // 与 recursive_directory_iterator 的默认行为一致：不进入指向目录的符号链接
+            if (entry.is_directory(type_ec) && !entry.is_symlink(type_ec)) {
+                int64_t device = child_device(task, current_path.native());
+                RuleState rules;
+                if (device < 0 || !enter_child(task, filename.data(), filename.size(), rules)) continue;
+                if (ctx.current_record) ctx.current_record->subdirs.push_back(filename);
+                const SessionDir* child = add_scan_dir(*ctx.shard, task.dir, filename.data(), filename.size());
+                push(id, ScanTask{ current_path, rules, old_child_index(ctx, filename.data(), filename.size()), child,
+                                   static_cast<uint32_t>(device) });
+            } else if (entry.is_regular_file(type_ec) && !task.rules.transit && !(hidden && !rules_.include_hidden())) {
+                TelemetryCounters::bump(ctx.shard->telemetry.files_visited);
+                FileCategory category = classify_sampled(ctx, [&]() { return get_file_category(current_path, fs::path()); });
+                // 排除的类别在目录入队时就已确定，这里无需再对每个文件比较路径
+                if (category & task.rules.excluded) {
+                    if (!size_all_files_) continue;
+                    category = CATEGORY_UNKNOWN; // 只记入目录树
+                }
+                if (category != CATEGORY_UNKNOWN || (size_all_files_ && !entry.is_symlink(type_ec))) {
+                    counters.stat_calls++;
+                    std::error_code size_ec;
+                    uint64_t file_size = 0;
+                    timed_stat(ctx, [&]() {
+                        file_size = fs::file_size(current_path, size_ec);
+                        errno = size_ec.value();
+                        return !size_ec;
+                    });
+                    if (!size_ec) {
+                        emit_file(ctx, ctx.current_record, task.dir, current_path.string(), filename.data(), filename.size(),
+                                  file_size, category);
+                    }
+                }
+            }
+        }
+        if (ec) {
+            // 如果在迭代某个目录时出错（例如，权限突然改变），则跳过该目录剩余部分
+            ctx.shard->telemetry.count_error(ec.value());
+            std::cerr << "Error iterating " << task.path << ": " << ec.message() << std::endl;
+        }
+    }
+
+    // getdents64 后端：用 d_type 判断类型，只有分类命中的文件 (目录树统计所有文件时为所有普通文件) 才对父目录 fd 调用 fstatat，
+    // 不再为每个文件重新解析完整路径。
+    void visit_directory_raw(int id, const ScanTask& task) {
+        WorkerContext& ctx = *workers_[id];
+        SyscallCounters& counters = ctx.counters;
+        counters.dirs_scanned++;
+
+        counters.open_calls++;
+        int dir_fd = openat(AT_FDCWD, task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd < 0) {
+            ctx.shard->telemetry.count_error(errno);
+            if (errno != EACCES && errno != EPERM) {
+                std::cerr << "Error opening " << task.path << ": " << strerror(errno) << std::endl;
+            }
+            return;
+        }
+        if (ctx.dirent_buffer.empty()) {
+            ctx.dirent_buffer.resize(kDirentBufferSize);
+        }
+
+        std::string child_path;
+        const bool inode_order = devices_[task.device]->inode_order;
+        if (inode_order) {
+            // 机械盘：读完全部目录项后再按 inode 排序处理
+            ctx.sorted.clear();
+            ctx.sorted_names.clear();
+        }
+        while (!g_stop_scan_flag.load()) {
+            counters.getdents_calls++;
+            long nread = syscall(SYS_getdents64, dir_fd, ctx.dirent_buffer.data(), ctx.dirent_buffer.size());
+            if (nread <= 0) {
+                if (nread < 0) {
+                    ctx.shard->telemetry.count_error(errno);
+                    std::cerr << "Error iterating " << task.path << ": " << strerror(errno) << std::endl;
+                }
+                break;
+            }
+            for (long pos = 0; pos < nread;) {
+                auto* d = reinterpret_cast<linux_dirent64*>(ctx.dirent_buffer.data() + pos);
+                pos += d->d_reclen;
+                const char* name = d->d_name;
+                // 隐藏文件/目录默认不扫描 (同时也跳过了 "." 和 "..")
+                if (name[0] == '.' && !rules_.visit_hidden(task.rules, name, d->d_type)) {
+                    continue;
+                }
+                size_t name_len = strlen(name);
+                if (inode_order) {
+                    ctx.sorted.push_back(SortedDirent{ d->d_ino, static_cast<uint32_t>(ctx.sorted_names.size()),
+                                                       static_cast<uint32_t>(name_len), d->d_type });
+                    ctx.sorted_names.append(name, name_len + 1);
+                    continue;
+                }
+                visit_raw_entry(id, task, dir_fd, name, name_len, d->d_type, child_path);
+            }
+        }
+        if (inode_order && !g_stop_scan_flag.load()) {
+            // inode 号大致对应 inode 表中的位置：文件按 inode 升序取大小，磁头单向移动；
+            // 子目录按 inode 降序入队，工作线程从队尾取任务时正好按升序进入
+            std::sort(ctx.sorted.begin(), ctx.sorted.end(),
+                      [](const SortedDirent& a, const SortedDirent& b) { return a.ino < b.ino; });
+            for (const SortedDirent& e : ctx.sorted) {
+                if (e.type == DT_DIR) continue;
+                visit_raw_entry(id, task, dir_fd, ctx.sorted_names.data() + e.name_offset, e.name_len, e.type, child_path);
+            }
+            for (auto it = ctx.sorted.rbegin(); it != ctx.sorted.rend(); ++it) {
+                if (it->type != DT_DIR) continue;
+                visit_raw_entry(id, task, dir_fd, ctx.sorted_names.data() + it->name_offset, it->name_len, it->type, child_path);
+            }
+        }
+        if (ctx.stat_batch_count > 0 && ctx.stat_batch[ctx.stat_batch_count - 1].dir_fd == dir_fd) {
+            // 该目录还有未完成的 statx，fd 需要保持打开直到本批完成
+            ctx.held_dir_fds.push_back(dir_fd);
+            if (ctx.held_dir_fds.size() >= kMaxHeldDirFds) {
+                flush_stat_batch(ctx);
+            }
+            return;
+        }
+        counters.close_calls++;
+        close(dir_fd);
+    }
+
+    // 处理一个非隐藏的目录项：子目录入队，分类命中的文件取大小后写入结果
+    void visit_raw_entry(int id, const ScanTask& task, int dir_fd, const char* name, size_t name_len, unsigned char type,
+                         std::string& child_path) {
+        WorkerContext& ctx = *workers_[id];
+        SyscallCounters& counters = ctx.counters;
+        counters.entries_seen++;
+        struct stat st;
+        bool have_stat = false;
+
+        if (type == DT_UNKNOWN) {
+            // 部分文件系统不提供 d_type，只能退回到 stat
+            counters.stat_calls++;
+            if (!timed_stat(ctx, [&]() { return fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0; })) return;
+            if (S_ISDIR(st.st_mode)) type = DT_DIR;
+            else if (S_ISREG(st.st_mode)) { type = DT_REG; have_stat = true; }
+            else if (S_ISLNK(st.st_mode)) type = DT_LNK;
+            else return;
+        }
+
+        join_path(task.path.native(), name, name_len, child_path);
+
+        if (type == DT_DIR) {
+            int64_t device = child_device(task, child_path);
+            RuleState rules;
+            if (device < 0 || !enter_child(task, name, name_len, rules)) return;
+            if (ctx.current_record) ctx.current_record->subdirs.emplace_back(name, name_len);
+            const SessionDir* child = add_scan_dir(*ctx.shard, task.dir, name, name_len);
+            push(id, ScanTask{ fs::path(child_path), rules, old_child_index(ctx, name, name_len), child,
+                               static_cast<uint32_t>(device) });
+            return;
+        }
+        // 与 std::filesystem 后端一致：指向普通文件的符号链接也参与分类，指向目录的则不进入
+        if (type != DT_REG && type != DT_LNK) {
+            return;
+        }
+        // 通道目录中的文件不记录；隐藏文件只在扫描隐藏项时处理 (DT_UNKNOWN 的隐藏项 stat 后才知道是文件)
+        if (task.rules.transit || (name[0] == '.' && !rules_.include_hidden())) {
+            return;
+        }
+        TelemetryCounters::bump(ctx.shard->telemetry.files_visited);
+        FileCategory category = classify_sampled(ctx, [&]() { return classify_file_name(name, name_len); });
+        if (category & task.rules.excluded) {
+            category = CATEGORY_UNKNOWN;
+        }
+        // 未分类的文件只在统计所有文件时取大小 (符号链接不计)
+        if (category == CATEGORY_UNKNOWN && (!size_all_files_ || type == DT_LNK)) {
+            return;
+        }
+        if (type == DT_LNK) {
+            counters.stat_calls++;
+            if (!timed_stat(ctx, [&]() { return fstatat(dir_fd, name, &st, 0) == 0; }) || !S_ISREG(st.st_mode)) return;
+        } else if (!have_stat) {
+            if (queue_stat(ctx, dir_fd, task.dir, name, name_len, child_path, category, ctx.current_record)) {
+                return;
+            }
+            counters.stat_calls++;
+            if (!timed_stat(ctx, [&]() { return fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0; })) return;
+        }
+        emit_file(ctx, ctx.current_record, task.dir, child_path, name, name_len, static_cast<uint64_t>(st.st_size), category);
+    }
+
+    // 尝试把文件加入 io_uring 批次；未启用或不可用时返回 false，由调用方同步 fstatat
+    bool queue_stat(WorkerContext& ctx, int dir_fd, const SessionDir* dir, const char* name, size_t name_len,
+                    const std::string& path, FileCategory category, DirRecord* record) {
+#ifdef DISK_CLEANER_HAVE_IO_URING
+        if (!use_io_uring_ || ctx.ring_unavailable) {
+            return false;
+        }
+        if (!ctx.ring) {
+            ctx.ring.reset(new IoUring());
+            if (!ctx.ring->init(kStatxBatchSize)) {
+                ctx.ring.reset();
+                ctx.ring_unavailable = true;
+                return false;
+            }
+            ctx.stat_batch.resize(std::min<size_t>(kStatxBatchSize, ctx.ring->capacity()));
+        }
+        dir->tree.pending.fetch_add(1, std::memory_order_relaxed); // 完成前该目录的子树不能汇总
+        PendingStat& e = ctx.stat_batch[ctx.stat_batch_count++];
+        e.dir_fd = dir_fd;
+        e.name.assign(name, name_len);
+        e.path.assign(path);
+        e.dir = dir;
+        e.category = category;
+        e.record = record;
+        e.done = false;
+        if (ctx.stat_batch_count == ctx.stat_batch.size()) {
+            flush_stat_batch(ctx);
+        }
+        return true;
+#else
+        (void)ctx; (void)dir_fd; (void)dir; (void)name; (void)name_len; (void)path; (void)category; (void)record;
+        return false;
+#endif
+    }
+
+    // 提交整批 statx 并等待全部完成，结果写入分类列表并触发回调
+    void flush_stat_batch(WorkerContext& ctx) {
+        const size_t n = ctx.stat_batch_count;
+        SyscallCounters& counters = ctx.counters;
+        TelemetryCounters& telemetry = ctx.shard->telemetry;
+        const uint64_t start = telemetry_now_ns();
+        const uint64_t callback_before = telemetry.callback_ns.load(std::memory_order_relaxed);
+#ifdef DISK_CLEANER_HAVE_IO_URING
+        if (n > 0 && ctx.ring) {
+            for (size_t i = 0; i < n; ++i) {
+                PendingStat& e = ctx.stat_batch[i];
+                ctx.ring->prep_statx(e.dir_fd, e.name.c_str(), AT_SYMLINK_NOFOLLOW, STATX_TYPE | STATX_SIZE, &e.stx, i);
+            }
+            counters.uring_statx_ops += n;
+            size_t completed = 0;
+            while (completed < n) {
+                counters.uring_enter_calls++;
+                if (ctx.ring->submit_and_wait(static_cast<unsigned>(n - completed)) < 0) {
+                    // io_uring 出错：剩余项退回同步路径，之后不再使用 io_uring
+                    std::cerr << "io_uring_enter failed: " << strerror(errno) << std::endl;
+                    ctx.ring_unavailable = true;
+                    break;
+                }
+                uint64_t index;
+                int result;
+                while (ctx.ring->pop_completion(index, result)) {
+                    ++completed;
+                    PendingStat& e = ctx.stat_batch[index];
+                    if (result == -EINVAL || result == -EOPNOTSUPP) {
+                        // 内核过旧，不支持 IORING_OP_STATX
+                        ctx.ring_unavailable = true;
+                        continue;
+                    }
+                    e.done = true;
+                    if (result < 0) telemetry.count_error(-result);
+                    if (result == 0 && S_ISREG(e.stx.stx_mode)) {
+                        emit_file(ctx, e.record, e.dir, e.path, e.name.data(), e.name.size(), e.stx.stx_size, e.category);
+                    }
+                }
+            }
+        }
+#endif
+        for (size_t i = 0; i < n; ++i) {
+            PendingStat& e = ctx.stat_batch[i];
+            if (e.done) continue;
+            struct stat st;
+            counters.stat_calls++;
+            if (fstatat(e.dir_fd, e.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                telemetry.count_error(errno);
+            } else if (S_ISREG(st.st_mode)) {
+                emit_file(ctx, e.record, e.dir, e.path, e.name.data(), e.name.size(), static_cast<uint64_t>(st.st_size), e.category);
+            }
+        }
+        // 整批的耗时都算作取大小，但要扣除其中触发的回调
+        if (n > 0) {
+            uint64_t elapsed = telemetry_now_ns() - start;
+            uint64_t callbacks = telemetry.callback_ns.load(std::memory_order_relaxed) - callback_before;
+            TelemetryCounters::bump(telemetry.size_lookup_ns, elapsed > callbacks ? elapsed - callbacks : 0);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            finish_tree_node(ctx.stat_batch[i].dir);
+        }
+        ctx.stat_batch_count = 0;
+        for (int fd : ctx.held_dir_fds) {
+            counters.close_calls++;
+            close(fd);
+        }
+        ctx.held_dir_fds.clear();
+    }
+
+    ScanSession& session_;
+    ScanBackend backend_;
+    bool use_io_uring_;
+    bool size_all_files_;          // 目录树统计所有普通文件：未分类的文件也取大小，但不进入结果
+    bool background_;              // 后台扫描策略：降低线程优先级并自适应退让
+    ScanThrottle throttle_;
+    ScanCallback callback_;
+    const ScanRules& rules_;
+    const MappedScanIndex* index_; // 上次扫描的索引，可能为空
+    bool record_index_;            // 是否记录本次扫描的目录树以写入新索引
+    std::atomic<bool> index_changed_;
+    WatchRegistry* watch_;         // 监视模式下登记目录 watch，可能为空
+    bool one_file_system_;         // 不进入其它设备的挂载点
+    std::vector<std::unique_ptr<WorkerContext>> workers_;
+    std::vector<std::unique_ptr<ScanDevice>> devices_;
+    std::unordered_map<std::string, uint32_t> mount_devices_; // 主目录之下的挂载点 -> 设备下标
+    std::atomic<size_t> pending_; // 已入队但尚未处理完毕的目录数
+};
+
+static int resolve_scan_worker_count() {
+    int count = g_scan_worker_count.load();
+    if (count <= 0) {
+        count = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    return count > 0 ? count : 1;
+}
+
+static void bump_results_generation() {
+    g_results_generation.fetch_add(1, std::memory_order_acq_rel);
+}
+
+static fs::path normalize_home_path(const std::string& home_path_str) {
+    fs::path home_path = fs::path(home_path_str).lexically_normal();
+    if (!home_path.has_filename() && home_path.has_parent_path() && home_path != home_path.root_path()) {
+        home_path = home_path.parent_path(); // 去掉末尾的 '/'，保证与子目录路径的比较一致
+    }
+    return home_path;
+}
+
+// watch: 监视模式下用于登记目录 watch；fallback_index: 未配置索引路径时使用的索引文件 (监视模式降级重扫用)
+// rules: 已编译的扫描规则 (监视模式与事件处理共用同一份)，为空时按当前配置编译
+void scan_directory(const std::string& home_path_str, ScanCallback callback,
+                    WatchRegistry* watch = nullptr, const std::string& fallback_index = std::string(),
+                    std::shared_ptr<const ScanRules> rules = nullptr) {
+    fs::path home_path = normalize_home_path(home_path_str);
+    if (!rules) {
+        rules = compile_scan_rules(home_path.native());
+    }
+
+    // 开始新的扫描会话 (每个扫描线程一个分片)：上次扫描的路径 arena 和全部结果在这里一次性释放
+    std::shared_ptr<ScanSession> session(new ScanSession(home_path.native(), resolve_scan_worker_count()));
+    std::shared_ptr<ScanSession> old_session;
+    {
+        std::lock_guard<std::mutex> lock(g_results_mutex);
+        old_session = std::atomic_exchange(&g_session, session);
+        bump_results_generation();
+        publish_snapshots(CATEGORY_ALL_CLEANUP | CATEGORY_ALL_MIGRATE);
+    }
+    old_session.reset(); // 在锁外释放
+    g_progress.begin_scan();
+    reset_syscall_counters();
+
+    std::string index_path;
+    {
+        std::lock_guard<std::mutex> lock(g_scan_index_mutex);
+        index_path = g_scan_index_path;
+    }
+    if (index_path.empty()) {
+        index_path = fallback_index;
+    }
+
+    try {
+        const bool size_all_files = g_directory_tree_mode.load() == DIRECTORY_TREE_ALL_FILES;
+        // 统计所有文件时索引中也保存未分类的文件，两种模式的索引不能混用
+        // 不跨文件系统时索引中不含挂载点下的目录，同样不能与普通索引混用
+        const uint64_t config_hash = classifier_config_hash() ^ (size_all_files ? 0x9E3779B97F4A7C15ULL : 0)
+                                   ^ (g_scan_one_file_system.load() ? 0xC2B2AE3D27D4EB4FULL : 0)
+                                   ^ rules->hash();
+        std::unique_ptr<MappedScanIndex> index;
+        if (!index_path.empty()) {
+            index.reset(new MappedScanIndex());
+            if (!index->open(index_path, home_path.native(), config_hash)) {
+                index.reset(); // 索引不存在或已失效，进行完整扫描
+            }
+        }
+
+        WorkStealingScanner scanner(*session, static_cast<ScanBackend>(g_scan_backend.load()),
+                                    callback, *rules, index.get(), !index_path.empty(), watch,
+                                    size_all_files);
+        scanner.run(home_path);
+        if (g_stop_scan_flag.load()) {
+            std::cout << "\n[Debug] Scan stopped by request." << std::endl;
+        } else if (!index_path.empty() && (!index || scanner.index_changed())) {
+            // 被中途停止的扫描不完整，不能写入索引
+            std::vector<const DirRecord*> records;
+            scanner.collect_records(records);
+            index.reset(); // 先解除旧索引的映射，再原子替换文件
+            write_scan_index(index_path, home_path.native(), config_hash, records);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Scan error: " << e.what() << std::endl;
+    }
+
+    session->mark_finished();
+    {
+        std::lock_guard<std::mutex> lock(g_results_mutex);
+        bump_results_generation();
+        publish_snapshots(CATEGORY_ALL_CLEANUP | CATEGORY_ALL_MIGRATE);
+    }
+    g_progress.finish_scan();
+    g_scan_finished = true;
+}
+
+// --- 监视模式 (inotify) ---
+// 初次扫描完成后订阅主目录下所有 (非隐藏) 目录的变化事件，增量更新分类结果：
+// 创建/移入时添加，删除/移出时移除，写入后关闭 (IN_CLOSE_WRITE) 时更新大小。
+// fanotify 的目录事件需要 CAP_SYS_ADMIN，普通用户进程只能使用 inotify。
+// watch 数量耗尽或事件队列溢出时，退化为定期增量重扫 (借助扫描索引只重读变化的目录)。
+static std::thread g_watch_thread;
+static std::atomic<bool> g_watch_stop_flag(false);
+static std::atomic<bool> g_watch_active(false);
+static std::atomic<int> g_watch_mode(WATCH_MODE_OFF);
+static std::atomic<int> g_watch_rescan_interval(60); // 降级后重扫的间隔 (秒)
+
+// 监视模式下的变化按 (所在目录, 文件名) 合并
+struct WatchKey {
+    const SessionDir* dir;
+    std::string name;
+    bool operator==(const WatchKey& o) const { return dir == o.dir && name == o.name; }
+};
+
+struct WatchKeyHash {
+    size_t operator()(const WatchKey& k) const {
+        return std::hash<std::string>()(k.name) ^ std::hash<const void*>()(k.dir);
+    }
+};
+
+struct WatchChange {
+    bool remove;
+    uint64_t size;
+    FileCategory category;
+    bool applied;
+    std::string path; // 完整路径，回调时使用
+};
+
+typedef std::unordered_map<WatchKey, WatchChange, WatchKeyHash> WatchChangeMap;
+
+// 把一批合并后的变化应用到分类结果中 (每批只遍历一次受影响的分类，且只比较受影响目录下的记录)。
+// 更新和删除发生在记录所在的分片，新增的文件写入 0 号分片
+static void apply_watch_changes(WatchChangeMap& changes, ScanCallback callback) {
+    if (changes.empty()) return;
+    unsigned int touched = 0;
+    for (const auto& c : changes) touched |= c.second.category;
+
+    struct Notify { const std::string* path; uint64_t size; FileCategory category; };
+    std::vector<Notify> notify;
+    uint64_t total = 0;
+    {
+        std::lock_guard<std::mutex> lock(g_results_mutex);
+        ScanSession* session = g_session.get();
+        if (!session) {
+            changes.clear();
+            return;
+        }
+        // 记录以目录路径指针标识所在目录
+        std::unordered_map<const char*, const SessionDir*> touched_dirs;
+        for (const auto& c : changes) touched_dirs.emplace(c.first.dir->path, c.first.dir);
+        WatchKey key;
+        for (size_t s = 0; s < session->shard_count(); ++s) {
+            ResultShard& shard = session->shard(s);
+            std::lock_guard<std::mutex> shard_lock(shard.mutex);
+            for (int slot = 0; slot < kScannedCategoryCount; ++slot) {
+                FileCategory category = kScannedCategories[slot];
+                if (!(touched & category)) continue;
+                CategoryRecords& records = shard.records[slot];
+                records.remove_if([&](size_t i) {
+                    auto dir = touched_dirs.find(records.dir(i));
+                    if (dir == touched_dirs.end()) return false;
+                    key.dir = dir->second;
+                    key.name.assign(records.name(i), records.name_len(i));
+                    auto it = changes.find(key);
+                    if (it == changes.end()) return false;
+                    WatchChange& c = it->second;
+                    c.applied = true;
+                    DirTotals delta;
+                    if (c.remove) {
+                        shard.add_junk_bytes(0 - records.file_size(i));
+                        delta.bytes = delta.category_bytes[slot] = 0 - records.file_size(i);
+                        delta.files = 0 - 1;
+                        adjust_tree(key.dir, delta);
+                        return true;
+                    }
+                    shard.add_junk_bytes(c.size - records.file_size(i));
+                    delta.bytes = delta.category_bytes[slot] = c.size - records.file_size(i);
+                    adjust_tree(key.dir, delta);
+                    records.set_size(i, c.size);
+                    notify.push_back(Notify{ &c.path, c.size, category });
+                    return false;
+                });
+            }
+        }
+        {
+            ResultShard& shard = session->shard(0);
+            std::lock_guard<std::mutex> shard_lock(shard.mutex);
+            for (auto& c : changes) {
+                if (c.second.applied || c.second.remove) continue;
+                int slot = category_slot(c.second.category);
+                shard.add_file(slot, c.first.dir, c.first.name.data(), c.first.name.size(), c.second.size);
+                DirTotals delta;
+                delta.bytes = delta.category_bytes[slot] = c.second.size;
+                delta.files = 1;
+                adjust_tree(c.first.dir, delta);
+                notify.push_back(Notify{ &c.second.path, c.second.size, c.second.category });
+            }
+        }
+        bump_results_generation();
+        publish_snapshots(touched);
+        total = session->junk_bytes();
+    }
+
+    if (g_progress.active()) {
+        ProgressBuffer progress;
+        for (const auto& f : notify) g_progress.report(progress, *f.path, f.size, f.category);
+        g_progress.handoff(progress);
+    }
+    if (callback) {
+        std::lock_guard<std::mutex> lock(g_callback_mutex);
+        for (const auto& f : notify) {
+            callback(f.path->c_str(), f.size, total, f.category);
+        }
+    }
+    changes.clear();
+}
+
+// 目录被删除或移出：移除其下所有结果
+static void remove_watch_subtree_results(const SessionDir* parent, const char* name) {
+    std::lock_guard<std::mutex> lock(g_results_mutex);
+    ScanSession* session = g_session.get();
+    if (!session) return;
+    const SessionDir* dir = session->find_child_dir(parent, name, strlen(name));
+    if (!dir) return;
+    std::unordered_set<const char*> removed_dirs = session->detach_subtree(dir);
+    for (size_t s = 0; s < session->shard_count(); ++s) {
+        ResultShard& shard = session->shard(s);
+        std::lock_guard<std::mutex> shard_lock(shard.mutex);
+        for (CategoryRecords& records : shard.records) {
+            records.remove_if([&](size_t i) {
+                if (!removed_dirs.count(records.dir(i))) return false;
+                shard.add_junk_bytes(0 - records.file_size(i));
+                return true;
+            });
+        }
+    }
+    bump_results_generation();
+    publish_snapshots(CATEGORY_ALL_CLEANUP | CATEGORY_ALL_MIGRATE);
+}
+
+// 记录一个文件的变化：stat 失败 (已被删除) 时按移除处理
+static void stage_watch_file(const std::string& path, const SessionDir* dir, const char* name, const RuleState& rules,
+                             bool removed, WatchChangeMap& changes) {
+    size_t name_len = strlen(name);
+    FileCategory category = classify_file_name(name, name_len);
+    if (category == CATEGORY_UNKNOWN || (category & rules.excluded)) return;
+    WatchChange change = { true, 0, category, false, path };
+    struct stat st;
+    if (!removed && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        change.remove = false;
+        change.size = static_cast<uint64_t>(st.st_size);
+    }
+    changes[WatchKey{ dir, std::string(name, name_len) }] = std::move(change);
+}
+
+// 在会话中查找或登记目录。known 为 true 时目录可能已在扫描中登记过 (事件与扫描存在竞争)
+static const SessionDir* watch_session_dir(const SessionDir* parent, const std::string& name, bool& known) {
+    std::lock_guard<std::mutex> lock(g_results_mutex);
+    ScanSession* session = g_session.get();
+    if (!session) return nullptr;
+    if (known) {
+        const SessionDir* dir = session->find_child_dir(parent, name.data(), name.size());
+        if (dir) return dir;
+        known = false; // 该目录是新的，其子目录也必然是新的
+    }
+    ResultShard& shard = session->shard(0);
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    return shard.add_dir(parent, name.data(), name.size());
+}
+
+// 新建或移入的目录：登记 watch 并扫描其中已有的内容
+static void watch_new_directory(WatchRegistry& registry, const ScanRules& rules, const std::string& dir_path,
+                                const SessionDir* parent, const std::string& dir_name, const RuleState& dir_rules,
+                                WatchChangeMap& changes) {
+    struct PendingDir {
+        std::string path;
+        RuleState rules;
+        const SessionDir* parent;
+        std::string name;
+        bool known;
+    };
+    std::vector<PendingDir> stack;
+    stack.push_back(PendingDir{ dir_path, dir_rules, parent, dir_name, true });
+    while (!stack.empty() && !g_watch_stop_flag.load()) {
+        PendingDir current = std::move(stack.back());
+        stack.pop_back();
+        const SessionDir* dir = watch_session_dir(current.parent, current.name, current.known);
+        if (!dir) return;
+        registry.add_directory(current.path, current.rules, dir);
+        std::error_code ec;
+        fs::directory_iterator it(current.path, fs::directory_options::skip_permission_denied, ec);
+        for (fs::directory_iterator end; !ec && it != end; it.increment(ec)) {
+            const std::string name = it->path().filename().string();
+            const bool hidden = name[0] == '.';
+            if (hidden && !rules.visit_hidden(current.rules, name.c_str(), DT_UNKNOWN)) continue;
+            std::error_code type_ec;
+            if (it->is_directory(type_ec) && !it->is_symlink(type_ec)) {
+                std::string child = it->path().string();
+                RuleState child_rules;
+                if (!rules.enter(current.rules, name.data(), name.size(), child_rules)) continue;
+                stack.push_back(PendingDir{ child, child_rules, dir, name, current.known });
+            } else if (it->is_regular_file(type_ec) && !current.rules.transit && !(hidden && !rules.include_hidden())) {
+                stage_watch_file(it->path().string(), dir, name.c_str(), current.rules, false, changes);
+            }
+        }
+    }
+}
+
+// 处理 inotify 事件，直到收到停止请求；需要降级为定期重扫时返回 false
+static bool run_watch_event_loop(WatchRegistry& registry, const ScanRules& rules, ScanCallback callback) {
+    WatchChangeMap changes;
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    while (!g_watch_stop_flag.load()) {
+        struct pollfd pfd = { registry.fd(), POLLIN, 0 };
+        int ready = poll(&pfd, 1, 500);
+        if (ready < 0 && errno != EINTR) {
+            std::cerr << "inotify poll failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+        if (ready <= 0) continue;
+
+        // 把当前可读的事件全部读完再统一应用，合并同一文件的多次变化
+        for (;;) {
+            ssize_t len = read(registry.fd(), buffer, sizeof(buffer));
+            if (len <= 0) break;
+            for (char* ptr = buffer; ptr < buffer + len;) {
+                const auto* event = reinterpret_cast<const struct inotify_event*>(ptr);
+                ptr += sizeof(struct inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    std::cerr << "[警告] inotify 事件队列溢出，监视模式将降级为定期重扫。" << std::endl;
+                    return false;
+                }
+                if (event->mask & IN_IGNORED) {
+                    registry.forget(event->wd);
+                    continue;
+                }
+                if (event->len == 0) continue; // 目录自身的事件
+                WatchedDir dir;
+                if (!registry.lookup(event->wd, dir)) continue;
+                const bool hidden = event->name[0] == '.';
+                if (hidden && !rules.visit_hidden(dir.rules, event->name, (event->mask & IN_ISDIR) ? DT_DIR : DT_REG)) {
+                    continue;
+                }
+                std::string path = dir.path + "/" + event->name;
+
+                if (event->mask & IN_ISDIR) {
+                    // 目录级变化较少见：先应用已积累的文件变化，保证顺序
+                    apply_watch_changes(changes, callback);
+                    if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                        registry.remove_subtree(path);
+                        remove_watch_subtree_results(dir.dir, event->name);
+                    } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                        RuleState child_rules;
+                        if (rules.enter(dir.rules, event->name, strlen(event->name), child_rules)) {
+                            watch_new_directory(registry, rules, path, dir.dir, event->name, child_rules, changes);
+                        }
+                        if (registry.exhausted()) return false;
+                    }
+                    continue;
+                }
+                // 通道目录中的文件不记录；隐藏文件只在扫描隐藏项时记录
+                if (dir.rules.transit || (hidden && !rules.include_hidden())) continue;
+                bool removed = event->mask & (IN_DELETE | IN_MOVED_FROM);
+                stage_watch_file(path, dir.dir, event->name, dir.rules, removed, changes);
+            }
+        }
+        apply_watch_changes(changes, callback);
+    }
+    return true;
+}
+
+// 未配置索引路径时，降级后的增量重扫使用私有的临时索引：放在 $XDG_RUNTIME_DIR (或临时目录) 下
+// 用 mkdtemp 新建的 0700 目录中，其它用户无法预先放置或读取。失败时返回空串 (每次完整重扫)
+static std::string make_private_index_dir() {
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+    std::error_code ec;
+    fs::path base = (runtime_dir && runtime_dir[0] == '/' && fs::is_directory(runtime_dir, ec))
+                  ? fs::path(runtime_dir) : fs::temp_directory_path(ec);
+    std::string pattern = (base / "disk-cleaner-watch-XXXXXX").string();
+    if (ec || !mkdtemp(&pattern[0])) {
+        std::cerr << "[警告] 无法创建监视模式的临时索引目录: " << strerror(errno) << std::endl;
+        return std::string();
+    }
+    return pattern;
+}
+
+static void watch_main(std::string home_path_str, ScanCallback callback) {
+    const std::string home_path = normalize_home_path(home_path_str).string();
+    std::string fallback_dir;   // 只有真正降级为定期重扫时才创建
+    std::string fallback_index;
+    auto begin_polling = [&]() {
+        if (!fallback_dir.empty()) return;
+        fallback_dir = make_private_index_dir();
+        if (!fallback_dir.empty()) fallback_index = fallback_dir + "/scan.idx";
+    };
+
+    WatchRegistry registry;
+    bool inotify_ok = registry.init();
+    if (!inotify_ok) {
+        std::cerr << "[警告] inotify 不可用 (" << strerror(errno) << ")，监视模式将使用定期重扫。" << std::endl;
+    }
+    g_watch_mode = inotify_ok ? WATCH_MODE_INOTIFY : WATCH_MODE_POLLING;
+    g_progress.start();
+    // 事件处理、首次扫描和降级后的重扫使用同一份规则，整个监视期间结果一致
+    std::shared_ptr<const ScanRules> rules = compile_scan_rules(home_path);
+    if (!inotify_ok) begin_polling();
+    scan_directory(home_path, callback, inotify_ok ? &registry : nullptr, fallback_index, rules);
+
+    bool keep_watching = inotify_ok && !registry.exhausted() && !g_stop_scan_flag.load();
+    if (keep_watching && run_watch_event_loop(registry, *rules, callback)) {
+        // 正常停止
+    } else {
+        registry.shutdown();
+        g_watch_mode = WATCH_MODE_POLLING;
+        begin_polling();
+        while (!g_watch_stop_flag.load()) {
+            // 分片睡眠，以便及时响应 StopWatch
+            int interval_ms = std::max(1, g_watch_rescan_interval.load()) * 1000;
+            for (int waited = 0; waited < interval_ms && !g_watch_stop_flag.load(); waited += 100) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            if (g_watch_stop_flag.load()) break;
+            g_stop_scan_flag = false;
+            g_scan_finished = false;
+            scan_directory(home_path, callback, nullptr, fallback_index, rules);
+        }
+    }
+    g_progress.stop();
+    if (!fallback_dir.empty()) {
+        std::error_code ec;
+        fs::remove_all(fallback_dir, ec);
+    }
+    g_watch_mode = WATCH_MODE_OFF;
+}
+
+// --- 并行删除引擎 ---
+// 单次后序遍历：目录用 openat 相对父目录 fd 打开，文件用 unlinkat 相对所在目录删除 (不做整路径解析)，
+// 子目录作为任务分发给工作线程。每个目录节点记录未完成的子目录数，某个子树清空后立即
+// unlinkat(AT_REMOVEDIR) 删除该目录并通知父节点，不需要第二遍收集空目录。
+// 释放的字节数直接取自删除前 fstatat 拿到的大小，"统计大小 + 删除" 只需一次遍历。
+struct DeleteOptions {
+    bool remove_root = false;    // 为 false 时保留根目录本身
+    bool unlink_special = false; // 默认只删除普通文件和符号链接 (不跟随)；为 true 时设备、管道、套接字也删除
+    bool measure_only = false;   // 只统计大小，不删除任何东西
+    std::vector<std::string> skip_children;        // 保留根目录下这些名字的直接子项
+    std::atomic<uint64_t>* progress = nullptr;     // 非空时每处理完一个目录累加一次已释放的字节数
+    const std::atomic<bool>* cancel = nullptr;     // 置位后不再列举新目录，尽快返回
+};
+
+class ParallelDeleter {
+public:
+    ParallelDeleter(int worker_count, DeleteOptions options)
+        : worker_count_(std::max(1, worker_count)), options_(std::move(options)) {}
+
+    // 删除 root_path 下的内容并返回释放的字节数 (只统计删除成功的普通文件；measure_only 时为统计到的大小)
+    uint64_t run(const std::string& root_path) {
+        root_path_ = root_path;
+        done_ = false;
+        freed_bytes_ = 0;
+        stack_.push_back(new DirNode(nullptr, std::string()));
+
+        std::vector<std::thread> threads;
+        for (int i = 1; i < worker_count_; ++i) {
+            threads.emplace_back(&ParallelDeleter::worker_loop, this);
+        }
+        worker_loop();
+        for (auto& t : threads) {
+            t.join();
+        }
+        return freed_bytes_.load();
+    }
+
+private:
+    struct DirNode {
+        DirNode(DirNode* parent_node, std::string dir_name) : parent(parent_node), name(std::move(dir_name)) {}
+        DirNode* parent;
+        std::string name;
+        int fd = -1;                      // 子目录全部删除前保持打开，供子节点 openat/unlinkat 使用
+        std::atomic<size_t> pending{ 1 }; // 自身的列举 + 尚未清空的子目录数
+    };
+
+    void worker_loop() {
+        std::vector<char> buffer(kDirentBufferSize);
+        uint64_t freed = 0;
+        while (true) {
+            DirNode* node = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return done_ || !stack_.empty(); });
+                if (stack_.empty()) break; // done_
+                // 后进先出：优先深入最近发现的子目录，同时打开的目录 fd 数与树深度成正比
+                node = stack_.back();
+                stack_.pop_back();
+            }
+            process(node, buffer, freed);
+        }
+        freed_bytes_.fetch_add(freed, std::memory_order_relaxed);
+    }
+
+    void process(DirNode* node, std::vector<char>& buffer, uint64_t& freed) {
+        if (options_.cancel && options_.cancel->load(std::memory_order_relaxed)) {
+            release(node);
+            return;
+        }
+        if (node->parent) {
+            node->fd = openat(node->parent->fd, node->name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        } else {
+            node->fd = open(root_path_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+        if (node->fd < 0) {
+            if (errno != ENOENT) {
+                std::cerr << "[警告] 无法打开目录 '" << node_path(node) << "': " << strerror(errno) << std::endl;
+            }
+            release(node);
+            return;
+        }
+
+        uint64_t freed_here = 0;
+        while (true) {
+            long nread = syscall(SYS_getdents64, node->fd, buffer.data(), buffer.size());
+            if (nread <= 0) break;
+            for (long offset = 0; offset < nread;) {
+                auto* entry = reinterpret_cast<linux_dirent64*>(buffer.data() + offset);
+                offset += entry->d_reclen;
+                const char* name = entry->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+                if (!node->parent && is_skipped_child(name)) continue;
+
+                unsigned char type = entry->d_type;
+                struct stat st;
+                bool have_stat = false;
+                if (type == DT_UNKNOWN || type == DT_REG) {
+                    if (fstatat(node->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                    have_stat = true;
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+                }
+                if (type == DT_DIR) {
+                    DirNode* child = new DirNode(node, name);
+                    node->pending.fetch_add(1, std::memory_order_relaxed);
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        stack_.push_back(child);
+                    }
+                    cv_.notify_one();
+                    continue;
+                }
+                if (type != DT_REG && type != DT_LNK && !options_.unlink_special) continue;
+
+                uint64_t size = (type == DT_REG && have_stat) ? static_cast<uint64_t>(st.st_size) : 0;
+                if (options_.measure_only || unlinkat(node->fd, name, 0) == 0) {
+                    freed_here += size;
+                } else if (errno != ENOENT) {
+                    std::cerr << "[警告] 无法删除文件 '" << node_path(node) << '/' << name
+                              << "': " << strerror(errno) << std::endl;
+                }
+            }
+        }
+        freed += freed_here;
+        if (options_.progress) {
+            options_.progress->fetch_add(freed_here, std::memory_order_relaxed);
+        }
+        release(node);
+    }
+
+    bool is_skipped_child(const char* name) const {
+        for (const auto& skip : options_.skip_children) {
+            if (skip == name) return true;
+        }
+        return false;
+    }
+
+    // 节点自身列举完毕或某个子目录清空时调用；计数归零后删除该目录并继续向上传递
+    void release(DirNode* node) {
+        while (node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            DirNode* parent = node->parent;
+            if (node->fd >= 0) {
+                close(node->fd);
+            }
+            if (!parent) {
+                if (options_.remove_root && !options_.measure_only && rmdir(root_path_.c_str()) != 0 &&
+                    errno != ENOTEMPTY && errno != EEXIST && errno != ENOENT) {
+                    std::cerr << "[警告] 无法删除目录 '" << root_path_ << "': " << strerror(errno) << std::endl;
+                }
+                delete node;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    done_ = true;
+                }
+                cv_.notify_all();
+                return;
+            }
+            // 目录里还留有无法删除的条目时 ENOTEMPTY 是预期结果，该目录保留
+            if (!options_.measure_only && unlinkat(parent->fd, node->name.c_str(), AT_REMOVEDIR) != 0 &&
+                errno != ENOTEMPTY && errno != EEXIST && errno != ENOENT) {
+                std::cerr << "[警告] 无法删除目录 '" << node_path(node) << "': " << strerror(errno) << std::endl;
+            }
+            delete node;
+            node = parent;
+        }
+    }
+
+    // 仅用于错误信息：沿父节点拼出完整路径
+    std::string node_path(const DirNode* node) const {
+        std::vector<const std::string*> names;
+        for (; node && node->parent; node = node->parent) {
+            names.push_back(&node->name);
+        }
+        std::string path = root_path_;
+        for (auto it = names.rbegin(); it != names.rend(); ++it) {
+            path += '/';
+            path += **it;
+        }
+        return path;
+    }
+
+    int worker_count_;
+    DeleteOptions options_;
+    std::string root_path_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<DirNode*> stack_; // 待列举的目录
+    bool done_ = false;           // 根节点已完成，所有工作线程退出
+    std::atomic<uint64_t> freed_bytes_{ 0 };
+};
+
+// --- 延迟删除 (墓碑目录 + 后台回收) ---
+// 延迟模式下清理目标先 rename 到同一文件系统上的隐藏墓碑目录 (同目录内 rename 是原子的，瞬间完成)，
+// 只统计大小后立即返回；后台回收线程以最低 CPU/IO 优先级逐个删除墓碑。
+// 墓碑在进程崩溃或退出时可能残留，库加载时会自动继续回收。
+static const char* const kTombstoneDirName = ".disk-cleaner-tombstones";
+static std::atomic<int> g_cleanup_mode(CLEANUP_MODE_IMMEDIATE);
+
+// 两处墓碑目录分别位于被清理目标的父目录中，保证 rename 不跨文件系统
+static std::vector<fs::path> tombstone_roots(const std::string& home_path_str) {
+    fs::path home(home_path_str);
+    return { home / ".cache" / kTombstoneDirName, home / ".local/share/Trash" / kTombstoneDirName };
+}
+
+class TombstoneReaper {
+public:
+    ~TombstoneReaper() { shutdown(); }
+
+    // measured 为 false 时大小未知，由回收线程删除前先统计
+    void enqueue(const fs::path& tombstone, uint64_t bytes, bool measured = true) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(tombstone.string());
+        if (!measured) {
+            unmeasured_.insert(queue_.back());
+        }
+        bytes_queued_ += bytes;
+        if (!thread_.joinable()) {
+            stop_ = false;
+            thread_ = std::thread(&TombstoneReaper::reap_loop, this);
+        }
+        cv_.notify_all();
+    }
+
+    // 库加载时调用：把上次残留的墓碑重新加入队列，大小由回收线程删除前统计
+    void resume(const std::string& home_path_str) {
+        for (const auto& root : tombstone_roots(home_path_str)) {
+            std::error_code ec;
+            for (fs::directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+                enqueue(it->path(), 0, false);
+            }
+        }
+    }
+
+    void progress(ReaperProgress* out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t reclaimed = bytes_reclaimed_.load(std::memory_order_relaxed);
+        out->bytes_reclaimed = reclaimed;
+        out->bytes_pending = bytes_queued_ > reclaimed ? bytes_queued_ - reclaimed : 0;
+        out->tombstones_pending = static_cast<int>(queue_.size()) + (busy_ ? 1 : 0);
+        out->active = (busy_ || !queue_.empty()) ? 1 : 0;
+    }
+
+    // timeout_ms < 0 表示一直等待；返回 true 表示所有墓碑已回收
+    bool wait(int timeout_ms) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto idle = [this]() { return queue_.empty() && !busy_; };
+        if (timeout_ms < 0) {
+            cv_.wait(lock, idle);
+            return true;
+        }
+        return cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), idle);
+    }
+
+    // 进程退出时停止回收：正在删除的墓碑留给下次加载继续
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+private:
+    void reap_loop() {
+        lower_thread_priority(); // 回收线程只使用空闲的 CPU 和磁盘带宽
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this]() { return stop_.load() || !queue_.empty(); });
+            if (stop_) break;
+            std::string tombstone = queue_.front();
+            queue_.pop_front();
+            bool measure = unmeasured_.erase(tombstone) > 0;
+            busy_ = true;
+            lock.unlock();
+
+            if (measure) {
+                DeleteOptions options;
+                options.measure_only = true;
+                options.cancel = &stop_;
+                uint64_t bytes = ParallelDeleter(1, options).run(tombstone);
+                std::lock_guard<std::mutex> relock(mutex_);
+                bytes_queued_ += bytes;
+            }
+            DeleteOptions options;
+            options.remove_root = true;
+            options.unlink_special = true;
+            options.progress = &bytes_reclaimed_;
+            options.cancel = &stop_;
+            ParallelDeleter(1, options).run(tombstone);
+            // 墓碑根目录为空时顺手删除 (失败说明还有其他墓碑，忽略)
+            rmdir(fs::path(tombstone).parent_path().c_str());
+
+            lock.lock();
+            busy_ = false;
+            cv_.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+    std::deque<std::string> queue_;
+    std::unordered_set<std::string> unmeasured_; // 库加载时恢复、尚未统计大小的墓碑
+    std::atomic<bool> stop_{ false };
+    bool busy_ = false;
+    uint64_t bytes_queued_ = 0;
+    std::atomic<uint64_t> bytes_reclaimed_{ 0 };
+};
+
+static TombstoneReaper g_reaper;
+
+// 库加载时继续回收上次残留的墓碑
+static const bool g_reaper_resumed = []() {
+    const char* home = getenv("HOME");
+    if (home) {
+        g_reaper.resume(home);
+    }
+    return true;
+}();
+
+// 把 parent 目录下的若干直接子项 rename 进一个新墓碑，返回墓碑路径；一项都没有移走时返回空路径。
+// rename 失败的子项 (例如跨文件系统的挂载点) 追加到 failed 中，由调用方同步删除。
+static fs::path entomb_children(const fs::path& parent, const std::vector<std::string>& names,
+                                const fs::path& tombstone_root, std::vector<fs::path>& failed) {
+    static std::atomic<uint64_t> sequence(0);
+    std::error_code ec;
+    fs::path tombstone = tombstone_root / (std::to_string(getpid()) + "-" +
+        std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + "-" +
+        std::to_string(sequence.fetch_add(1)));
+    // 回收线程会删除已空的墓碑根目录，创建失败时重建一次
+    int created = -1;
+    for (int attempt = 0; attempt < 2 && created != 0; ++attempt) {
+        fs::create_directories(tombstone_root, ec);
+        created = mkdir(tombstone.c_str(), 0700);
+    }
+    if (created != 0) {
+        for (const auto& name : names) failed.push_back(parent / name);
+        return fs::path();
+    }
+    size_t moved = 0;
+    for (const auto& name : names) {
+        fs::path source = parent / name;
+        if (rename(source.c_str(), (tombstone / name).c_str()) == 0) {
+            ++moved;
+        } else if (errno != ENOENT) {
+            failed.push_back(source);
+        }
+    }
+    if (moved == 0) {
+        rmdir(tombstone.c_str());
+        rmdir(tombstone_root.c_str());
+        return fs::path();
+    }
+    return tombstone;
+}
+
+// --- 特殊类别大小 (回收站、缩略图缓存、其他应用缓存) ---
+// 一次并行遍历同时统计三类：.cache 只走一遍，thumbnails 作为它的子目录单独计入，墓碑目录跳过。
+// 每个目录缓存 "直属文件总大小 + 子目录列表"，下次以目录 mtime (连同 dev/ino) 校验：
+// 目录项增删、改名都会更新目录 mtime，未变化的目录只需一次 fstat，不再列举和逐个 stat。
+// 注意：原地改写文件内容不会更新所在目录的 mtime，这种变化要等目录本身变化后才会反映出来。
+// ~/.cache 下被扫描规则排除的直接子目录名：统计和清理缓存时保留。
+// "thumbnails" 按缩略图缓存类别求值，其余按其它应用缓存类别求值；.cache 本身是隐藏目录，这里不按隐藏项剪枝
+static std::vector<std::string> rule_excluded_cache_dirs(const std::string& home_path_str) {
+    const std::string home = normalize_home_path(home_path_str).native();
+    std::shared_ptr<const ScanRules> rules = compile_scan_rules(home);
+    const std::string cache_path = home + "/.cache";
+    RuleState cache_state;
+    const bool cache_kept = rules->enter(rules->root(), ".cache", 6, cache_state, false);
+
+    std::vector<std::string> names;
+    std::error_code ec;
+    for (fs::directory_iterator it(cache_path, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code type_ec;
+        if (!it->is_directory(type_ec) || it->is_symlink(type_ec)) continue;
+        std::string name = it->path().filename().string();
+        RuleState state;
+        const uint32_t category = name == "thumbnails" ? CATEGORY_THUMBNAIL_CACHE : CATEGORY_OTHER_APP_CACHE;
+        // 只作为通道进入的目录其下仍有被排除的内容，整体保留
+        if (!cache_kept || !rules->enter(cache_state, name.data(), name.size(), state, false) ||
+            state.transit || (state.excluded & category)) {
+            names.push_back(std::move(name));
+        }
+    }
+    return names;
+}
+
+class SpecialSizeCache {
+public:
+    void compute(const std::string& home_path_str, SpecialCategorySizes* out) {
+        std::lock_guard<std::mutex> compute_lock(compute_mutex_);
+        fs::path home(home_path_str);
+        excluded_cache_dirs_ = rule_excluded_cache_dirs(home_path_str);
+        for (auto& bytes : bytes_) bytes = 0;
+        dirs_scanned_ = 0;
+        dirs_cached_ = 0;
+        next_.clear();
+        pending_ = 0;
+        push(Task{ (home / ".cache").string(), kBucketOtherCache, true, true });
+        push(Task{ (home / ".local/share/Trash/files").string(), kBucketTrash, false, true });
+        push(Task{ (home / ".local/share/Trash/info").string(), kBucketTrash, false, true });
+
+        int worker_count = resolve_scan_worker_count();
+        std::vector<std::thread> threads;
+        for (int i = 1; i < worker_count; ++i) {
+            threads.emplace_back(&SpecialSizeCache::worker_loop, this);
+        }
+        worker_loop();
+        for (auto& t : threads) {
+            t.join();
+        }
+        // 只保留本次访问到的目录，已删除目录的缓存随之丢弃
+        entries_.swap(next_);
+        next_.clear();
+
+        out->trash = bytes_[kBucketTrash].load();
+        out->thumbnail_cache = bytes_[kBucketThumbnails].load();
+        out->other_app_cache = bytes_[kBucketOtherCache].load();
+        out->dirs_scanned = dirs_scanned_.load();
+        out->dirs_from_cache = dirs_cached_.load();
+    }
+
+private:
+    enum Bucket { kBucketTrash, kBucketThumbnails, kBucketOtherCache, kBucketCount };
+
+    struct DirEntry {
+        dev_t dev;
+        ino_t ino;
+        struct timespec mtime;
+        uint64_t file_bytes;              // 直属普通文件的总大小
+        std::vector<std::string> subdirs; // 直属子目录名
+    };
+
+    struct Task {
+        std::string path;
+        int bucket;
+        bool cache_root; // .cache 本身：子目录 thumbnails 单独计入，墓碑目录和被规则排除的目录跳过
+        bool root;       // 起点目录允许是符号链接
+    };
+
+    void push(Task task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stack_.push_back(std::move(task));
+            ++pending_;
+        }
+        cv_.notify_one();
+    }
+
+    void worker_loop() {
+        std::vector<char> buffer(kDirentBufferSize);
+        while (true) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return pending_ == 0 || !stack_.empty(); });
+                if (stack_.empty()) break; // pending_ == 0
+                task = std::move(stack_.back());
+                stack_.pop_back();
+            }
+            process(task, buffer);
+            bool finished;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                finished = --pending_ == 0;
+            }
+            if (finished) {
+                cv_.notify_all();
+            }
+        }
+    }
+
+    static bool matches(const DirEntry& entry, const struct stat& st) {
+        return entry.dev == st.st_dev && entry.ino == st.st_ino && entry.mtime.tv_sec == st.st_mtim.tv_sec &&
+               entry.mtime.tv_nsec == st.st_mtim.tv_nsec;
+    }
+
+    void process(const Task& task, std::vector<char>& buffer) {
+        struct stat dir_st;
+        int stat_flags = task.root ? 0 : AT_SYMLINK_NOFOLLOW;
+        if (fstatat(AT_FDCWD, task.path.c_str(), &dir_st, stat_flags) != 0 || !S_ISDIR(dir_st.st_mode)) return;
+
+        DirEntry entry;
+        // 遍历期间 entries_ 的结构不变，每个目录只被一个任务访问，可以直接移走其中的缓存项
+        auto cached = entries_.find(task.path);
+        if (cached != entries_.end() && matches(cached->second, dir_st)) {
+            entry = std::move(cached->second);
+            dirs_cached_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            int fd = open(task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | (task.root ? 0 : O_NOFOLLOW));
+            if (fd < 0) return;
+            // 以打开后的 fstat 为准，列举期间目录再发生变化时下次会重新统计
+            if (fstat(fd, &dir_st) != 0) {
+                close(fd);
+                return;
+            }
+            entry.dev = dir_st.st_dev;
+            entry.ino = dir_st.st_ino;
+            entry.mtime = dir_st.st_mtim;
+            entry.file_bytes = 0;
+            list_directory(fd, buffer, entry);
+            close(fd);
+            dirs_scanned_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        bytes_[task.bucket].fetch_add(entry.file_bytes, std::memory_order_relaxed);
+        for (const auto& name : entry.subdirs) {
+            int bucket = task.bucket;
+            if (task.cache_root) {
+                if (name == kTombstoneDirName) continue;
+                if (std::find(excluded_cache_dirs_.begin(), excluded_cache_dirs_.end(), name) != excluded_cache_dirs_.end()) {
+                    continue;
+                }
+                if (name == "thumbnails") bucket = kBucketThumbnails;
+            }
+            push(Task{ task.path + '/' + name, bucket, false, false });
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        next_.emplace(task.path, std::move(entry));
+    }
+
+    static void list_directory(int fd, std::vector<char>& buffer, DirEntry& entry) {
+        while (true) {
+            long nread = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+            if (nread <= 0) break;
+            for (long offset = 0; offset < nread;) {
+                auto* dirent = reinterpret_cast<linux_dirent64*>(buffer.data() + offset);
+                offset += dirent->d_reclen;
+                const char* name = dirent->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+                if (dirent->d_type == DT_DIR) {
+                    entry.subdirs.emplace_back(name);
+                    continue;
+                }
+                if (dirent->d_type != DT_REG && dirent->d_type != DT_UNKNOWN) continue;
+                struct stat st;
+                if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                if (S_ISDIR(st.st_mode)) {
+                    entry.subdirs.emplace_back(name);
+                } else if (S_ISREG(st.st_mode)) {
+                    entry.file_bytes += static_cast<uint64_t>(st.st_size);
+                }
+            }
+        }
+    }
+
+    std::mutex compute_mutex_; // 同一时间只进行一次统计
+    std::vector<std::string> excluded_cache_dirs_;      // 本次统计中被规则排除的缓存子目录
+    std::unordered_map<std::string, DirEntry> entries_; // 上一次统计的目录缓存
+    std::unordered_map<std::string, DirEntry> next_;    // 本次统计访问到的目录，受 mutex_ 保护
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Task> stack_;
+    size_t pending_ = 0; // 已入队但尚未处理完的目录数
+    std::atomic<uint64_t> bytes_[kBucketCount];
+    std::atomic<uint64_t> dirs_scanned_{ 0 };
+    std::atomic<uint64_t> dirs_cached_{ 0 };
+};
+
+static SpecialSizeCache g_special_sizes;
+
+// --- 内容哈希 (查重用) ---
+// 结构与 XXH3 的长输入路径相同：8 条 64 位累加通道，每 64 字节一个条带、每 16 个条带 (1 KB) 一个块，
+// 块末对累加器做一次打散；最后把 8 条通道两两相乘折叠成 128 位结果。
+// 累加核心有标量、SSE2 和 AVX2 三个实现，结果逐位相同，运行时按 CPU 支持选择。
+static constexpr uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+struct HashSecret {
+    uint64_t keys[32];
+    constexpr HashSecret() : keys() {
+        for (int i = 0; i < 32; ++i) keys[i] = splitmix64(static_cast<uint64_t>(i) * 0x2545F4914F6CDD1DULL + 1);
+    }
+};
+static constexpr HashSecret kHashSecret;
+
+static const size_t kHashStripe = 64;
+static const size_t kHashStripesPerBlock = 16;
+static const size_t kHashBlock = kHashStripe * kHashStripesPerBlock;
+static const uint64_t kHashPrime32 = 0x9E3779B1ULL;
+// 条带 n 使用 keys[n..n+7]，块末打散使用 keys[16..23]，最终折叠使用 keys[24..31]
+static const size_t kScrambleKey = 16;
+static const size_t kMergeKey = 24;
+
+static inline uint64_t read_u64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void hash_stripe_scalar(uint64_t* acc, const unsigned char* p, const uint64_t* keys) {
+    for (int i = 0; i < 8; ++i) {
+        uint64_t d = read_u64(p + 8 * i);
+        uint64_t k = d ^ keys[i];
+        acc[i ^ 1] += d;
+        acc[i] += (k & 0xFFFFFFFFULL) * (k >> 32);
+    }
+}
+
+// 标量块内核只在没有 SIMD 内核的平台上使用 (尾部条带总是用 hash_stripe_scalar)
+#if !defined(__x86_64__) && !defined(__i386__)
+static void hash_scramble_scalar(uint64_t* acc) {
+    for (int i = 0; i < 8; ++i) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= kHashSecret.keys[kScrambleKey + i];
+        acc[i] = a * kHashPrime32;
+    }
+}
+
+static void hash_blocks_scalar(uint64_t* acc, const unsigned char* data, size_t blocks) {
+    for (size_t b = 0; b < blocks; ++b, data += kHashBlock) {
+        for (size_t n = 0; n < kHashStripesPerBlock; ++n) {
+            hash_stripe_scalar(acc, data + n * kHashStripe, kHashSecret.keys + n);
+        }
+        hash_scramble_scalar(acc);
+    }
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+static void hash_blocks_sse2(uint64_t* acc64, const unsigned char* data, size_t blocks) {
+    __m128i acc[4];
+    for (int j = 0; j < 4; ++j) acc[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc64 + 2 * j));
+    const __m128i prime = _mm_set1_epi32(static_cast<int>(kHashPrime32));
+    for (size_t b = 0; b < blocks; ++b, data += kHashBlock) {
+        for (size_t n = 0; n < kHashStripesPerBlock; ++n) {
+            const unsigned char* p = data + n * kHashStripe;
+            for (int j = 0; j < 4; ++j) {
+                __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * j));
+                __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kHashSecret.keys + n + 2 * j));
+                __m128i k = _mm_xor_si128(d, key);
+                __m128i product = _mm_mul_epu32(k, _mm_shuffle_epi32(k, _MM_SHUFFLE(0, 3, 0, 1)));
+                __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+                acc[j] = _mm_add_epi64(acc[j], _mm_add_epi64(product, swapped));
+            }
+        }
+        for (int j = 0; j < 4; ++j) {
+            __m128i a = _mm_xor_si128(acc[j], _mm_srli_epi64(acc[j], 47));
+            a = _mm_xor_si128(a, _mm_loadu_si128(reinterpret_cast<const __m128i*>(kHashSecret.keys + kScrambleKey + 2 * j)));
+            __m128i lo = _mm_mul_epu32(a, prime);
+            __m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+            acc[j] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+        }
+    }
+    for (int j = 0; j < 4; ++j) _mm_storeu_si128(reinterpret_cast<__m128i*>(acc64 + 2 * j), acc[j]);
+}
+
+__attribute__((target("avx2")))
+static void hash_blocks_avx2(uint64_t* acc64, const unsigned char* data, size_t blocks) {
+    __m256i acc[2];
+    for (int j = 0; j < 2; ++j) acc[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc64 + 4 * j));
+    const __m256i prime = _mm256_set1_epi32(static_cast<int>(kHashPrime32));
+    for (size_t b = 0; b < blocks; ++b, data += kHashBlock) {
+        for (size_t n = 0; n < kHashStripesPerBlock; ++n) {
+            const unsigned char* p = data + n * kHashStripe;
+            for (int j = 0; j < 2; ++j) {
+                __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * j));
+                __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kHashSecret.keys + n + 4 * j));
+                __m256i k = _mm256_xor_si256(d, key);
+                __m256i product = _mm256_mul_epu32(k, _mm256_shuffle_epi32(k, _MM_SHUFFLE(0, 3, 0, 1)));
+                __m256i swapped = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+                acc[j] = _mm256_add_epi64(acc[j], _mm256_add_epi64(product, swapped));
+            }
+        }
+        for (int j = 0; j < 2; ++j) {
+            __m256i a = _mm256_xor_si256(acc[j], _mm256_srli_epi64(acc[j], 47));
+            a = _mm256_xor_si256(a, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kHashSecret.keys + kScrambleKey + 4 * j)));
+            __m256i lo = _mm256_mul_epu32(a, prime);
+            __m256i hi = _mm256_mul_epu32(_mm256_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+            acc[j] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+        }
+    }
+    for (int j = 0; j < 2; ++j) _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc64 + 4 * j), acc[j]);
+}
+#endif
+
+typedef void (*HashBlocksFn)(uint64_t* acc, const unsigned char* data, size_t blocks);
+
+static HashBlocksFn select_hash_kernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init(); // 在静态初始化阶段调用，需先初始化 CPU 特性检测
+    if (__builtin_cpu_supports("avx2")) return hash_blocks_avx2;
+    return hash_blocks_sse2;
+#else
+    return hash_blocks_scalar;
+#endif
+}
+
+static const HashBlocksFn g_hash_blocks = select_hash_kernel();
+
+struct ContentHash {
+    uint64_t lo;
+    uint64_t hi;
+    bool operator==(const ContentHash& other) const { return lo == other.lo && hi == other.hi; }
+};
+
+static inline uint64_t fold_mul64(uint64_t a, uint64_t b) {
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+static inline uint64_t hash_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    return h ^ (h >> 32);
+}
+
+// 流式哈希：update 每次必须传入整块 (kHashBlock 的整数倍)，最后用 finish 处理不足一块的尾部
+class ContentHasher {
+public:
+    ContentHasher() {
+        static const uint64_t kInit[8] = { kHashPrime32, 0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL,
+                                           0x165667B19E3779F9ULL, 0x85EBCA77C2B2AE63ULL, 0x85EBCA77ULL,
+                                           0x27D4EB2F165667C5ULL, 0x61C8864E7A143579ULL };
+        memcpy(acc_, kInit, sizeof(acc_));
+    }
+
+    void update(const unsigned char* data, size_t len) {
+        g_hash_blocks(acc_, data, len / kHashBlock);
+        total_ += len;
+    }
+
+    ContentHash finish(const unsigned char* tail, size_t len) {
+        total_ += len;
+        size_t stripes = len / kHashStripe;
+        for (size_t n = 0; n < stripes; ++n) {
+            hash_stripe_scalar(acc_, tail + n * kHashStripe, kHashSecret.keys + n);
+        }
+        size_t rest = len - stripes * kHashStripe;
+        if (rest > 0) {
+            unsigned char last[kHashStripe] = {};
+            memcpy(last, tail + stripes * kHashStripe, rest);
+            hash_stripe_scalar(acc_, last, kHashSecret.keys + stripes);
+        }
+        const uint64_t* k = kHashSecret.keys + kMergeKey;
+        uint64_t lo = total_ * 0x9E3779B185EBCA87ULL;
+        uint64_t hi = ~total_ * 0xC2B2AE3D27D4EB4FULL;
+        for (int i = 0; i < 8; i += 2) {
+            lo += fold_mul64(acc_[i] ^ k[i], acc_[i + 1] ^ k[i + 1]);
+            hi += fold_mul64(acc_[i] ^ k[(i + 3) & 7], acc_[i + 1] ^ k[(i + 6) & 7]);
+        }
+        return ContentHash{ hash_avalanche(lo), hash_avalanche(hi) };
+    }
+
+private:
+    uint64_t acc_[8];
+    uint64_t total_ = 0;
+};
+
+static ContentHash hash_buffer(const unsigned char* data, size_t len) {
+    ContentHasher hasher;
+    size_t whole = len - len % kHashBlock;
+    hasher.update(data, whole);
+    return hasher.finish(data + whole, len - whole);
+}
+
+static uint64_t scan_index_checksum(uint64_t seed, const void* data, size_t len) {
+    ContentHash h = hash_buffer(static_cast<const unsigned char*>(data), len);
+    return hash_avalanche(fold_mul64(seed ^ h.lo, 0x9E3779B185EBCA87ULL) ^ h.hi);
+}
+
+// --- 重复文件检测 ---
+// 基于扫描结果分三级筛选，绝大多数文件只用到扫描时已有的大小，根本不会被读取：
+//   1. 按大小分组，大小唯一的文件直接排除；同一 inode 的硬链接只保留一个
+//   2. 剩余文件读首尾各 4 KB 做哈希 (不超过 8 KB 的文件此时已是全文哈希)
+//   3. 首尾哈希也相同的文件再 mmap 整个文件做全文哈希
+// 第 2、3 级在多个线程上并行读取。
+// mmap 读取期间文件被截断会触发 SIGBUS：哈希线程在读取映射前登记跳转点，信号处理函数跳回并放弃该文件；
+// 其他线程触发的 SIGBUS 交还给原来的处理方式。信号处理函数只在全文哈希阶段安装，结束后恢复宿主原来的设置。
+static const size_t kEdgeHashBytes = 4096;
+static thread_local sigjmp_buf* t_mmap_guard = nullptr;
+static struct sigaction g_previous_sigbus;
+static std::mutex g_sigbus_guard_mutex;
+static int g_sigbus_guard_users = 0; // 同时进行的全文哈希阶段数，受 g_sigbus_guard_mutex 保护
+
+static void mmap_sigbus_handler(int sig, siginfo_t* info, void* context) {
+    if (t_mmap_guard) {
+        siglongjmp(*t_mmap_guard, 1);
+    }
+    if (g_previous_sigbus.sa_flags & SA_SIGINFO) {
+        if (g_previous_sigbus.sa_sigaction) {
+            g_previous_sigbus.sa_sigaction(sig, info, context);
+            return;
+        }
+    } else if (g_previous_sigbus.sa_handler != SIG_DFL && g_previous_sigbus.sa_handler != SIG_IGN) {
+        g_previous_sigbus.sa_handler(sig);
+        return;
+    }
+    signal(SIGBUS, SIG_DFL);
+    raise(SIGBUS);
+}
+
+// 作用域内安装 SIGBUS 处理函数；多个重复文件检测同时进行时由第一个安装、最后一个恢复
+class SigbusGuardScope {
+public:
+    SigbusGuardScope() {
+        std::lock_guard<std::mutex> lock(g_sigbus_guard_mutex);
+        if (g_sigbus_guard_users++ > 0) return;
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = mmap_sigbus_handler;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGBUS, &action, &g_previous_sigbus);
+    }
+
+    ~SigbusGuardScope() {
+        std::lock_guard<std::mutex> lock(g_sigbus_guard_mutex);
+        if (--g_sigbus_guard_users > 0) return;
+        struct sigaction current;
+        sigaction(SIGBUS, &g_previous_sigbus, &current);
+        // 宿主在此期间换成了自己的处理函数：保留它，不用旧设置覆盖
+        if (!(current.sa_flags & SA_SIGINFO) || current.sa_sigaction != mmap_sigbus_handler) {
+            sigaction(SIGBUS, &current, nullptr);
+        }
+    }
+
+    SigbusGuardScope(const SigbusGuardScope&) = delete;
+    SigbusGuardScope& operator=(const SigbusGuardScope&) = delete;
+};
+
+static const size_t kHashWindowBytes = 64 << 20; // 全文哈希每次映射的窗口大小 (kHashBlock 的整数倍)
+
+struct DuplicateCandidate {
+    std::string path;
+    uint64_t size;
+    FileCategory category;
+    dev_t dev = 0;
+    ino_t ino = 0;
+    bool valid = false;    // 文件仍存在、仍是普通文件且大小未变
+    bool complete = false; // edge 哈希已覆盖整个文件
+    ContentHash edge{ 0, 0 };
+    ContentHash full{ 0, 0 };
+};
+
+struct DuplicateReport {
+    struct Group {
+        uint64_t file_size;
+        FileCategory category;
+        std::vector<std::string> paths;
+        std::vector<const char*> path_ptrs;
+    };
+    std::vector<Group> groups;
+    DuplicateStats stats{};
+};
+
+// 在 worker_count 个线程上对 [0, count) 并行执行 fn(i)
+template <typename Fn>
+static void parallel_for(size_t count, int worker_count, Fn fn) {
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) fn(i);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < worker_count && static_cast<size_t>(t) < count; ++t) threads.emplace_back(work);
+    work();
+    for (auto& t : threads) t.join();
+}
+
+class DuplicateFinder {
+public:
+    DuplicateReport* run(unsigned int category_mask) {
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<DuplicateReport> report(new DuplicateReport());
+        DuplicateStats& stats = report->stats;
+        int workers = resolve_scan_worker_count();
+
+        // 第 1 级：按大小分组 (空文件不算重复)
+        std::vector<DuplicateCandidate> files;
+        std::string path;
+        for (int slot = 0; slot < kScannedCategoryCount; ++slot) {
+            if (!(category_mask & kScannedCategories[slot])) continue;
+            std::shared_ptr<const ResultSnapshot> snap = merged_snapshot(slot);
+            for (const auto& seg : snap->segments) {
+                const RecordChunk& c = *seg.chunk;
+                for (size_t j = 0; j < seg.count; ++j) {
+                    if (c.sizes[j] == 0) continue;
+                    join_record_path(c.dirs[j], c.names[j], c.name_lens[j], path);
+                    DuplicateCandidate candidate;
+                    candidate.path = path;
+                    candidate.size = c.sizes[j];
+                    candidate.category = kScannedCategories[slot];
+                    files.push_back(std::move(candidate));
+                }
+            }
+        }
+        stats.files_considered = files.size();
+        std::sort(files.begin(), files.end(),
+                  [](const DuplicateCandidate& a, const DuplicateCandidate& b) { return a.size < b.size; });
+        std::vector<DuplicateCandidate> candidates;
+        for_each_run(files, [](const DuplicateCandidate& a, const DuplicateCandidate& b) { return a.size == b.size; },
+                     [&](size_t begin, size_t end) {
+                         if (end - begin < 2) return;
+                         for (size_t i = begin; i < end; ++i) candidates.push_back(std::move(files[i]));
+                     });
+        files.clear();
+        files.shrink_to_fit();
+        stats.size_candidates = candidates.size();
+
+        // 第 2 级：首尾 4 KB 哈希
+        std::atomic<uint64_t> bytes_read(0);
+        parallel_for(candidates.size(), workers, [&](size_t i) { hash_edges(candidates[i], bytes_read); });
+        drop_hard_links(candidates);
+        std::sort(candidates.begin(), candidates.end(), [](const DuplicateCandidate& a, const DuplicateCandidate& b) {
+            if (a.size != b.size) return a.size < b.size;
+            if (a.edge.lo != b.edge.lo) return a.edge.lo < b.edge.lo;
+            return a.edge.hi < b.edge.hi;
+        });
+        std::vector<DuplicateCandidate> survivors;
+        for_each_run(candidates,
+                     [](const DuplicateCandidate& a, const DuplicateCandidate& b) { return a.size == b.size && a.edge == b.edge; },
+                     [&](size_t begin, size_t end) {
+                         if (end - begin < 2) return;
+                         for (size_t i = begin; i < end; ++i) survivors.push_back(std::move(candidates[i]));
+                     });
+        candidates.clear();
+
+        // 第 3 级：全文哈希 (edge 哈希已覆盖全文的小文件直接沿用)
+        std::vector<size_t> to_hash;
+        for (size_t i = 0; i < survivors.size(); ++i) {
+            if (survivors[i].complete) {
+                survivors[i].full = survivors[i].edge;
+            } else {
+                to_hash.push_back(i);
+            }
+        }
+        stats.edge_candidates = to_hash.size();
+        auto full_start = std::chrono::steady_clock::now();
+        std::atomic<uint64_t> full_bytes(0);
+        if (!to_hash.empty()) {
+            SigbusGuardScope sigbus_guard;
+            parallel_for(to_hash.size(), workers, [&](size_t k) { hash_full(survivors[to_hash[k]], full_bytes); });
+        }
+        double full_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - full_start).count();
+        for (size_t index : to_hash) {
+            if (survivors[index].valid) ++stats.files_fully_hashed;
+        }
+
+        std::sort(survivors.begin(), survivors.end(), [](const DuplicateCandidate& a, const DuplicateCandidate& b) {
+            if (a.valid != b.valid) return a.valid;
+            if (a.size != b.size) return a.size < b.size;
+            if (a.full.lo != b.full.lo) return a.full.lo < b.full.lo;
+            if (a.full.hi != b.full.hi) return a.full.hi < b.full.hi;
+            return a.path < b.path;
+        });
+        for_each_run(survivors,
+                     [](const DuplicateCandidate& a, const DuplicateCandidate& b) {
+                         return a.valid && b.valid && a.size == b.size && a.full == b.full;
+                     },
+                     [&](size_t begin, size_t end) {
+                         if (end - begin < 2 || !survivors[begin].valid) return;
+                         DuplicateReport::Group group;
+                         group.file_size = survivors[begin].size;
+                         group.category = survivors[begin].category;
+                         for (size_t i = begin; i < end; ++i) group.paths.push_back(std::move(survivors[i].path));
+                         report->groups.push_back(std::move(group));
+                     });
+
+        // 可释放空间大的组排在前面
+        std::sort(report->groups.begin(), report->groups.end(),
+                  [](const DuplicateReport::Group& a, const DuplicateReport::Group& b) {
+                      return a.file_size * (a.paths.size() - 1) > b.file_size * (b.paths.size() - 1);
+                  });
+        for (auto& group : report->groups) {
+            for (const auto& p : group.paths) group.path_ptrs.push_back(p.c_str());
+            stats.reclaimable_bytes += group.file_size * (group.paths.size() - 1);
+        }
+        stats.groups = report->groups.size();
+        stats.bytes_read = bytes_read.load() + full_bytes.load();
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.hash_mb_per_second = full_seconds > 0 ? full_bytes.load() / 1e6 / full_seconds : 0;
+        return report.release();
+    }
+
+private:
+    // 对已排序数组中 same(a, b) 成立的每一段连续元素调用 fn(begin, end)
+    template <typename Same, typename Fn>
+    static void for_each_run(const std::vector<DuplicateCandidate>& items, Same same, Fn fn) {
+        for (size_t begin = 0; begin < items.size();) {
+            size_t end = begin + 1;
+            while (end < items.size() && same(items[begin], items[end])) ++end;
+            fn(begin, end);
+            begin = end;
+        }
+    }
+
+    static bool read_fully(int fd, unsigned char* buffer, size_t len, off_t offset) {
+        while (len > 0) {
+            ssize_t n = pread(fd, buffer, len, offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buffer += n;
+            len -= static_cast<size_t>(n);
+            offset += n;
+        }
+        return true;
+    }
+
+    // 首尾各 4 KB 拼在一起哈希；不超过 8 KB 的文件读取全文
+    static void hash_edges(DuplicateCandidate& c, std::atomic<uint64_t>& bytes_read) {
+        int fd = open(c.path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || static_cast<uint64_t>(st.st_size) != c.size) {
+            close(fd);
+            return;
+        }
+        c.dev = st.st_dev;
+        c.ino = st.st_ino;
+        unsigned char buffer[2 * kEdgeHashBytes];
+        size_t len;
+        bool ok;
+        if (c.size <= 2 * kEdgeHashBytes) {
+            len = static_cast<size_t>(c.size);
+            ok = read_fully(fd, buffer, len, 0);
+            c.complete = true;
+        } else {
+            len = 2 * kEdgeHashBytes;
+            ok = read_fully(fd, buffer, kEdgeHashBytes, 0) &&
+                 read_fully(fd, buffer + kEdgeHashBytes, kEdgeHashBytes, static_cast<off_t>(c.size - kEdgeHashBytes));
+        }
+        close(fd);
+        if (!ok) return;
+        bytes_read.fetch_add(len, std::memory_order_relaxed);
+        c.edge = hash_buffer(buffer, len);
+        c.valid = true;
+    }
+
+    // 同一 inode 的多个路径 (硬链接) 删掉任何一个都不释放空间，只保留第一个
+    static void drop_hard_links(std::vector<DuplicateCandidate>& candidates) {
+        std::unordered_set<std::string> seen;
+        std::vector<DuplicateCandidate> kept;
+        kept.reserve(candidates.size());
+        for (auto& c : candidates) {
+            if (!c.valid) continue;
+            std::string key = std::to_string(c.dev) + ':' + std::to_string(c.ino);
+            if (seen.insert(key).second) kept.push_back(std::move(c));
+        }
+        candidates.swap(kept);
+    }
+
+    // 按窗口 mmap 整个文件顺序哈希，提示内核顺序预读
+    static void hash_full(DuplicateCandidate& c, std::atomic<uint64_t>& bytes_read) {
+        c.valid = false;
+        int fd = open(c.path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) != c.size) {
+            close(fd);
+            return;
+        }
+        // 跳转点之后会修改、跳回后还要使用的变量必须是 volatile
+        void* volatile map = MAP_FAILED;
+        volatile size_t map_len = 0;
+        sigjmp_buf jump;
+        if (sigsetjmp(jump, 1) != 0) {
+            t_mmap_guard = nullptr;
+            munmap(map, map_len);
+            close(fd);
+            return; // 读取期间文件被截断
+        }
+        t_mmap_guard = &jump;
+        ContentHasher hasher;
+        bool ok = true;
+        for (uint64_t offset = 0; offset < c.size;) {
+            size_t len = static_cast<size_t>(std::min<uint64_t>(kHashWindowBytes, c.size - offset));
+            void* window = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(offset));
+            if (window == MAP_FAILED) {
+                ok = false;
+                break;
+            }
+            map_len = len;
+            map = window;
+            madvise(window, len, MADV_SEQUENTIAL);
+            madvise(window, len, MADV_WILLNEED);
+            const unsigned char* data = static_cast<const unsigned char*>(window);
+            bool last = offset + len == c.size;
+            size_t whole = last ? len - len % kHashBlock : len;
+            hasher.update(data, whole);
+            if (last) c.full = hasher.finish(data + whole, len - whole);
+            map = MAP_FAILED;
+            munmap(window, len);
+            offset += len;
+        }
+        t_mmap_guard = nullptr;
+        close(fd);
+        if (!ok) return;
+        bytes_read.fetch_add(c.size, std::memory_order_relaxed);
+        c.valid = true;
+    }
+};
+
+// --- API 实现 ---
+void StartScan(const char* home_path, ScanCallback callback) {
+    if (!g_scan_finished || g_watch_active) {
+        return; // 扫描已在进行中，或处于监视模式 (结果会自动更新)
+    }
+    
+    // --- 关键：每次开始新扫描前，必须重置停止标志 ---
+    g_stop_scan_flag.store(false); 
+    
+    g_scan_finished = false;
+    
+    if (g_scan_thread.joinable()) {
+        g_scan_thread.join();
+    }
+    std::string home(home_path);
+    g_scan_thread = std::thread([home, callback]() {
+        g_progress.start();
+        scan_directory(home, callback);
+        g_progress.stop();
+    });
+}
+
+// --- 新增 API 的实现 ---
+API void StopScan() {
+    // 设置停止标志，通知扫描线程退出
+    g_stop_scan_flag.store(true);
+}
+
+API void SetScanWorkerCount(int count) {
+    g_scan_worker_count.store(count < 0 ? 0 : count);
+}
+
+API void SetScanBackend(ScanBackend backend) {
+    g_scan_backend.store(backend == SCAN_BACKEND_GETDENTS ? SCAN_BACKEND_GETDENTS : SCAN_BACKEND_STD_FILESYSTEM);
+}
+
+API void SetScanPolicy(ScanPolicy policy) {
+    g_scan_policy.store(policy == SCAN_POLICY_BACKGROUND ? SCAN_POLICY_BACKGROUND : SCAN_POLICY_NORMAL);
+}
+
+API void SetScanMaxEntriesPerSecond(uint64_t max_entries_per_second) {
+    g_scan_max_entries_per_second.store(max_entries_per_second);
+}
+
+API void SetScanDeviceConcurrency(int rotational, int non_rotational) {
+    g_scan_rotational_concurrency.store(rotational > 0 ? rotational : 2);
+    g_scan_solid_state_concurrency.store(non_rotational > 0 ? non_rotational : 0);
+}
+
+API void SetScanInodeOrder(ScanInodeOrder order) {
+    g_scan_inode_order.store(order == SCAN_INODE_ORDER_OFF || order == SCAN_INODE_ORDER_ON ? order : SCAN_INODE_ORDER_AUTO);
+}
+
+API void SetScanOneFileSystem(int enable) {
+    g_scan_one_file_system.store(enable != 0);
+}
+
+API int AddScanRule(const char* pattern, unsigned int categories, ScanRuleAction action) {
+    if (!pattern || pattern[0] == '\0' || (action != SCAN_RULE_EXCLUDE && action != SCAN_RULE_INCLUDE)) {
+        return -1;
+    }
+    if (categories != 0 && (categories & kAllRuleCategories) == 0) {
+        return -1; // 不含任何已知类别 (0 有 "全部类别" 的特殊含义，不能由未知的位截断得到)
+    }
+    uint32_t states = 0;
+    if (!ScanRules::check_pattern(pattern, states)) return -1;
+    std::lock_guard<std::mutex> lock(g_scan_rules_mutex);
+    // 所有路径通配规则共用一个状态位有限的自动机
+    for (const ScanRuleSpec& spec : g_scan_rules) {
+        uint32_t used = 0;
+        ScanRules::check_pattern(spec.pattern, used);
+        states += used;
+    }
+    if (states > kMaxPathGlobStates) return -1;
+    g_scan_rules.push_back(ScanRuleSpec{ pattern, categories, action });
+    return 0;
+}
+
+API void ResetScanRules(void) {
+    std::lock_guard<std::mutex> lock(g_scan_rules_mutex);
+    g_scan_rules = default_scan_rules();
+}
+
+API void SetScanHiddenPolicy(ScanHiddenPolicy policy) {
+    g_scan_hidden_policy.store(policy == SCAN_HIDDEN_INCLUDE ? SCAN_HIDDEN_INCLUDE : SCAN_HIDDEN_SKIP);
+}
+
+API void SetScanIndexPath(const char* index_path) {
+    std::lock_guard<std::mutex> lock(g_scan_index_mutex);
+    g_scan_index_path = index_path ? index_path : "";
+}
+
+API void SetScanIoUring(int enable) {
+    g_scan_use_io_uring.store(enable != 0);
+}
+
+API int IsIoUringSupported() {
+#ifdef DISK_CLEANER_HAVE_IO_URING
+    IoUring probe;
+    return probe.init(1) ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+API void GetScanSyscallStats(ScanSyscallStats* stats) {
+    if (!stats) return;
+    stats->dirs_scanned = g_stat_dirs_scanned.load();
+    stats->entries_scanned = g_stat_entries_seen.load();
+    stats->open_calls = g_stat_open_calls.load();
+    stats->getdents_calls = g_stat_getdents_calls.load();
+    stats->stat_calls = g_stat_stat_calls.load();
+    stats->close_calls = g_stat_close_calls.load();
+    stats->uring_enter_calls = g_stat_uring_enter_calls.load();
+    stats->uring_statx_ops = g_stat_uring_statx_ops.load();
+    stats->dirs_from_index = g_stat_dirs_from_index.load();
+    stats->total_syscalls = stats->open_calls + stats->getdents_calls + stats->stat_calls + stats->close_calls
+                          + stats->uring_enter_calls;
+    stats->syscalls_per_entry = stats->entries_scanned
+        ? static_cast<double>(stats->total_syscalls) / static_cast<double>(stats->entries_scanned) : 0.0;
+}
+
+// --- 扫描遥测 ---
+// 瞬时速率按两次读取之间的差值计算；读取间隔过短时沿用上一次的结果，避免抖动
+struct TelemetryRateSampler {
+    std::mutex mutex;
+    const ScanSession* session = nullptr;
+    uint64_t sample_ns = 0;
+    uint64_t sample_files = 0;
+    double rate = 0;
+};
+static TelemetryRateSampler g_telemetry_rate;
+
+API void GetScanTelemetry(ScanTelemetry* telemetry) {
+    if (!telemetry) return;
+    memset(telemetry, 0, sizeof(*telemetry));
+    std::shared_ptr<ScanSession> session = std::atomic_load(&g_session);
+    if (!session) return;
+
+    uint64_t traversal_ns = 0, classification_ns = 0, size_lookup_ns = 0, callback_ns = 0, throttle_ns = 0;
+    for (size_t i = 0; i < session->shard_count(); ++i) {
+        const TelemetryCounters& c = session->shard(i).telemetry;
+        telemetry->dirs_visited += c.dirs_visited.load(std::memory_order_relaxed);
+        telemetry->files_visited += c.files_visited.load(std::memory_order_relaxed);
+        for (int slot = 0; slot < kScannedCategoryCount; ++slot) {
+            uint64_t n = c.files_classified[slot].load(std::memory_order_relaxed);
+            telemetry->files_classified[slot] += n;
+            telemetry->files_classified_total += n;
+        }
+        telemetry->bytes_found += c.bytes_found.load(std::memory_order_relaxed);
+        telemetry->errors += c.errors.load(std::memory_order_relaxed);
+        telemetry->permission_skips += c.permission_skips.load(std::memory_order_relaxed);
+        traversal_ns += c.traversal_ns.load(std::memory_order_relaxed);
+        classification_ns += c.classification_ns.load(std::memory_order_relaxed);
+        size_lookup_ns += c.size_lookup_ns.load(std::memory_order_relaxed);
+        callback_ns += c.callback_ns.load(std::memory_order_relaxed);
+        throttle_ns += c.throttle_ns.load(std::memory_order_relaxed);
+    }
+    telemetry->traversal_seconds = traversal_ns / 1e9;
+    telemetry->classification_seconds = classification_ns / 1e9;
+    telemetry->size_lookup_seconds = size_lookup_ns / 1e9;
+    telemetry->callback_seconds = callback_ns / 1e9;
+    telemetry->throttle_seconds = throttle_ns / 1e9;
+    telemetry->worker_threads = static_cast<int>(session->shard_count());
+
+    uint64_t now = telemetry_now_ns();
+    uint64_t finished = session->finished_ns();
+    telemetry->finished = finished ? 1 : 0;
+    telemetry->elapsed_seconds = ((finished ? finished : now) - session->started_ns()) / 1e9;
+    if (telemetry->elapsed_seconds > 0) {
+        telemetry->average_files_per_second = telemetry->files_visited / telemetry->elapsed_seconds;
+    }
+
+    std::lock_guard<std::mutex> lock(g_telemetry_rate.mutex);
+    TelemetryRateSampler& r = g_telemetry_rate;
+    if (r.session != session.get()) {
+        r.session = session.get();
+        r.sample_ns = session->started_ns();
+        r.sample_files = 0;
+        r.rate = 0;
+    }
+    if (finished) {
+        r.rate = 0;
+    } else if (now - r.sample_ns >= 500000000ULL) {
+        r.rate = (telemetry->files_visited - r.sample_files) / ((now - r.sample_ns) / 1e9);
+        r.sample_ns = now;
+        r.sample_files = telemetry->files_visited;
+    } else if (r.rate == 0 && now > r.sample_ns) {
+        r.rate = telemetry->average_files_per_second; // 扫描刚开始，还没有完整的采样区间
+    }
+    telemetry->files_per_second = r.rate;
+}
+
+API int ExportScanTelemetryJson(char* buffer, uint64_t buffer_size) {
+    ScanTelemetry t;
+    GetScanTelemetry(&t);
+    ScanSyscallStats sys;
+    GetScanSyscallStats(&sys);
+    std::ostringstream out;
+    out << "{\"finished\":" << t.finished << ",\"worker_threads\":" << t.worker_threads
+        << ",\"elapsed_seconds\":" << t.elapsed_seconds << ",\"files_per_second\":" << t.files_per_second
+        << ",\"average_files_per_second\":" << t.average_files_per_second
+        << ",\"dirs_visited\":" << t.dirs_visited << ",\"files_visited\":" << t.files_visited
+        << ",\"files_classified\":{";
+    static const char* const kSlotNames[] = { "packages", "compressed", "video", "audio", "image", "document" };
+    for (int slot = 0; slot < kScannedCategoryCount; ++slot) {
+        out << (slot ? "," : "") << "\"" << kSlotNames[slot] << "\":" << t.files_classified[slot];
+    }
+    out << "},\"files_classified_total\":" << t.files_classified_total << ",\"bytes_found\":" << t.bytes_found
+        << ",\"errors\":" << t.errors << ",\"permission_skips\":" << t.permission_skips
+        << ",\"phase_seconds\":{\"traversal\":" << t.traversal_seconds
+        << ",\"classification\":" << t.classification_seconds << ",\"size_lookup\":" << t.size_lookup_seconds
+        << ",\"callback\":" << t.callback_seconds << ",\"throttle\":" << t.throttle_seconds << "}"
+        << ",\"syscalls\":{\"open\":" << sys.open_calls << ",\"getdents\":" << sys.getdents_calls
+        << ",\"stat\":" << sys.stat_calls << ",\"close\":" << sys.close_calls
+        << ",\"uring_enter\":" << sys.uring_enter_calls << ",\"uring_statx_ops\":" << sys.uring_statx_ops
+        << ",\"dirs_from_index\":" << sys.dirs_from_index << ",\"per_entry\":" << sys.syscalls_per_entry << "}}";
+    const std::string json = out.str();
+    if (buffer && buffer_size > json.size()) {
+        memcpy(buffer, json.c_str(), json.size() + 1);
+    }
+    return static_cast<int>(json.size());
+}
+
+API int StartWatch(const char* home_path, ScanCallback callback) {
+    if (!home_path || g_watch_active || !g_scan_finished) {
+        return -1;
+    }
+    if (g_scan_thread.joinable()) {
+        g_scan_thread.join();
+    }
+    if (g_watch_thread.joinable()) {
+        g_watch_thread.join();
+    }
+    g_watch_stop_flag = false;
+    g_stop_scan_flag = false;
+    g_scan_finished = false;
+    g_watch_active = true;
+    g_watch_thread = std::thread(watch_main, std::string(home_path), callback);
+    return 0;
+}
+
+API void StopWatch() {
+    if (!g_watch_active) return;
+    g_watch_stop_flag = true;
+    g_stop_scan_flag = true; // 初次扫描或降级重扫尚未结束时一并停止
+    if (g_watch_thread.joinable()) {
+        g_watch_thread.join();
+    }
+    g_watch_active = false;
+}
+
+API int GetWatchMode() {
+    return g_watch_mode.load();
+}
+
+API void SetWatchRescanInterval(int seconds) {
+    g_watch_rescan_interval = seconds > 0 ? seconds : 60;
+}
+
+API void SetScanProgressCallback(ScanBatchCallback callback, int max_batch_files, int max_interval_ms) {
+    g_progress.configure(callback, max_batch_files, max_interval_ms);
+}
+
+API uint64_t GetResultsGeneration() {
+    return g_results_generation.load(std::memory_order_acquire);
+}
+
+API void GetScanMemoryStats(ScanMemoryStats* stats) {
+    if (!stats) return;
+    {
+        std::lock_guard<std::mutex> lock(g_results_mutex);
+        stats->files_recorded = 0;
+        stats->dirs_recorded = 0;
+        stats->arena_bytes = 0;
+        stats->record_bytes = 0;
+        if (g_session) g_session->memory_stats(*stats);
+    }
+    struct rusage usage;
+    stats->peak_rss_bytes = getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<uint64_t>(usage.ru_maxrss) * 1024 : 0;
+    stats->peak_rss_per_million_files = stats->files_recorded
+        ? static_cast<double>(stats->peak_rss_bytes) * 1e6 / static_cast<double>(stats->files_recorded) : 0.0;
+}
+
+int IsScanFinished() {
+    return g_scan_finished ? 1 : 0;
+}
+
+// 对调用方不透明的快照句柄，每个句柄持有一个引用
+struct ScanSnapshot {
+    std::shared_ptr<const ResultSnapshot> data;
+};
+
+API ScanSnapshot* AcquireScanSnapshot(FileCategory category) {
+    int slot = category_slot(category);
+    if (slot < 0) return nullptr; // 回收站等类别不通过扫描得到，没有文件列表
+    return new ScanSnapshot{ merged_snapshot(slot) };
+}
+
+API void ReleaseScanSnapshot(ScanSnapshot* snapshot) {
+    delete snapshot;
+}
+
+API uint64_t GetScanSnapshotCount(const ScanSnapshot* snapshot) {
+    return snapshot ? snapshot->data->count : 0;
+}
+
+API uint64_t GetScanSnapshotTotalSize(const ScanSnapshot* snapshot) {
+    return snapshot ? snapshot->data->total_bytes : 0;
+}
+
+API uint64_t GetScanSnapshotGeneration(const ScanSnapshot* snapshot) {
+    return snapshot ? snapshot->data->generation : 0;
+}
+
+API uint64_t GetScanSnapshotEntries(const ScanSnapshot* snapshot, uint64_t start, ScanSnapshotEntry* entries,
+                                    uint64_t max_entries) {
+    if (!snapshot || !entries) return 0;
+    const ResultSnapshot& snap = *snapshot->data;
+    if (start >= snap.count) return 0;
+    uint64_t n = std::min<uint64_t>(max_entries, snap.count - start);
+    size_t seg = snap.segment_of(static_cast<size_t>(start));
+    size_t j = static_cast<size_t>(start) - snap.starts[seg];
+    for (uint64_t k = 0; k < n; ++k, ++j) {
+        if (j == snap.segments[seg].count) {
+            ++seg;
+            j = 0;
+        }
+        const RecordChunk& c = *snap.segments[seg].chunk;
+        entries[k].directory = c.dirs[j];
+        entries[k].name = c.names[j];
+        entries[k].size = c.sizes[j];
+    }
+    return n;
+}
+
+// --- 目录树查询 ---
+// 句柄持有扫描会话，保证目录节点和路径在释放句柄前有效；节点中的计数是读取时的值
+struct DirectoryTree {
+    std::shared_ptr<ScanSession> session;
+};
+
+static void fill_directory_node(const SessionDir* dir, DirectoryNode* node) {
+    DirTotals t = dir->tree.load();
+    node->path = dir->path;
+    node->bytes = t.bytes;
+    node->file_count = t.files;
+    memcpy(node->category_bytes, t.category_bytes, sizeof(node->category_bytes));
+    node->subdir_count = dir->tree.child_count.load(std::memory_order_relaxed);
+    node->complete = dir->tree.pending.load(std::memory_order_acquire) == 0 ? 1 : 0;
+    node->id = dir;
+}
+
+API void SetDirectoryTreeMode(DirectoryTreeMode mode) {
+    g_directory_tree_mode.store(mode == DIRECTORY_TREE_ALL_FILES ? DIRECTORY_TREE_ALL_FILES : DIRECTORY_TREE_SCANNED_FILES);
+}
+
+API DirectoryTree* AcquireDirectoryTree() {
+    std::shared_ptr<ScanSession> session = std::atomic_load(&g_session);
+    return session ? new DirectoryTree{ session } : nullptr;
+}
+
+API void ReleaseDirectoryTree(DirectoryTree* tree) {
+    delete tree;
+}
+
+API int GetDirectoryTreeRoot(const DirectoryTree* tree, DirectoryNode* node) {
+    if (!tree || !node) return -1;
+    fill_directory_node(tree->session->root(), node);
+    return 0;
+}
+
+API int FindDirectoryNode(const DirectoryTree* tree, const char* path, DirectoryNode* node) {
+    if (!tree || !path || !node) return -1;
+    const SessionDir* dir = tree->session->root();
+    std::string target = normalize_home_path(path).native();
+    if (target.compare(0, dir->path_len, dir->path, dir->path_len) != 0) return -1;
+    if (target.size() > dir->path_len && target[dir->path_len] != '/' && dir->path[dir->path_len - 1] != '/') return -1;
+    // 从根目录开始逐级沿子目录链表查找
+    size_t pos = dir->path_len;
+    while (dir && pos < target.size()) {
+        if (target[pos] == '/') {
+            ++pos;
+            continue;
+        }
+        size_t end = target.find('/', pos);
+        if (end == std::string::npos) end = target.size();
+        const SessionDir* child = dir->tree.first_child.load(std::memory_order_acquire);
+        while (child && (child->detached || child->name_len != end - pos
+                         || memcmp(child->name(), target.data() + pos, end - pos) != 0)) {
+            child = child->tree.next_sibling;
+        }
+        dir = child;
+        pos = end;
+    }
+    if (!dir) return -1;
+    fill_directory_node(dir, node);
+    return 0;
+}
+
+API int GetDirectoryChildren(const DirectoryTree* tree, const void* id, DirectoryNode* children, int max_count) {
+    if (!tree || !id || !children || max_count <= 0) return 0;
+    const SessionDir* dir = static_cast<const SessionDir*>(id);
+    std::vector<std::pair<uint64_t, const SessionDir*>> list;
+    for (const SessionDir* c = dir->tree.first_child.load(std::memory_order_acquire); c; c = c->tree.next_sibling) {
+        if (!c->detached) list.emplace_back(c->tree.bytes.load(std::memory_order_relaxed), c);
+    }
+    size_t n = std::min(list.size(), static_cast<size_t>(max_count));
+    std::partial_sort(list.begin(), list.begin() + n, list.end(),
+                      [](const std::pair<uint64_t, const SessionDir*>& a, const std::pair<uint64_t, const SessionDir*>& b) {
+                          return a.first > b.first;
+                      });
+    for (size_t i = 0; i < n; ++i) {
+        fill_directory_node(list[i].second, &children[i]);
+    }
+    return static_cast<int>(n);
+}
+
+API int GetScanSnapshotEntry(const ScanSnapshot* snapshot, uint64_t index, ScanSnapshotEntry* entry) {
+    return GetScanSnapshotEntries(snapshot, index, entry, 1) == 1 ? 0 : -1;
+}
+
+API int CopyScanSnapshotPath(const ScanSnapshot* snapshot, uint64_t index, char* buffer, uint64_t buffer_size) {
+    ScanSnapshotEntry entry;
+    if (GetScanSnapshotEntry(snapshot, index, &entry) != 0) return -1;
+    size_t dir_len = strlen(entry.directory);
+    size_t name_len = strlen(entry.name);
+    bool need_slash = dir_len == 0 || entry.directory[dir_len - 1] != '/';
+    size_t len = dir_len + (need_slash ? 1 : 0) + name_len;
+    if (buffer && buffer_size > len) {
+        memcpy(buffer, entry.directory, dir_len);
+        if (need_slash) buffer[dir_len] = '/';
+        memcpy(buffer + len - name_len, entry.name, name_len + 1);
+    }
+    return static_cast<int>(len);
+}
+
+// 兼容接口：基于快照拼出完整路径并逐个拷贝，不再持有结果锁
+FileInfo* GetScanResults(FileCategory category, int* count) {
+    *count = 0;
+    int slot = category_slot(category);
+    if (slot < 0) return nullptr;
+    std::shared_ptr<const ResultSnapshot> snap = merged_snapshot(slot);
+    if (snap->count == 0) return nullptr;
+
+    *count = static_cast<int>(snap->count);
+    
+    // 注意：这里返回的数组内存需要调用方使用 free_scan_results 来释放
+    FileInfo* results = new FileInfo[*count];
+    std::string path;
+    int i = 0;
+    for (const auto& seg : snap->segments) {
+        const RecordChunk& c = *seg.chunk;
+        for (size_t j = 0; j < seg.count; ++j, ++i) {
+            join_record_path(c.dirs[j], c.names[j], c.name_lens[j], path);
+            results[i].path = new char[path.size() + 1];
+            memcpy(results[i].path, path.c_str(), path.size() + 1);
+            results[i].size = c.sizes[j];
+            results[i].category = category;
+        }
+    }
+    return results;
+}
+
+void FreeScanResults(FileInfo* results, int count) {
+    if (!results) return;
+    // 释放 get_scan_results 中为每个 path 字符串分配的内存
+    for (int i = 0; i < count; ++i) {
+        delete[] results[i].path;
+    }
+    // 释放数组本身的内存
+    delete[] results;
+}
+
+void SetLargestFileCount(int count) {
+    g_largest_file_count.store(count < 0 ? 0 : count); // 各分片在下次读取时按新上限重建
+}
+
+FileInfo* GetLargestFiles(FileCategory category, int max_count, int* count) {
+    *count = 0;
+    int slot = category_slot(category);
+    std::shared_ptr<ScanSession> session = std::atomic_load(&g_session); // 持有会话，保证路径在拷贝期间有效
+    max_count = std::min(max_count, g_largest_file_count.load());
+    if (slot < 0 || !session || max_count <= 0) return nullptr;
+
+    // 每个分片只贡献自己的前 K 个，合并后再取前 max_count 个
+    std::vector<LargestFileEntry> top;
+    session->for_each_records(slot, [&](CategoryRecords& records) { records.collect_largest(top); });
+    size_t n = std::min(top.size(), static_cast<size_t>(max_count));
+    if (n == 0) return nullptr;
+    std::partial_sort(top.begin(), top.begin() + n, top.end(),
+                      [](const LargestFileEntry& a, const LargestFileEntry& b) { return a.size > b.size; });
+
+    *count = static_cast<int>(n);
+    FileInfo* results = new FileInfo[n];
+    std::string path;
+    for (size_t i = 0; i < n; ++i) {
+        join_record_path(top[i].dir, top[i].name, top[i].name_len, path);
+        results[i].path = new char[path.size() + 1];
+        memcpy(results[i].path, path.c_str(), path.size() + 1);
+        results[i].size = top[i].size;
+        results[i].category = category;
+    }
+    return results;
+}
+// --- 文件搬迁引擎 ---
+// 每个文件依次尝试：
+//   1. rename：同一文件系统内瞬间完成
+//   2. FICLONE：跨目录但文件系统支持 reflink (btrfs/xfs) 时共享数据块，不复制数据
+//   3. copy_file_range：在内核中复制数据，不经过用户态缓冲；内核或文件系统不支持时退回 read/write
+// 复制先写到目标目录中的临时文件，保留权限位、属主和时间戳并 fsync 后再 rename 到最终位置，
+// 最后才删除源文件，任何一步失败都会删除临时文件并保留源文件。
+// 同一目标设备上同时复制的文件数有上限，避免机械盘上多个大文件交错写入。
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+static std::atomic<int> g_migration_per_device(4);
+
+struct MigrationItem {
+    std::string source;
+    std::string destination;
+};
 
-// --- 内部数据结构和状态变量 ---
-static std::thread g_scan_thread;
-static std::atomic<bool> g_scan_finished(true);
-static std::mutex g_results_mutex;
-static std::vector<FileInfo> g_trash_files;
-static std::vector<FileInfo> g_package_files;
-static std::vector<FileInfo> g_compressed_files; // 压缩包
-static std::vector<FileInfo> g_video_files;
-static std::vector<FileInfo> g_audio_files;
-static std::vector<FileInfo> g_image_files; // 图片
-static std::vector<FileInfo> g_document_files; // 文档
-static std::atomic<uint64_t> g_total_junk_size(0);
+// 不覆盖已存在目标的 rename (目标存在时失败，errno 为 EEXIST)：
+// 优先 renameat2(RENAME_NOREPLACE)，文件系统不支持时退回 link + unlink，同样由内核保证原子性
+static int rename_noreplace(const char* from, const char* to) {
+    if (renameat2(AT_FDCWD, from, AT_FDCWD, to, RENAME_NOREPLACE) == 0) return 0;
+    if (errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP) return -1;
+    if (link(from, to) != 0) return -1;
+    unlink(from);
+    return 0;
+}
 
-// --- 文件类型定义 ---
-std::unordered_set<std::string> g_package_exts = {".deb", ".rpm", ".pkg", ".appimage"};
-std::unordered_set<std::string> g_video_exts = {".mp4", ".mkv", ".avi", ".mov", ".wmv", ".flv", ".webm",
- 								".3gp", ".m4v", ".mpg", ".rmvb", ".rm", ".vob", ".mpeg"};
-std::unordered_set<std::string> g_audio_exts = {".mp3", ".wav", ".flac", ".aac", ".ogg", ".m4a", ".wma"};
-std::unordered_set<std::string> g_image_exts = {".jpg", ".jpeg", ".png", ".gif", ".bmp", ".tiff", ".svg", ".webp"};
-std::unordered_set<std::string> g_document_exts = {".pdf", ".doc", ".docx", ".xls", ".xlsx", ".ppt", ".pptx"};//文档类别
+class FileMigrator {
+public:
+    // cancel: 置位后不再开始新文件，正在复制的文件在下一个数据块前放弃；limiter: 可选的带宽上限
+    FileMigrator(int per_device_limit, const std::atomic<bool>* cancel = nullptr, BandwidthLimiter* limiter = nullptr)
+        : per_device_limit_(std::max(1, per_device_limit)), cancel_(cancel), limiter_(limiter) {}
 
-// --- 核心修改：使用一个有序的 vector 来检查文件名结尾 ---
-// 把更长的、更精确的后缀放在前面
-std::vector<std::string> g_compressed_endings = {
-    ".tar.gz", ".tar.bz2", ".tar.xz", ".tgz",
-    ".zip", ".rar", ".7z", ".gz", ".bz2", ".xz", ".tar"
-};
+    // 返回成功搬迁的文件数；统计结果通过 stats() 获取
+    size_t run(const std::vector<MigrationItem>& items) {
+        auto start = std::chrono::steady_clock::now();
+        moved_.assign(items.size(), 0);
+        // 按目标目录所在设备分组，每个设备各自一组工作线程
+        std::unordered_map<dev_t, std::vector<size_t>> groups;
+        for (size_t i = 0; i < items.size(); ++i) {
+            struct stat st;
+            std::string dir = fs::path(items[i].destination).parent_path().string();
+            dev_t dev = stat(dir.c_str(), &st) == 0 ? st.st_dev : 0;
+            groups[dev].push_back(i);
+        }
 
-// --- 内部辅助函数 ---
-// --- 更新 get_file_category 函数以支持新枚举和图片 ---
-FileCategory get_file_category(const fs::path& path, const fs::path& trash_path) {
-    // 获取完整文件名并转为小写，以便进行不区分大小写的比较
-    std::string filename = path.filename().string();
-    std::transform(filename.begin(), filename.end(), filename.begin(), ::tolower);
-    // 2. 检查压缩文件 (新逻辑)
-    for (const auto& ending : g_compressed_endings) {
-        // 手动实现 "ends_with" (兼容 C++17)
-        if (filename.length() >= ending.length() && 
-            filename.compare(filename.length() - ending.length(), ending.length(), ending) == 0) {
-            return CATEGORY_COMPRESSED;
-        }
-    }
-    // 3. 检查其他类型的文件
-    std::string ext = path.extension().string();
-    // 再次转换，因为 ext 是新获取的
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-    if (g_package_exts.count(ext)) return CATEGORY_PACKAGES;
-    if (g_video_exts.count(ext)) return CATEGORY_VIDEO;
-    if (g_audio_exts.count(ext)) return CATEGORY_AUDIO;
-    if (g_image_exts.count(ext)) return CATEGORY_IMAGE;
-    if (g_document_exts.count(ext)) return CATEGORY_DOCUMENT;
-
-    // 4. 如果都不是，则返回 UNKNOWN
-    return CATEGORY_UNKNOWN;
-}
-// --- 新增：内部辅助函数，用于计算目录大小 ---
-static uint64_t calculate_directory_size(const fs::path& p) {
-    uint64_t current_size = 0;
-    try {
-        // 确保目录存在
-        if (fs::exists(p) && fs::is_directory(p)) {
-             for (const auto& entry : fs::recursive_directory_iterator(p, fs::directory_options::skip_permission_denied)) {
-                if (entry.is_regular_file()) {
-                    // 同样需要捕获可能的错误
-                    std::error_code ec;
-                    uint64_t file_size = fs::file_size(entry, ec);
-                    if (!ec) {
-                        current_size += file_size;
+        std::vector<std::thread> threads;
+        std::vector<std::unique_ptr<std::atomic<size_t>>> cursors;
+        for (auto& group : groups) {
+            cursors.emplace_back(new std::atomic<size_t>(0));
+            std::atomic<size_t>* cursor = cursors.back().get();
+            const std::vector<size_t>* indices = &group.second;
+            size_t workers = std::min<size_t>(static_cast<size_t>(per_device_limit_), indices->size());
+            for (size_t w = 0; w < workers; ++w) {
+                threads.emplace_back([this, &items, cursor, indices]() {
+                    std::vector<char> buffer;
+                    for (size_t k = cursor->fetch_add(1); k < indices->size() && !cancelled(); k = cursor->fetch_add(1)) {
+                        size_t index = (*indices)[k];
+                        moved_[index] = migrate_file(items[index], buffer) ? 1 : 0;
                     }
-                }
+                });
             }
         }
-    } catch (...) {
-        // 捕获所有可能的异常，保证函数不会崩溃
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return static_cast<size_t>(stats().files_moved);
     }
-    return current_size;
-}
 
-// --- 新增辅助函数：将文件处理逻辑提取出来，避免代码重复 ---
-void process_file_entry(const fs::path& current_path, FileCategory category, ScanCallback callback) {
-    std::error_code ec;
-    uint64_t file_size = fs::file_size(current_path, ec);
-    
-    if (!ec) {
-        char* path_copy = new char[current_path.string().length() + 1];
-        strcpy(path_copy, current_path.string().c_str());
-        FileInfo info = { path_copy, file_size, category };
-        
-        {
-            std::lock_guard<std::mutex> lock(g_results_mutex);
-            if (category == CATEGORY_PACKAGES) g_package_files.push_back(info);
-            else if (category == CATEGORY_COMPRESSED) g_compressed_files.push_back(info);
-            else if (category == CATEGORY_VIDEO) g_video_files.push_back(info);
-            else if (category == CATEGORY_AUDIO) g_audio_files.push_back(info);
-            else if (category == CATEGORY_IMAGE) g_image_files.push_back(info);
-            else if (category == CATEGORY_DOCUMENT) g_document_files.push_back(info);
+    bool moved(size_t index) const { return moved_[index] != 0; }
+
+    // 已经传输的字节数 (复制中的文件按数据块累加)，可在 run 期间从其他线程读取
+    uint64_t bytes_transferred() const { return bytes_transferred_.load(std::memory_order_relaxed); }
+
+    MigrationStats stats() const {
+        MigrationStats stats;
+        stats.files_renamed = files_renamed_.load();
+        stats.files_cloned = files_cloned_.load();
+        stats.files_copied = files_copied_.load();
+        stats.files_moved = stats.files_renamed + stats.files_cloned + stats.files_copied;
+        stats.files_failed = files_failed_.load();
+        stats.bytes_moved = bytes_moved_.load();
+        stats.bytes_copied = bytes_copied_.load();
+        stats.seconds = seconds_;
+        stats.mb_per_second = seconds_ > 0 ? stats.bytes_moved / 1e6 / seconds_ : 0;
+        return stats;
+    }
+
+private:
+    bool cancelled() const { return cancel_ && cancel_->load(std::memory_order_relaxed); }
+
+    bool migrate_file(const MigrationItem& item, std::vector<char>& buffer) {
+        struct stat st;
+        if (lstat(item.source.c_str(), &st) != 0) {
+            return false; // 源文件已不存在
+        }
+        // 不同目录下的同名文件会落到同一个目标上：已存在的目标一律不覆盖，该文件计为失败并保留源文件
+        if (rename_noreplace(item.source.c_str(), item.destination.c_str()) == 0) {
+            files_renamed_.fetch_add(1, std::memory_order_relaxed);
+            bytes_moved_.fetch_add(static_cast<uint64_t>(st.st_size), std::memory_order_relaxed);
+            bytes_transferred_.fetch_add(static_cast<uint64_t>(st.st_size), std::memory_order_relaxed);
+            return true;
+        }
+        if (errno != EXDEV || !S_ISREG(st.st_mode)) {
+            report_failure(item, errno);
+            return false;
+        }
+        // 跨设备时 rename 先报告 EXDEV，目标已存在就不必复制 (最终发布时仍会原子地检查一次)
+        struct stat existing;
+        if (lstat(item.destination.c_str(), &existing) == 0) {
+            report_failure(item, EEXIST);
+            return false;
         }
 
-        g_total_junk_size += file_size;
+        static std::atomic<uint64_t> sequence(0);
+        fs::path destination(item.destination);
+        std::string temp = (destination.parent_path() / ("." + destination.filename().string() + "." +
+                            std::to_string(getpid()) + "-" + std::to_string(sequence.fetch_add(1)) + ".migrating")).string();
+        int src = open(item.source.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (src < 0) {
+            report_failure(item, errno);
+            return false;
+        }
+        int dst = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (dst < 0) {
+            report_failure(item, errno);
+            close(src);
+            return false;
+        }
 
-        if (callback) {
-            callback(info.path, info.size, g_total_junk_size, info.category);
+        uint64_t transferred = 0;
+        bool cloned = ioctl(dst, FICLONE, src) == 0;
+        bool ok = cloned || copy_data(src, dst, static_cast<uint64_t>(st.st_size), buffer, transferred);
+        int error = ok ? 0 : errno;
+        if (ok) {
+            // 属主可能因权限不足无法保留，不视为失败
+            int chown_result = fchown(dst, st.st_uid, st.st_gid);
+            (void)chown_result;
+            struct timespec times[2] = { st.st_atim, st.st_mtim };
+            ok = fchmod(dst, st.st_mode & 07777) == 0 && futimens(dst, times) == 0 && fsync(dst) == 0;
+            if (!ok) error = errno;
+        }
+        close(src);
+        if (close(dst) != 0 && ok) {
+            ok = false;
+            error = errno;
         }
+        if (ok && rename_noreplace(temp.c_str(), item.destination.c_str()) != 0) {
+            ok = false;
+            error = errno;
+        }
+        if (!ok) {
+            unlink(temp.c_str());
+            bytes_transferred_.fetch_sub(transferred, std::memory_order_relaxed);
+            report_failure(item, error);
+            return false;
+        }
+        if (unlink(item.source.c_str()) != 0) {
+            // 目标已经完整写入，源文件删不掉时只提示，不回滚
+            std::cerr << "[警告] 已复制到 '" << item.destination << "'，但无法删除源文件 '" << item.source
+                      << "': " << strerror(errno) << std::endl;
+        }
+        if (cloned) {
+            bytes_transferred_.fetch_add(static_cast<uint64_t>(st.st_size), std::memory_order_relaxed);
+        }
+        (cloned ? files_cloned_ : files_copied_).fetch_add(1, std::memory_order_relaxed);
+        bytes_moved_.fetch_add(static_cast<uint64_t>(st.st_size), std::memory_order_relaxed);
+        if (!cloned) bytes_copied_.fetch_add(static_cast<uint64_t>(st.st_size), std::memory_order_relaxed);
+        return true;
     }
-}
-
-void scan_directory(const std::string& home_path_str, ScanCallback callback) {
-    fs::path home_path(home_path_str);
-    
-    // --- 新增：定义要为搬迁类别排除的特定目录 ---
-    fs::path excluded_migrate_path = home_path / "MoveFiles";
 
-    // 清空上次扫描结果 (保持不变)
-    {
-        std::lock_guard<std::mutex> lock(g_results_mutex);
-        g_package_files.clear();
-        g_compressed_files.clear();
-        g_video_files.clear();
-        g_audio_files.clear();
-        g_image_files.clear();
-        g_trash_files.clear(); // 虽然不再扫描，但清空以保持状态一致性
-        g_document_files.clear();
-        g_total_junk_size = 0;
+    // 每个数据块之前检查取消并申请带宽；取消时返回 false 且 errno 为 ECANCELED
+    bool before_chunk(uint64_t bytes) {
+        if (cancelled() || (limiter_ && !limiter_->acquire(bytes, cancel_))) {
+            errno = ECANCELED;
+            return false;
+        }
+        return true;
     }
 
-    try {
-        // 使用手动迭代器循环
-        auto it = fs::recursive_directory_iterator(home_path, fs::directory_options::skip_permission_denied);
-        auto end = fs::recursive_directory_iterator();
+    // 数据块实际只传输了 used 字节 (失败时为 0)：归还其余的带宽
+    void unused_chunk(uint64_t reserved, uint64_t used) {
+        if (limiter_ && used < reserved) limiter_->release(reserved - used);
+    }
 
-        while (it != end) {
-            // --- 关键：在循环的开始检查停止标志 ---
-            if (g_stop_scan_flag.load()) {
-                std::cout << "\n[Debug] Scan stopped by request." << std::endl;
-                break; // 收到停止信号，退出循环
-            }
-            const auto& entry = *it;
-            const auto& current_path = entry.path();
+    void after_chunk(uint64_t bytes, uint64_t& transferred) {
+        transferred += bytes;
+        bytes_transferred_.fetch_add(bytes, std::memory_order_relaxed);
+    }
 
-            // --- 新增的核心逻辑：判断是否是隐藏文件或目录 ---
-            if (current_path.filename().string().rfind('.', 0) == 0) {
-                // 如果文件名以 '.' 开头
-                if (entry.is_directory()) {
-                    // 如果是目录，则告诉迭代器不要进入
-                    it.disable_recursion_pending();
-                }
-                // 不论是文件还是目录，都直接跳到下一次迭代
-                
-                // (将迭代器递增逻辑移到循环末尾，以统一处理)
-            } else {
-                // --- 如果不是隐藏文件/目录，则执行之前的逻辑 ---
-                if (entry.is_regular_file()) {
-                    // 注意：因为隐藏目录被跳过，这里的 trash_path 参数已经无用，可以传空
-                    FileCategory category = get_file_category(current_path, fs::path());
-                    // --- 新增的核心逻辑：检查文件是否在排除目录内 ---
-                    bool is_migrate_category = category & (CATEGORY_VIDEO | CATEGORY_AUDIO | CATEGORY_IMAGE | CATEGORY_DOCUMENT);
-                    
-	             if (is_migrate_category) {
-	                    // 使用 weakly_canonical 进行健壮的路径比较
-	                    // 检查当前文件的路径是否以排除目录的路径开头
-	                    if (fs::weakly_canonical(current_path).string().rfind(excluded_migrate_path.string(), 0) == 0) {
-	                        // 如果是，则跳过此文件，继续下一次循环
-	                        
-	                        // (将迭代器递增逻辑移到循环末尾，以统一处理)
-	                    } else {
-	                        // 如果不在排除目录内，则正常处理
-	                        process_file_entry(current_path, category, callback);
-	                    }
-	                } else if (category != CATEGORY_UNKNOWN) {
-	                    // 对于非搬迁类别（如安装包、压缩包），直接处理
-	                    process_file_entry(current_path, category, callback);
-	                }
-	         }    
-            }
-
-            // --- 核心修改：手动增加迭代器 ---
-            // 将迭代器递增操作也放入 try-catch 块，以处理权限问题导致的迭代失败
-            try {
-                ++it;
-            } catch (const fs::filesystem_error& e) {
-                // 如果在迭代某个目录时出错（例如，权限突然改变），则跳过它
-                std::cerr << "Error iterating past " << entry.path() << ": " << e.what() << std::endl;
-                it.disable_recursion_pending();
-                // 再次尝试递增
-                std::error_code ec;
-                it.increment(ec);
-                if (ec) { // 如果还是失败，就退出循环
+    // 优先 copy_file_range (内核内复制)；不支持跨文件系统或不支持该系统调用时退回 read/write。
+    // 最多复制 size 字节 (lstat 时的大小)，每块只按实际要传输的字节申请带宽
+    bool copy_data(int src, int dst, uint64_t size, std::vector<char>& buffer, uint64_t& transferred) {
+        const size_t kMaxChunk = 8 << 20;
+        size_t chunk = limiter_ ? limiter_->chunk_size(kMaxChunk) : kMaxChunk;
+        uint64_t copied = 0;
+#ifdef SYS_copy_file_range
+        while (copied < size) {
+            size_t len = static_cast<size_t>(std::min<uint64_t>(chunk, size - copied));
+            if (!before_chunk(len)) return false;
+            ssize_t n = syscall(SYS_copy_file_range, src, nullptr, dst, nullptr, len, 0u);
+            unused_chunk(len, n > 0 ? static_cast<uint64_t>(n) : 0);
+            if (n < 0) {
+                if (copied == 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)) {
                     break;
                 }
+                return false;
             }
+            if (n == 0) return true; // 源文件在复制期间变短
+            copied += static_cast<uint64_t>(n);
+            after_chunk(static_cast<uint64_t>(n), transferred);
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Scan error: " << e.what() << std::endl;
+        if (copied > 0 || size == 0) return true;
+#endif
+        buffer.resize(std::min<size_t>(chunk, 1 << 20));
+        while (copied < size) {
+            size_t len = static_cast<size_t>(std::min<uint64_t>(buffer.size(), size - copied));
+            if (!before_chunk(len)) return false;
+            ssize_t n = read(src, buffer.data(), len);
+            unused_chunk(len, n > 0 ? static_cast<uint64_t>(n) : 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (n == 0) return true;
+            for (ssize_t written = 0; written < n;) {
+                ssize_t w = write(dst, buffer.data() + written, static_cast<size_t>(n - written));
+                if (w < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                written += w;
+            }
+            copied += static_cast<uint64_t>(n);
+            after_chunk(static_cast<uint64_t>(n), transferred);
+        }
+        return true;
     }
 
-    g_scan_finished = true;
-}
+    void report_failure(const MigrationItem& item, int error) {
+        if (error == ECANCELED) return; // 被取消的文件保持原样，不算失败
+        files_failed_.fetch_add(1, std::memory_order_relaxed);
+        std::cerr << "Failed to move " << item.source << ": " << strerror(error) << std::endl;
+    }
 
-// --- API 实现 ---
-void StartScan(const char* home_path, ScanCallback callback) {
-    if (!g_scan_finished) {
-        return; // 扫描已在进行中
+    int per_device_limit_;
+    const std::atomic<bool>* cancel_;
+    BandwidthLimiter* limiter_;
+    std::vector<char> moved_; // 每个文件是否搬迁成功 (各线程只写自己的下标)
+    double seconds_ = 0;
+    std::atomic<uint64_t> files_renamed_{ 0 };
+    std::atomic<uint64_t> files_cloned_{ 0 };
+    std::atomic<uint64_t> files_copied_{ 0 };
+    std::atomic<uint64_t> files_failed_{ 0 };
+    std::atomic<uint64_t> bytes_moved_{ 0 };
+    std::atomic<uint64_t> bytes_copied_{ 0 };
+    std::atomic<uint64_t> bytes_transferred_{ 0 };
+};
+
+static std::mutex g_migration_stats_mutex;
+static MigrationStats g_last_migration_stats{};
+
+// 执行一批搬迁并记录统计、打印吞吐量
+static size_t run_migration(FileMigrator& migrator, const std::vector<MigrationItem>& items) {
+    size_t moved = migrator.run(items);
+    MigrationStats stats = migrator.stats();
+    {
+        std::lock_guard<std::mutex> lock(g_migration_stats_mutex);
+        g_last_migration_stats = stats;
     }
-    
-    // --- 关键：每次开始新扫描前，必须重置停止标志 ---
-    g_stop_scan_flag.store(false); 
-    
-    g_scan_finished = false;
-    
-    if (g_scan_thread.joinable()) {
-        g_scan_thread.join();
+    if (!items.empty()) {
+        std::cout << "[信息] 搬迁完成：" << stats.files_moved << " 个文件 (rename " << stats.files_renamed
+                  << ", reflink " << stats.files_cloned << ", 复制 " << stats.files_copied << ")，失败 "
+                  << stats.files_failed << "，" << stats.bytes_moved / 1e6 << " MB，" << stats.mb_per_second
+                  << " MB/s" << std::endl;
     }
-    g_scan_thread = std::thread(scan_directory, std::string(home_path), callback);
+    return moved;
 }
 
-// --- 新增 API 的实现 ---
-API void StopScan() {
-    // 设置停止标志，通知扫描线程退出
-    g_stop_scan_flag.store(true);
-}
+// --- 异步搬迁任务 ---
+// 任务启动时从结果快照中取出文件列表 (不持有结果锁)，在自己的线程中执行搬迁；
+// 结束后才短暂加锁，把已搬走的记录从扫描结果中删除。记录按名字指针识别 (指向 arena，
+// 快照持有 arena 的引用，不会被复用)。期间若开始了新的扫描，新结果已经反映磁盘现状，不再修改。
+struct MigrationJob {
+    std::atomic<bool> cancel{ false };
+    BandwidthLimiter limiter;
+    std::unique_ptr<FileMigrator> migrator;
+    std::vector<MigrationItem> items;
+    std::vector<const char*> record_names; // 与 items 一一对应
+    std::vector<int> record_slots;
+    std::vector<std::shared_ptr<const ResultSnapshot>> snapshots;
+    std::shared_ptr<ScanSession> session;
+    unsigned int category_mask = 0;
+    uint64_t bytes_total = 0;
+    std::thread thread;
 
-int IsScanFinished() {
-    return g_scan_finished ? 1 : 0;
-}
+    std::mutex mutex;
+    std::condition_variable cv;
+    MigrationJobState state = MIGRATION_JOB_RUNNING;
+    std::chrono::steady_clock::time_point sample_time; // 计算当前速率用的上一次采样
+    uint64_t sample_bytes = 0;
+    double current_rate = 0;
 
-FileInfo* GetScanResults(FileCategory category, int* count) {
-    std::lock_guard<std::mutex> lock(g_results_mutex);
-    const std::vector<FileInfo>* source_vec = nullptr;
-
-    // <--- MODIFIED: 使用所有新的枚举名
-    if (category == CATEGORY_TRASH) source_vec = &g_trash_files;
-    else if (category == CATEGORY_PACKAGES) source_vec = &g_package_files;
-    else if (category == CATEGORY_VIDEO) source_vec = &g_video_files;
-    else if (category == CATEGORY_AUDIO) source_vec = &g_audio_files;
-    else if (category == CATEGORY_IMAGE) source_vec = &g_image_files;
-    else if (category == CATEGORY_COMPRESSED) source_vec = &g_compressed_files;
-    else if (category == CATEGORY_DOCUMENT) source_vec = &g_document_files;
-    else {
-        *count = 0;
-        return nullptr;
+    void run() {
+        run_migration(*migrator, items);
+        {
+            std::lock_guard<std::mutex> lock(g_results_mutex);
+            if (session && std::atomic_load(&g_session) == session) {
+                DirTreeRemoval removed;
+                for (int slot = 0; slot < kScannedCategoryCount; ++slot) {
+                    if (!(category_mask & kScannedCategories[slot])) continue;
+                    std::unordered_set<const char*> moved;
+                    for (size_t i = 0; i < items.size(); ++i) {
+                        if (record_slots[i] == slot && migrator->moved(i)) moved.insert(record_names[i]);
+                    }
+                    if (moved.empty()) continue;
+                    session->for_each_records(slot, [&](CategoryRecords& records) {
+                        records.remove_if([&](size_t i) {
+                            if (!moved.count(records.name(i))) return false;
+                            removed.add(records.dir(i), slot, records.file_size(i));
+                            return true;
+                        });
+                    });
+                }
+                removed.apply(*session);
+                bump_results_generation();
+                publish_snapshots(category_mask);
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        state = cancel.load() ? MIGRATION_JOB_CANCELLED : MIGRATION_JOB_FINISHED;
+        cv.notify_all();
     }
+};
 
-    *count = source_vec->size();
-    if (*count == 0) return nullptr;
-    
-    // 注意：这里返回的数组内存需要调用方使用 free_scan_results 来释放
-    FileInfo* results = new FileInfo[*count];
-    for (int i = 0; i < *count; ++i) {
-        // 浅拷贝结构体
-        results[i] = (*source_vec)[i];
-        // 为路径字符串分配新内存并拷贝，避免悬空指针
-        results[i].path = new char[strlen((*source_vec)[i].path) + 1];
-        strcpy(results[i].path, (*source_vec)[i].path);
+// 创建目标目录并从当前结果快照收集文件列表，启动任务线程；目标目录无法创建时返回 nullptr
+static MigrationJob* start_migration_job(unsigned int category_mask, const char* destination_dir,
+                                         uint64_t max_bytes_per_second) {
+    if (!destination_dir) return nullptr;
+    fs::path dest(destination_dir);
+    try {
+        if (!fs::exists(dest)) {
+            fs::create_directories(dest);
+        }
+    } catch (const fs::filesystem_error& e) {
+        std::cerr << "Failed to create destination directory: " << e.what() << std::endl;
+        return nullptr;
     }
-    return results;
-}
 
-void FreeScanResults(FileInfo* results, int count) {
-    if (!results) return;
-    // 释放 get_scan_results 中为每个 path 字符串分配的内存
-    for (int i = 0; i < count; ++i) {
-        delete[] results[i].path;
-    }
-    // 释放数组本身的内存
-    delete[] results;
-}
-/**
- * @brief 获取回收站总大小
- * 
- * @param home_path 用户主目录路径
- * @return uint64_t 返回回收站占用的字节数
- */
-static uint64_t internal_get_trash_size(const char* home_path_cstr) {
-    if (!home_path_cstr) return 0;
-    fs::path home_path(home_path_cstr);
-    fs::path trash_files_path = home_path / ".local/share/Trash/files";
-    fs::path trash_info_path = home_path / ".local/share/Trash/info";
+    std::unique_ptr<MigrationJob> job(new MigrationJob());
+    job->category_mask = category_mask & (CATEGORY_VIDEO | CATEGORY_AUDIO | CATEGORY_IMAGE | CATEGORY_DOCUMENT);
+    // 快照与会话需要来自同一次扫描；收集期间恰好开始新扫描时重新收集
+    do {
+        job->session = std::atomic_load(&g_session);
+        job->items.clear();
+        job->record_names.clear();
+        job->record_slots.clear();
+        job->snapshots.clear();
+        job->bytes_total = 0;
+        std::string path;
+        for (int slot = 0; slot < kScannedCategoryCount; ++slot) {
+            if (!(job->category_mask & kScannedCategories[slot])) continue;
+            std::shared_ptr<const ResultSnapshot> snap = merged_snapshot(slot);
+            for (const auto& seg : snap->segments) {
+                const RecordChunk& c = *seg.chunk;
+                for (size_t j = 0; j < seg.count; ++j) {
+                    join_record_path(c.dirs[j], c.names[j], c.name_lens[j], path);
+                    job->items.push_back(MigrationItem{ path, (dest / fs::path(path).filename()).string() });
+                    job->record_names.push_back(c.names[j]);
+                    job->record_slots.push_back(slot);
+                    job->bytes_total += c.sizes[j];
+                }
+            }
+            job->snapshots.push_back(std::move(snap));
+        }
+    } while (std::atomic_load(&g_session) != job->session);
 
-    return calculate_directory_size(trash_files_path) + calculate_directory_size(trash_info_path);
+    job->limiter.set_rate(max_bytes_per_second);
+    job->migrator.reset(new FileMigrator(g_migration_per_device.load(), &job->cancel, &job->limiter));
+    job->sample_time = std::chrono::steady_clock::now();
+    MigrationJob* raw = job.release();
+    raw->thread = std::thread(&MigrationJob::run, raw);
+    return raw;
 }
 
 int MoveFiles(const char** file_paths, int count, const char* destination_dir) {
@@ -304,22 +5591,30 @@ int MoveFiles(const char** file_paths, int count, const char* destination_dir) {
         if (!fs::exists(dest)) {
             fs::create_directories(dest);
         }
-        
-        for (int i = 0; i < count; ++i) {
-            fs::path source(file_paths[i]);
-            if (fs::exists(source)) {
-                fs::path new_location = dest / source.filename();
-                fs::rename(source, new_location);
-            }
-        }
     } catch (const std::exception& e) {
         std::cerr << "Failed to move files: " << e.what() << std::endl;
         return -1;
     }
-    return 0;
+
+    std::vector<MigrationItem> items;
+    for (int i = 0; i < count; ++i) {
+        if (!file_paths[i]) continue;
+        fs::path source(file_paths[i]);
+        items.push_back(MigrationItem{ source.string(), (dest / source.filename()).string() });
+    }
+    FileMigrator migrator(g_migration_per_device.load());
+    run_migration(migrator, items);
+    return migrator.stats().files_failed == 0 ? 0 : -1;
 }
 
 // --- 4. 实现新的 API ---
+API FileCategory ClassifyFileName(const char* file_name) {
+    if (!file_name) return CATEGORY_UNKNOWN;
+    const char* slash = strrchr(file_name, '/');
+    const char* name = slash ? slash + 1 : file_name;
+    return classify_file_name(name, strlen(name));
+}
+
 API void SetExtensions(FileCategory category, const char* extensions[], int count) {
     // 辅助 lambda，用于填充 unordered_set
     auto update_set = [&](std::unordered_set<std::string>& target_set) {
@@ -348,70 +5643,123 @@ API void SetExtensions(FileCategory category, const char* extensions[], int coun
             });
             break;
         default: // 对于其他类型（如回收站、缓存），此操作无意义
-            break;
+            return;
+    }
+    rebuild_classifier();
+}
+
+// 缓存、回收站等清理路径共用的 "统计大小 + 删除" 原语：一次遍历完成，返回实际释放的字节数
+static uint64_t size_and_unlink_tree(const fs::path& root, bool remove_root,
+                                     std::vector<std::string> skip_children = std::vector<std::string>()) {
+    DeleteOptions options;
+    options.remove_root = remove_root;
+    options.unlink_special = true;
+    options.skip_children = std::move(skip_children);
+    return ParallelDeleter(resolve_scan_worker_count(), options).run(root.string());
+}
+
+// 删除单个路径，可以是文件，也可以是整棵目录树
+static uint64_t size_and_unlink_path(const fs::path& path) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) return 0;
+    if (S_ISDIR(st.st_mode)) return size_and_unlink_tree(path, true);
+    if (unlink(path.c_str()) != 0) return 0;
+    return S_ISREG(st.st_mode) ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+// 列出 dir 下除 skip 和墓碑目录以外的直接子项
+static std::vector<std::string> list_children(const fs::path& dir, const std::vector<std::string>& skip) {
+    std::vector<std::string> names;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name != kTombstoneDirName && std::find(skip.begin(), skip.end(), name) == skip.end()) {
+            names.push_back(std::move(name));
+        }
     }
+    return names;
+}
+
+// 延迟模式：把 parent 下的 names 移进墓碑，统计大小后交给后台回收线程，返回统计到的字节数。
+// 无法 rename 的子项当场删除。
+static uint64_t entomb_and_measure(const fs::path& parent, const std::vector<std::string>& names) {
+    std::vector<fs::path> failed;
+    fs::path tombstone = entomb_children(parent, names, parent / kTombstoneDirName, failed);
+    uint64_t bytes = 0;
+    if (!tombstone.empty()) {
+        DeleteOptions options;
+        options.measure_only = true;
+        options.unlink_special = true;
+        bytes = ParallelDeleter(resolve_scan_worker_count(), options).run(tombstone.string());
+        g_reaper.enqueue(tombstone, bytes);
+    }
+    for (const auto& path : failed) {
+        bytes += size_and_unlink_path(path);
+    }
+    return bytes;
+}
+
+// 清空 dir 下除 skip 以外的内容 (dir 本身保留)
+static uint64_t cleanup_children(const fs::path& dir, const std::vector<std::string>& skip) {
+    if (g_cleanup_mode.load() == CLEANUP_MODE_DEFERRED) {
+        return entomb_and_measure(dir, list_children(dir, skip));
+    }
+    std::vector<std::string> skip_children(skip);
+    skip_children.push_back(kTombstoneDirName);
+    return size_and_unlink_tree(dir, false, std::move(skip_children));
+}
+
+// 删除整个路径 (包括它本身)
+static uint64_t cleanup_path(const fs::path& path) {
+    if (g_cleanup_mode.load() == CLEANUP_MODE_DEFERRED) {
+        return entomb_and_measure(path.parent_path(), { path.filename().string() });
+    }
+    return size_and_unlink_path(path);
 }
 
 // 内部函数，实现回收站清理逻辑
 static uint64_t internal_empty_trash(const std::string& home_path_str) {
-    // <--- MODIFIED: 修复变量名错误
     fs::path trash_base_path = fs::path(home_path_str) / ".local/share/Trash";
     fs::path trash_files_path = trash_base_path / "files";
     fs::path trash_info_path = trash_base_path / "info";
-    uint64_t freed_space = 0;
-
-    auto calculate_size = [&](const fs::path& p) {
-        uint64_t current_size = 0;
-        try {
-            if (fs::exists(p) && fs::is_directory(p)) {
-                for (const auto& entry : fs::recursive_directory_iterator(p, fs::directory_options::skip_permission_denied)) {
-                    if (entry.is_regular_file()) {
-                        std::error_code ec;
-                        uint64_t size = fs::file_size(entry, ec);
-                        if (!ec) current_size += size;
-                    }
-                }
-            }
-        } catch (...) {}
-        return current_size;
-    };
 
-    freed_space = calculate_size(trash_files_path) + calculate_size(trash_info_path);
-
-    try {
-        if (fs::exists(trash_files_path)) fs::remove_all(trash_files_path);
-        if (fs::exists(trash_info_path)) fs::remove_all(trash_info_path);
-        fs::create_directories(trash_files_path);
-        fs::create_directories(trash_info_path);
-    } catch (const std::exception& e) {
-        std::cerr << "Failed to empty trash: " << e.what() << std::endl;
-        return 0;
+    // 清空内容但保留 files/ 和 info/ 目录本身，释放的字节数在删除过程中统计
+    uint64_t freed_space = 0;
+    if (g_cleanup_mode.load() == CLEANUP_MODE_DEFERRED) {
+        // 两个目录整体移进墓碑再重建，files/ 与 info/ 保持一致
+        freed_space = entomb_and_measure(trash_base_path, { "files", "info" });
+    } else {
+        freed_space = size_and_unlink_tree(trash_files_path, false) + size_and_unlink_tree(trash_info_path, false);
     }
+
+    std::error_code ec;
+    fs::create_directories(trash_files_path, ec);
+    fs::create_directories(trash_info_path, ec);
     return freed_space;
 }
 
 // --- 新 API 的实现 ---
-API uint64_t GetSpecialCategorySize(FileCategory category) {
+API void GetSpecialCategorySizes(SpecialCategorySizes* sizes) {
+    if (!sizes) return;
+    memset(sizes, 0, sizeof(*sizes));
     const char* home_dir_cstr = getenv("HOME");
-    if (!home_dir_cstr) return 0;
-    fs::path home_path(home_dir_cstr);
-    fs::path user_cache_path = home_path / ".cache";
-    fs::path thumb_cache_path = user_cache_path / "thumbnails";
+    if (!home_dir_cstr) return;
+    g_special_sizes.compute(home_dir_cstr, sizes);
+}
 
+API uint64_t GetSpecialCategorySize(FileCategory category) {
+    // 三类一起统计；目录缓存使得界面依次查询各类别时，后几次调用几乎不需要 I/O
+    SpecialCategorySizes sizes;
     switch (category) {
-        // --- 新增 Case ---
         case CATEGORY_TRASH:
-            return internal_get_trash_size(home_dir_cstr);
-
+            GetSpecialCategorySizes(&sizes);
+            return sizes.trash;
         case CATEGORY_THUMBNAIL_CACHE:
-            return calculate_directory_size(thumb_cache_path);
-        
-        case CATEGORY_OTHER_APP_CACHE: {
-            uint64_t total_cache_size = calculate_directory_size(user_cache_path);
-            uint64_t thumb_cache_size = calculate_directory_size(thumb_cache_path);
-            // 返回总大小减去缩略图大小，避免重复计算
-            return (total_cache_size > thumb_cache_size) ? (total_cache_size - thumb_cache_size) : 0;
-        }
+            GetSpecialCategorySizes(&sizes);
+            return sizes.thumbnail_cache;
+        case CATEGORY_OTHER_APP_CACHE:
+            GetSpecialCategorySizes(&sizes);
+            return sizes.other_app_cache;
         default:
             return 0;
     }
@@ -425,54 +5773,49 @@ API uint64_t CleanupCategories(unsigned int category_mask) {
     if (home_dir_cstr) {
         fs::path user_cache_path = fs::path(home_dir_cstr) / ".cache";
         fs::path thumb_cache_path = user_cache_path / "thumbnails";
+        // 被扫描规则排除的缓存子目录总是保留
+        std::vector<std::string> keep;
+        if (category_mask & (CATEGORY_OTHER_APP_CACHE | CATEGORY_THUMBNAIL_CACHE)) {
+            keep = rule_excluded_cache_dirs(home_dir_cstr);
+        }
+        const bool keep_thumbnails = std::find(keep.begin(), keep.end(), "thumbnails") != keep.end();
 
         // 优先处理组合情况：如果两个缓存都选了，就直接清空整个 .cache 目录
         if ((category_mask & CATEGORY_OTHER_APP_CACHE) && (category_mask & CATEGORY_THUMBNAIL_CACHE)) {
-            uint64_t size = calculate_directory_size(user_cache_path);
-            try {
-                for (const auto& entry : fs::directory_iterator(user_cache_path)) {
-                    fs::remove_all(entry.path());
-                }
-                total_freed_space += size;
-            } catch (const fs::filesystem_error& e) { /* ... */ }
+            total_freed_space += cleanup_children(user_cache_path, keep);
         } else { // 否则，处理单个情况
-            if (category_mask & CATEGORY_THUMBNAIL_CACHE) {
-                uint64_t size = calculate_directory_size(thumb_cache_path);
-                try {
-                    fs::remove_all(thumb_cache_path);
-                    total_freed_space += size;
-                } catch (const fs::filesystem_error& e) { /* ... */ }
+            if ((category_mask & CATEGORY_THUMBNAIL_CACHE) && !keep_thumbnails) {
+                total_freed_space += cleanup_path(thumb_cache_path);
             }
             if (category_mask & CATEGORY_OTHER_APP_CACHE) {
-                // 选择性删除：遍历 .cache，但不删除 thumbnails 目录
-                uint64_t freed_now = 0;
-                try {
-                    for (const auto& entry : fs::directory_iterator(user_cache_path)) {
-                        if (entry.path() != thumb_cache_path) { // 跳过缩略图目录
-                            uint64_t entry_size = calculate_directory_size(entry.path());
-                            fs::remove_all(entry.path());
-                            freed_now += entry_size;
-                        }
-                    }
-                    total_freed_space += freed_now;
-                } catch (const fs::filesystem_error& e) { /* ... */ }
+                // 选择性删除：清空 .cache，但保留 thumbnails 目录
+                if (!keep_thumbnails) keep.push_back("thumbnails");
+                total_freed_space += cleanup_children(user_cache_path, keep);
             }
         }
     }
     
     // --- 2. 处理扫描出的文件列表清理 (复用旧逻辑) ---
-    auto clear_file_list = [&](std::vector<FileInfo>& files) {
-        for (const auto& file_info : files) {
-            try {
-                if(fs::exists(file_info.path)) {
-                    fs::remove(file_info.path);
-                    total_freed_space += file_info.size;
+    DirTreeRemoval removed;
+    auto clear_file_list = [&](FileCategory category) {
+        if (!g_session) return;
+        int slot = category_slot(category);
+        g_session->for_each_records(slot, [&](CategoryRecords& records) {
+            std::string path;
+            for (size_t i = 0; i < records.size(); ++i) {
+                join_record_path(records.dir(i), records.name(i), records.name_len(i), path);
+                try {
+                    if(fs::exists(path)) {
+                        fs::remove(path);
+                        total_freed_space += records.file_size(i);
+                    }
+                    removed.add(records.dir(i), slot, records.file_size(i)); // 删除失败的文件仍留在目录树中
+                }  catch(const fs::filesystem_error& e) {
+                    std::cerr << "Failed to delete " << path << ": " << e.what() << std::endl;
                 }
-            }  catch(const fs::filesystem_error& e) {
-                std::cerr << "Failed to delete " << file_info.path << ": " << e.what() << std::endl;
             }
-        }
-        files.clear();
+            records.clear();
+        });
     };
 
     // 使用 lock_guard 保证线程安全
@@ -480,19 +5823,31 @@ API uint64_t CleanupCategories(unsigned int category_mask) {
     if (category_mask & CATEGORY_TRASH) {
         // 回收站清理逻辑比较特殊，我们把它也整合进来
         if (home_dir_cstr) {
-             uint64_t trash_size_before = calculate_directory_size(fs::path(home_dir_cstr) / ".local/share/Trash");
-             // 调用内部的清空回收站逻辑
-             internal_empty_trash(home_dir_cstr); // 假设 internal_empty_trash 存在
-             total_freed_space += trash_size_before;
+             total_freed_space += internal_empty_trash(home_dir_cstr);
         }
-        g_trash_files.clear();
     }
-    if (category_mask & CATEGORY_PACKAGES) clear_file_list(g_package_files);
-    if (category_mask & CATEGORY_COMPRESSED) clear_file_list(g_compressed_files);
+    if (category_mask & CATEGORY_PACKAGES) clear_file_list(CATEGORY_PACKAGES);
+    if (category_mask & CATEGORY_COMPRESSED) clear_file_list(CATEGORY_COMPRESSED);
+    if (g_session) removed.apply(*g_session);
+    bump_results_generation();
+    publish_snapshots(category_mask);
 
     return total_freed_space;
 }
 
+API void SetCleanupMode(CleanupMode mode) {
+    g_cleanup_mode = (mode == CLEANUP_MODE_DEFERRED) ? CLEANUP_MODE_DEFERRED : CLEANUP_MODE_IMMEDIATE;
+}
+
+API void GetReaperProgress(ReaperProgress* progress) {
+    if (!progress) return;
+    g_reaper.progress(progress);
+}
+
+API int WaitForReaper(int timeout_ms) {
+    return g_reaper.wait(timeout_ms) ? 1 : 0;
+}
+
 //清理指定文件夹下的所有文件
 API uint64_t CleanupDirectory(const char* dir_path_str) {
     // --- 1. 路径合法性检查 (初步) ---
@@ -544,109 +5899,127 @@ API uint64_t CleanupDirectory(const char* dir_path_str) {
 
     // --- 通过所有检查，开始执行清理 ---
     std::cout << "[信息] 路径 '" << dir_path_str << "' 通过所有安全检查，开始清理其下的所有文件..." << std::endl;
-    uint64_t total_freed_space = 0;
-    
-    try {
-	  // --- 阶段一：删除所有文件 ---
-        // --- 核心修改：使用递归迭代器遍历所有子孙文件 ---
-        for (const auto& entry : fs::recursive_directory_iterator(dir_path, fs::directory_options::skip_permission_denied)) {
-            // --- 逐个文件进行删除，并进行精细的错误处理 ---
-            // 确保我们只处理文件，跳过目录
-            if (entry.is_regular_file()) {
-                std::error_code ec_size, ec_remove;
-                uint64_t file_size = fs::file_size(entry, ec_size);
-
-                if (!ec_size) {
-                    fs::remove(entry.path(), ec_remove);
-                    if (!ec_remove) {
-                        // 只有在获取大小和删除都成功时，才增加计数
-                        total_freed_space += file_size;
-                    } else {
-                        // 如果删除失败，打印具体错误并继续
-                        std::cerr << "[警告] 无法删除文件 '" << entry.path().string() 
-                                  << "': " << ec_remove.message() << std::endl;
-                    }
-                } else {
-                    std::cerr << "[警告] 无法获取文件大小 '" << entry.path().string() 
-                              << "': " << ec_size.message() << std::endl;
-                }
-            }
-        }
-    } catch (const std::exception& e) {
-        // 捕获迭代器本身可能产生的错误
-        std::cerr << "[错误] 清理过程中遍历目录时发生错误: " << e.what() << std::endl;
-    }
+    // 单次后序遍历删除：文件随列举即删，子树清空后立即删除该目录 (保留传入的根目录本身)
+    ParallelDeleter deleter(resolve_scan_worker_count(), DeleteOptions());
+    uint64_t total_freed_space = deleter.run(dir_path.string());
 
-    // --- 阶段二：安全地清理所有产生的空目录 ---
-    try {
-        // 1. 收集所有子目录的路径
-        std::vector<fs::path> subdirs;
-        for (const auto& entry : fs::recursive_directory_iterator(dir_path, fs::directory_options::skip_permission_denied)) {
-            if (entry.is_directory()) {
-                subdirs.push_back(entry.path());
-            }
-        }
+    return total_freed_space;
+}
 
-        // 2. 按路径长度降序排序 (从最深的目录开始处理)
-        std::sort(subdirs.begin(), subdirs.end(), [](const fs::path& a, const fs::path& b) {
-            return a.string().length() > b.string().length();
-        });
+//搬迁指定文件类型 
+int MigrateCategories(unsigned int category_mask, const char* destination_dir) {
+    // 同步接口：启动一个不限速的任务并等待完成，搬迁期间同样不持有结果锁
+    MigrationJob* job = start_migration_job(category_mask, destination_dir, 0);
+    if (!job) return -1;
+    ReleaseMigrationJob(job);
+    return 0;
+}
 
-        // 3. 遍历收集到的路径列表并删除空目录
-        for (const auto& subdir_path : subdirs) {
-            // 再次检查目录是否存在且为空
-            if (fs::exists(subdir_path) && fs::is_empty(subdir_path)) {
-                 // 确保不删除用户传入的根目录本身
-                if (subdir_path != dir_path) {
-                    fs::remove(subdir_path);
-                }
-            }
+API MigrationJob* StartMigrationJob(unsigned int category_mask, const char* destination_dir,
+                                    uint64_t max_bytes_per_second) {
+    return start_migration_job(category_mask, destination_dir, max_bytes_per_second);
+}
+
+API void GetMigrationJobProgress(MigrationJob* job, MigrationJobProgress* progress) {
+    if (!job || !progress) return;
+    MigrationStats stats = job->migrator->stats();
+    uint64_t transferred = job->migrator->bytes_transferred();
+    progress->files_total = job->items.size();
+    progress->files_done = stats.files_moved;
+    progress->files_failed = stats.files_failed;
+    progress->bytes_total = job->bytes_total;
+    progress->bytes_done = transferred;
+
+    std::lock_guard<std::mutex> lock(job->mutex);
+    progress->state = job->state;
+    if (job->state != MIGRATION_JOB_RUNNING) {
+        job->current_rate = 0;
+    } else {
+        // 距上次采样至少 0.5 秒才更新，避免频繁轮询时速率抖动
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - job->sample_time).count();
+        if (seconds >= 0.5) {
+            job->current_rate = (transferred - job->sample_bytes) / 1e6 / seconds;
+            job->sample_time = now;
+            job->sample_bytes = transferred;
         }
-    } catch (const std::exception& e) {
-         std::cerr << "[警告] 清理空目录时发生错误: " << e.what() << std::endl;
     }
+    progress->mb_per_second = job->current_rate;
+}
 
-    return total_freed_space;
+API void SetMigrationJobBandwidthLimit(MigrationJob* job, uint64_t max_bytes_per_second) {
+    if (job) job->limiter.set_rate(max_bytes_per_second);
 }
 
-//搬迁指定文件类型 
-int MigrateCategories(unsigned int category_mask, const char* destination_dir) {
-    fs::path dest(destination_dir);
-    try {
-        if (!fs::exists(dest)) {
-            fs::create_directories(dest);
-        }
-    } catch (const fs::filesystem_error& e) {
-        std::cerr << "Failed to create destination directory: " << e.what() << std::endl;
-        return -1;
+API void CancelMigrationJob(MigrationJob* job) {
+    if (job) job->cancel = true;
+}
+
+API int WaitMigrationJob(MigrationJob* job, int timeout_ms) {
+    if (!job) return 1;
+    std::unique_lock<std::mutex> lock(job->mutex);
+    auto done = [job]() { return job->state != MIGRATION_JOB_RUNNING; };
+    if (timeout_ms < 0) {
+        job->cv.wait(lock, done);
+        return 1;
     }
-    
-    // 辅助lambda，用于搬迁文件列表
-    auto migrate_list = [&](std::vector<FileInfo>& files) {
-        for (const auto& file_info : files) {
-            try {
-                fs::path source(file_info.path);
-                if (fs::exists(source)) {
-                    fs::rename(source, dest / source.filename());
-                }
-            } catch (const fs::filesystem_error& e) {
-                std::cerr << "Failed to move " << file_info.path << ": " << e.what() << std::endl;
-                // continue on error
-            }
-        }
-        files.clear();
-    };
-    
-    std::lock_guard<std::mutex> lock(g_results_mutex);
-    if (category_mask & CATEGORY_VIDEO) migrate_list(g_video_files);
-    if (category_mask & CATEGORY_AUDIO) migrate_list(g_audio_files);
-    if (category_mask & CATEGORY_IMAGE) migrate_list(g_image_files);
-    if (category_mask & CATEGORY_DOCUMENT) migrate_list(g_document_files);
+    return job->cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), done) ? 1 : 0;
+}
+
+API void ReleaseMigrationJob(MigrationJob* job) {
+    if (!job) return;
+    if (job->thread.joinable()) {
+        job->thread.join();
+    }
+    delete job;
+}
+
+API void SetMigrationConcurrency(int per_device) {
+    g_migration_per_device = per_device > 0 ? per_device : 4;
+}
+
+API void GetLastMigrationStats(MigrationStats* stats) {
+    if (!stats) return;
+    std::lock_guard<std::mutex> lock(g_migration_stats_mutex);
+    *stats = g_last_migration_stats;
+}
+
+API DuplicateReport* FindDuplicates(unsigned int category_mask) {
+    DuplicateFinder finder;
+    return finder.run(category_mask);
+}
 
+API void ReleaseDuplicateReport(DuplicateReport* report) {
+    delete report;
+}
+
+API uint64_t GetDuplicateGroupCount(const DuplicateReport* report) {
+    return report ? report->groups.size() : 0;
+}
+
+API int GetDuplicateGroup(const DuplicateReport* report, uint64_t index, DuplicateGroup* group) {
+    if (!report || !group || index >= report->groups.size()) return -1;
+    const DuplicateReport::Group& g = report->groups[static_cast<size_t>(index)];
+    group->file_size = g.file_size;
+    group->reclaimable_bytes = g.file_size * (g.paths.size() - 1);
+    group->file_count = static_cast<uint32_t>(g.paths.size());
+    group->category = g.category;
+    group->paths = g.path_ptrs.data();
     return 0;
 }
+
+API void GetDuplicateStats(const DuplicateReport* report, DuplicateStats* stats) {
+    if (!stats) return;
+    if (!report) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    *stats = report->stats;
+}
+
 // --- 新增 API 的实现 (修复崩溃的关键) ---
 void CleanupScanner() {
+    StopWatch();
     if (g_scan_thread.joinable()) {
         g_scan_thread.join();
     }
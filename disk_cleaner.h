@@ -49,6 +49,126 @@ struct FileInfo {
     FileCategory category;//文件类别
 };
 
+/**
+ * @brief 目录遍历后端
+ */
+enum ScanBackend {
+    SCAN_BACKEND_STD_FILESYSTEM = 0,  // 基于 std::filesystem::directory_iterator (默认)
+    SCAN_BACKEND_GETDENTS       = 1   // 基于 openat/getdents64，利用 d_type 跳过不必要的 stat (仅 Linux)
+};
+
+/**
+ * @brief 目录项的处理顺序
+ */
+enum ScanInodeOrder {
+    SCAN_INODE_ORDER_OFF  = 0,  // 按 getdents 返回的顺序边读边处理
+    SCAN_INODE_ORDER_ON   = 1,  // 读完整个目录后按 inode 号排序再取大小和入队子目录，减少机械盘寻道
+    SCAN_INODE_ORDER_AUTO = 2   // 只对机械盘按 inode 排序 (默认)
+};
+
+/**
+ * @brief 扫描规则的动作
+ */
+enum ScanRuleAction {
+    SCAN_RULE_EXCLUDE = 0,  // 排除：不再把匹配目录下的文件计入给定类别 (类别为 0 时不扫描整棵子树)
+    SCAN_RULE_INCLUDE = 1   // 包含：撤销先前规则对给定类别的排除，路径形式的包含规则可以进入被排除的目录或隐藏目录
+};
+
+/**
+ * @brief 隐藏文件和目录 (名字以 '.' 开头) 的扫描方式
+ */
+enum ScanHiddenPolicy {
+    SCAN_HIDDEN_SKIP    = 0,  // 不扫描 (默认)，包含规则指定的路径除外
+    SCAN_HIDDEN_INCLUDE = 1   // 与普通文件和目录一样扫描
+};
+
+/**
+ * @brief 扫描策略
+ */
+enum ScanPolicy {
+    SCAN_POLICY_NORMAL     = 0,  // 全速扫描 (默认)
+    SCAN_POLICY_BACKGROUND = 1   // 后台扫描：扫描线程使用 nice 19 和空闲 I/O 优先级，I/O 拥塞时自动放慢
+};
+
+/**
+ * @brief 最近一次扫描的系统调用统计，用于对比不同遍历后端的开销。
+ *        std::filesystem 后端的数值按库调用估算 (getdents64 记为每个目录两次)。
+ */
+struct ScanSyscallStats {
+    uint64_t dirs_scanned;      // 已扫描的目录数
+    uint64_t entries_scanned;   // 已检查的非隐藏目录项数 (文件 + 目录)
+    uint64_t open_calls;        // openat / opendir 次数
+    uint64_t getdents_calls;    // getdents64 次数
+    uint64_t stat_calls;        // stat / fstatat 次数
+    uint64_t close_calls;       // close 次数
+    uint64_t uring_enter_calls; // io_uring_enter 次数 (启用 io_uring 时)
+    uint64_t uring_statx_ops;   // 通过 io_uring 提交的 statx 请求数 (不是系统调用)
+    uint64_t dirs_from_index;   // 时间戳未变、直接复用索引结果的目录数
+    uint64_t total_syscalls;    // 以上系统调用之和 (不含 uring_statx_ops)
+    double syscalls_per_entry;  // 平均每个目录项的系统调用数
+};
+
+/**
+ * @brief 监视模式的当前工作方式
+ */
+enum WatchMode {
+    WATCH_MODE_OFF     = 0,  // 未处于监视模式
+    WATCH_MODE_INOTIFY = 1,  // 通过 inotify 事件增量更新结果
+    WATCH_MODE_POLLING = 2   // inotify 不可用或 watch 数量耗尽，定期增量重扫
+};
+
+/**
+ * @brief 扫描结果的内存占用统计。
+ *        扫描结果中的路径按 "父目录 + 文件名" 保存在按块分配的 arena 中，开始新扫描时整体释放。
+ */
+struct ScanMemoryStats {
+    uint64_t files_recorded;    // 当前结果中的文件数
+    uint64_t dirs_recorded;     // 会话中登记的目录数
+    uint64_t arena_bytes;       // 路径 arena 已分配的字节数
+    uint64_t record_bytes;      // 结果记录与目录表占用的字节数
+    uint64_t peak_rss_bytes;    // 进程的峰值常驻内存 (getrusage ru_maxrss)
+    double peak_rss_per_million_files; // 按当前文件数折算的每百万文件峰值常驻内存 (字节)
+};
+
+/**
+ * @brief 扫描遥测。计数由各扫描线程分别累加，读取时汇总，扫描过程中任意时刻都可以读取；
+ *        各阶段耗时是所有线程之和，用于区分 "磁盘慢" (遍历、取大小) 和 "回调慢"。
+ */
+struct ScanTelemetry {
+    uint64_t dirs_visited;            // 已处理的目录数 (含直接复用索引的目录)
+    uint64_t files_visited;           // 已检查的非隐藏文件数 (普通文件和符号链接)
+    uint64_t files_classified[6];     // 依次为安装包、压缩包、视频、音频、图片、文档命中的文件数
+    uint64_t files_classified_total;  // 以上之和
+    uint64_t bytes_found;             // 命中文件的总字节数
+    uint64_t errors;                  // 打开、读取目录或取文件大小失败的次数 (不含权限不足)
+    uint64_t permission_skips;        // 因权限不足跳过的目录或文件数
+    double traversal_seconds;         // 读取目录的耗时
+    double classification_seconds;    // 按文件名分类的耗时 (抽样估计)
+    double size_lookup_seconds;       // stat / fstatat / io_uring statx 的耗时
+    double callback_seconds;          // 扫描回调和进度投递的耗时
+    double throttle_seconds;          // 后台模式退让和目录项预算造成的休眠时间
+    double elapsed_seconds;           // 扫描开始至今 (已结束时为总耗时)
+    double files_per_second;          // 瞬时速率：相邻两次读取 (至少间隔 0.5 秒) 之间检查的文件数 / 时间；扫描结束后为 0
+    double average_files_per_second;  // files_visited / elapsed_seconds
+    int worker_threads;               // 扫描线程数
+    int finished;                     // 1 表示扫描已结束 (或被停止)
+};
+
+/**
+ * @brief 扫描结果快照 (不透明句柄)。
+ *        快照创建后内容不再变化，读取时无需加锁，也不会阻塞扫描线程。
+ */
+typedef struct ScanSnapshot ScanSnapshot;
+
+/**
+ * @brief 快照中的一个文件。两个字符串都指向快照内部的存储，在 ReleaseScanSnapshot 之前有效，调用方不要释放。
+ */
+struct ScanSnapshotEntry {
+    const char* directory;  // 所在目录的完整路径
+    const char* name;       // 文件名
+    uint64_t size;          // 文件大小 (字节数)
+};
+
 /**
  * @brief 扫描进度回调函数类型定义
  * 
@@ -59,6 +179,162 @@ struct FileInfo {
  */
 typedef void (*ScanCallback)(const char* file_path, uint64_t file_size, uint64_t total_scanned_size, FileCategory category);
 
+/**
+ * @brief 批量进度中的一个文件
+ */
+struct ScanProgressRecord {
+    const char* path;       // 文件路径，只在回调期间有效
+    uint64_t size;          // 文件大小 (Bytes)
+    FileCategory category;  // 文件所属分类
+};
+
+/**
+ * @brief 批量进度的合计值 (本轮扫描开始以来)
+ */
+struct ScanProgressTotals {
+    uint64_t files_reported;   // 已发现的文件总数
+    uint64_t bytes_reported;   // 已发现的文件总大小 (Bytes)
+    uint64_t records_dropped;  // 因回调处理过慢、队列已满而没有逐条投递的记录数 (已计入上面两项)
+    int finished;              // 1 表示一轮扫描已经结束，这是本轮的最后一批
+};
+
+/**
+ * @brief 批量进度回调函数类型定义，在独立的投递线程中调用。
+ *
+ * @param records 本批文件，count 可能为 0 (例如扫描结束时只投递合计值)
+ * @param count 本批文件数量
+ * @param totals 合计值
+ */
+typedef void (*ScanBatchCallback)(const ScanProgressRecord* records, int count, const ScanProgressTotals* totals);
+
+/**
+ * @brief 特殊类别 (不通过扫描得到) 的大小
+ */
+struct SpecialCategorySizes {
+    uint64_t trash;            // 回收站 (files/ 与 info/)
+    uint64_t thumbnail_cache;  // .cache/thumbnails
+    uint64_t other_app_cache;  // .cache 下除 thumbnails 以外的内容
+    uint64_t dirs_scanned;     // 本次重新列举的目录数
+    uint64_t dirs_from_cache;  // mtime 未变、直接复用缓存结果的目录数
+};
+
+/**
+ * @brief 最近一次搬迁 (MigrateCategories / MoveFiles) 的统计
+ */
+struct MigrationStats {
+    uint64_t files_moved;    // 成功搬迁的文件数 (以下三项之和)
+    uint64_t files_renamed;  // 同一文件系统内直接 rename 的文件数
+    uint64_t files_cloned;   // 通过 reflink (FICLONE) 共享数据块的文件数
+    uint64_t files_copied;   // 通过 copy_file_range 复制数据的文件数
+    uint64_t files_failed;   // 搬迁失败、源文件保留的文件数
+    uint64_t bytes_moved;    // 成功搬迁的总字节数
+    uint64_t bytes_copied;   // 其中实际复制了数据的字节数
+    double seconds;          // 耗时 (秒)
+    double mb_per_second;    // 吞吐量 (bytes_moved / seconds，MB/s)
+};
+
+/**
+ * @brief 异步搬迁任务 (不透明句柄)，由 StartMigrationJob 创建、ReleaseMigrationJob 释放。
+ */
+typedef struct MigrationJob MigrationJob;
+
+/**
+ * @brief 搬迁任务的状态
+ */
+enum MigrationJobState {
+    MIGRATION_JOB_RUNNING   = 0,  // 正在搬迁
+    MIGRATION_JOB_FINISHED  = 1,  // 已完成 (个别文件可能失败，见 files_failed)
+    MIGRATION_JOB_CANCELLED = 2   // 已取消，尚未处理的文件保持原样
+};
+
+/**
+ * @brief 搬迁任务的进度
+ */
+struct MigrationJobProgress {
+    uint64_t files_total;     // 任务启动时快照中的文件数
+    uint64_t files_done;      // 已搬迁的文件数
+    uint64_t files_failed;    // 搬迁失败的文件数
+    uint64_t bytes_total;     // 任务启动时快照中的总字节数
+    uint64_t bytes_done;      // 已传输的字节数 (正在复制的文件按数据块计入)
+    double mb_per_second;     // 当前速率 (MB/s)，约每 0.5 秒更新一次
+    MigrationJobState state;
+};
+
+/**
+ * @brief 重复文件检测结果 (不透明句柄)，由 FindDuplicates 创建、ReleaseDuplicateReport 释放。
+ */
+typedef struct DuplicateReport DuplicateReport;
+
+/**
+ * @brief 一组内容完全相同的文件
+ */
+struct DuplicateGroup {
+    uint64_t file_size;          // 单个文件的大小 (Bytes)
+    uint64_t reclaimable_bytes;  // 只保留一份时可释放的字节数 (file_size * (file_count - 1))
+    uint32_t file_count;         // 组内文件数 (>= 2)
+    FileCategory category;       // 第一个文件所属的分类
+    const char* const* paths;    // file_count 个路径，按字典序排列，在 ReleaseDuplicateReport 之前有效
+};
+
+/**
+ * @brief 重复文件检测的统计，用于确认大多数文件没有被读取
+ */
+struct DuplicateStats {
+    uint64_t files_considered;    // 扫描结果中参与检测的非空文件数
+    uint64_t size_candidates;     // 存在同样大小文件、需要读取首尾 4 KB 的文件数
+    uint64_t edge_candidates;     // 首尾哈希也相同、需要全文哈希的文件数
+    uint64_t files_fully_hashed;  // 实际完成全文哈希的文件数
+    uint64_t bytes_read;          // 读取的总字节数
+    uint64_t groups;              // 重复文件组数
+    uint64_t reclaimable_bytes;   // 所有组可释放的字节数之和
+    double seconds;               // 总耗时 (秒)
+    double hash_mb_per_second;    // 全文哈希阶段的读取吞吐量 (MB/s)
+};
+
+/**
+ * @brief 扫描时建立的目录树统计哪些文件
+ */
+enum DirectoryTreeMode {
+    DIRECTORY_TREE_SCANNED_FILES = 0, // 只统计分类命中的文件，不增加系统调用 (默认)
+    DIRECTORY_TREE_ALL_FILES     = 1  // 统计所有非隐藏的普通文件，每个未分类的文件多一次 stat
+};
+
+/**
+ * @brief 扫描会话的目录树 (不透明句柄)，由 AcquireDirectoryTree 获取、ReleaseDirectoryTree 释放。
+ */
+typedef struct DirectoryTree DirectoryTree;
+
+/**
+ * @brief 目录树中的一个目录，计数包含整棵子树 (隐藏目录不参与扫描，也不在树中)
+ */
+struct DirectoryNode {
+    const char* path;             // 目录的完整路径，在 ReleaseDirectoryTree 之前有效
+    uint64_t bytes;               // 子树中已统计文件的总字节数
+    uint64_t file_count;          // 子树中已统计的文件数
+    uint64_t category_bytes[6];   // 依次为安装包、压缩包、视频、音频、图片、文档的字节数
+    uint32_t subdir_count;        // 直接子目录数
+    int complete;                 // 1 表示整棵子树已扫描完并汇总到本节点；扫描过程中为 0 时计数只是部分结果
+    const void* id;               // 节点标识，传给 GetDirectoryChildren
+};
+
+/**
+ * @brief CleanupCategories 处理缓存和回收站的方式
+ */
+enum CleanupMode {
+    CLEANUP_MODE_IMMEDIATE = 0,  // 同步删除，删除完成后返回 (默认)
+    CLEANUP_MODE_DEFERRED  = 1   // 先移进同一文件系统上的隐藏墓碑目录并统计大小，立即返回，由后台线程低优先级删除
+};
+
+/**
+ * @brief 后台回收 (延迟删除) 的进度
+ */
+struct ReaperProgress {
+    uint64_t bytes_pending;    // 已移进墓碑、尚未删除的字节数
+    uint64_t bytes_reclaimed;  // 本进程中后台已删除的字节数
+    int tombstones_pending;    // 尚未回收完的墓碑数 (每次清理一个)
+    int active;                // 1 表示后台仍在回收
+};
+
 extern "C" {
 
 /**
@@ -75,6 +351,211 @@ API void StartScan(const char* home_path, ScanCallback callback);
  */
 API void StopScan();
 
+/**
+ * @brief 注册批量进度回调，对下一次 StartScan / StartWatch 生效。
+ *        扫描线程只把记录追加到当前批次，由独立的投递线程每积累 max_batch_files 个文件
+ *        或每隔约 max_interval_ms 毫秒调用一次回调，回调的耗时不会拖慢扫描。
+ *        回调处理过慢时扫描不会等待：超出队列上限的批次只计入合计值 (见 ScanProgressTotals::records_dropped)。
+ *        使用批量回调时，建议给 StartScan 传入 NULL 作为逐文件回调。
+ *
+ * @param callback 批量回调，传 NULL 表示取消
+ * @param max_batch_files 每批最多的文件数，<= 0 表示使用默认值 1024
+ * @param max_interval_ms 投递间隔 (毫秒)，<= 0 表示使用默认值 200
+ */
+API void SetScanProgressCallback(ScanBatchCallback callback, int max_batch_files, int max_interval_ms);
+
+/**
+ * @brief 设置扫描使用的工作线程数量，对下一次 StartScan 生效。
+ *        各工作线程维护自己的待扫描目录队列，空闲时从其它线程窃取任务。
+ *        注意：回调函数仍然是串行调用的，但可能来自不同的工作线程。
+ *
+ * @param count 工作线程数量，<= 0 表示使用 CPU 核心数 (默认)
+ */
+API void SetScanWorkerCount(int count);
+
+/**
+ * @brief 选择目录遍历后端，对下一次 StartScan 生效。
+ *
+ * @param backend 见 ScanBackend，默认 SCAN_BACKEND_STD_FILESYSTEM
+ */
+API void SetScanBackend(ScanBackend backend);
+
+/**
+ * @brief 设置扫描策略，对下一次 StartScan / StartWatch 生效。
+ *        后台模式下扫描线程只在 CPU 和磁盘空闲时运行 (nice 19 + IOPRIO_CLASS_IDLE)；
+ *        每处理完一个目录，若目录读取和取大小的延迟明显高于本次扫描的基线，
+ *        或 /proc/pressure/io 显示系统 I/O 拥塞，则按该目录耗时的倍数休眠，拥塞解除后逐步恢复全速。
+ *        扫描会因此变慢，但不会拖慢前台程序。
+ *
+ * @param policy 见 ScanPolicy，默认 SCAN_POLICY_NORMAL
+ */
+API void SetScanPolicy(ScanPolicy policy);
+
+/**
+ * @brief 设置每秒最多检查的目录项数 (文件 + 目录)，对下一次 StartScan / StartWatch 生效，与扫描策略无关。
+ *
+ * @param max_entries_per_second 每秒目录项上限，0 表示不限制 (默认)
+ */
+API void SetScanMaxEntriesPerSecond(uint64_t max_entries_per_second);
+
+/**
+ * @brief 设置每个设备上同时读取目录的扫描线程数，对下一次 StartScan / StartWatch 生效。
+ *        主目录下挂载了其它磁盘时，每个块设备有各自的任务队列，设备类型取自 /sys/block/<设备>/queue/rotational；
+ *        机械盘上的线程数受限时，其余线程继续扫描其它设备，慢速磁盘不会拖住整个扫描。
+ *        tmpfs、网络文件系统等没有块设备的文件系统不受限制。
+ *
+ * @param rotational 机械盘 (包括报告为旋转介质的 U 盘) 的线程数，<= 0 表示使用默认值 2
+ * @param non_rotational 固态盘的线程数，<= 0 表示不限制 (默认，等于扫描线程数)
+ */
+API void SetScanDeviceConcurrency(int rotational, int non_rotational);
+
+/**
+ * @brief 设置扫描是否跨越文件系统边界 (类似 find -xdev)，对下一次 StartScan / StartWatch 生效。
+ *        启用后不进入主目录下其它设备的挂载点；同一设备的 bind mount 仍会扫描。
+ *
+ * @param enable 非 0 表示不跨越，默认 0
+ */
+API void SetScanOneFileSystem(int enable);
+
+/**
+ * @brief 设置目录项的处理顺序，对下一次 StartScan / StartWatch 生效。
+ *        按 inode 排序时先读完整个目录，文件按 inode 升序取大小，
+ *        子目录也按 inode 升序进入，机械盘上的 stat 不再在 inode 表中来回寻道。
+ *        std::filesystem 不提供 inode 号，按 inode 排序的目录总是使用 getdents64 后端读取。
+ *
+ * @param order 见 ScanInodeOrder，默认 SCAN_INODE_ORDER_AUTO
+ */
+API void SetScanInodeOrder(ScanInodeOrder order);
+
+/**
+ * @brief 添加一条扫描规则，对下一次 StartScan / StartWatch 以及 CleanupCategories /
+ *        GetSpecialCategorySize / GetSpecialCategorySizes 生效。
+ *        规则在目录入队时按目录求值一次：被完全排除的子树不会被读取。同一目录命中多条规则时后添加的优先。
+ *        pattern 的形式：
+ *          - 目录名：不含 '/'，如 "node_modules"、"*.git"，匹配任意深度的同名目录，可以含通配符 * ? [...]；
+ *          - 路径："~/a/b"、主目录下的绝对路径或相对主目录的 "a/b"，匹配该目录及其下所有内容；
+ *          - 路径通配：含 '/' 且含通配符，如 "~/work/v[0-9]/build"，匹配相对主目录的完整路径，分量 "**" 匹配任意层目录。
+ *        通配模式在添加时编译为自动机：含通配符的单个名字最多 63 个记号 (字符、? 、* 或 [...])；
+ *        所有路径通配规则的分量数 (每条规则另加 1) 合计不超过 64。超出时返回 -1。
+ *        隐藏目录默认不扫描，可以用路径形式的包含规则指定其下要扫描的目录 (如 "~/.local/share/Trash")。
+ *        对 ~/.cache 的直接子目录添加排除规则后，清理缓存时保留这些目录 ("thumbnails" 对应缩略图缓存类别)。
+ *
+ * @param pattern 规则模式 (UTF-8)
+ * @param categories FileCategory 的组合，0 表示全部类别
+ * @param action 见 ScanRuleAction
+ * @return 0 成功，-1 参数无效或超出通配模式的上限
+ */
+API int AddScanRule(const char* pattern, unsigned int categories, ScanRuleAction action);
+
+/**
+ * @brief 清除通过 AddScanRule 添加的规则，恢复默认规则 (搬迁类别排除 "~/MoveFiles")。
+ */
+API void ResetScanRules(void);
+
+/**
+ * @brief 设置隐藏文件和目录的扫描方式，对下一次扫描生效。
+ *
+ * @param policy 见 ScanHiddenPolicy，默认 SCAN_HIDDEN_SKIP
+ */
+API void SetScanHiddenPolicy(ScanHiddenPolicy policy);
+
+/**
+ * @brief 获取当前 (或最近一次) 扫描的系统调用统计，扫描过程中也可以调用。
+ *
+ * @param stats [out] 用于接收统计数据的结构体指针
+ */
+API void GetScanSyscallStats(ScanSyscallStats* stats);
+
+/**
+ * @brief 获取当前 (或最近一次) 扫描的遥测数据，扫描过程中可随时调用。
+ *
+ * @param telemetry [out] 用于接收数据的结构体指针；还没有扫描过时全部为 0
+ */
+API void GetScanTelemetry(ScanTelemetry* telemetry);
+
+/**
+ * @brief 以 JSON 导出 GetScanTelemetry 和 GetScanSyscallStats 的数据，便于附在问题报告中。
+ *
+ * @param buffer 缓冲区，可以为 NULL (只查询长度)
+ * @param buffer_size 缓冲区大小，需要大于 JSON 长度才会写入
+ * @return int JSON 的长度 (不含结尾的 '\0')
+ */
+API int ExportScanTelemetryJson(char* buffer, uint64_t buffer_size);
+
+/**
+ * @brief 设置持久化扫描索引文件的路径，对下一次 StartScan 生效。
+ *        启用后每次扫描结束都会把目录树 (各目录的 mtime/ctime 及其下已分类的文件) 写入该文件，
+ *        下次扫描时 mmap 读取，时间戳未变的目录只需一次 stat 即可复用上次的结果。
+ *        注意：只修改文件内容不会改变目录时间戳，此时复用的文件大小可能不是最新值。
+ *        主目录或扩展名配置 (SetExtensions) 变化后索引自动失效；索引损坏 (校验和或记录内容无效) 时整体作废并完整扫描。
+ *        请不要把索引放在 ~/.cache 下，否则清理应用缓存时会被一并删除。
+ *
+ * @param index_path 索引文件路径 (例如 "/home/user/.local/state/disk-cleaner/scan.idx")，传 NULL 或空串表示禁用 (默认)
+ */
+API void SetScanIndexPath(const char* index_path);
+
+/**
+ * @brief 启用/关闭基于 io_uring 的批量 statx，对下一次 StartScan 生效，仅对 SCAN_BACKEND_GETDENTS 有效。
+ *        分类命中的文件会攒成批次 (每批最多 256 个) 一次性提交，
+ *        内核不支持 io_uring 或 IORING_OP_STATX 时自动退回逐个 fstatat。
+ *
+ * @param enable 非 0 表示启用，默认关闭
+ */
+API void SetScanIoUring(int enable);
+
+/**
+ * @brief 检查当前系统是否可以使用 io_uring。
+ *
+ * @return int 1 表示可用，0 表示不可用
+ */
+API int IsIoUringSupported();
+
+/**
+ * @brief 启动监视模式：先进行一次完整扫描，之后订阅主目录下的文件系统变化事件并增量更新扫描结果
+ *        (创建/移入时添加，删除/移出时移除，写入完成后更新大小)。
+ *        监视模式下 StartScan 不再生效；新增或变化的文件同样通过 callback 通知。
+ *        inotify watch 数量达到上限时自动降级为定期增量重扫。
+ *
+ * @param home_path 要监视的用户主目录路径
+ * @param callback 回调函数，可以为 NULL
+ * @return int 0 表示成功，-1 表示已有扫描或监视在进行中
+ */
+API int StartWatch(const char* home_path, ScanCallback callback);
+
+/**
+ * @brief 停止监视模式，等待监视线程退出。
+ */
+API void StopWatch();
+
+/**
+ * @brief 获取监视模式的当前工作方式。
+ *
+ * @return int 见 WatchMode
+ */
+API int GetWatchMode();
+
+/**
+ * @brief 设置监视模式降级后定期重扫的间隔，默认 60 秒。
+ *
+ * @param seconds 间隔秒数
+ */
+API void SetWatchRescanInterval(int seconds);
+
+/**
+ * @brief 获取扫描结果的版本号。结果每发生一次变化 (扫描开始/结束、监视事件、清理、搬迁) 版本号都会增加，
+ *        调用方可以在版本号未变时跳过 GetScanResults。
+ *
+ * @return uint64_t 当前版本号
+ */
+API uint64_t GetResultsGeneration();
+
+/**
+ * @brief 获取扫描结果的内存占用统计，扫描过程中也可以调用。
+ *
+ * @param stats [out] 用于接收统计数据的结构体指针
+ */
+API void GetScanMemoryStats(ScanMemoryStats* stats);
+
 /**
  * @brief 检查扫描是否已完成
  * 
@@ -83,7 +564,8 @@ API void StopScan();
 API int IsScanFinished();
 
 /**
- * @brief 获取扫描结果
+ * @brief 获取扫描结果 (兼容接口)。基于 AcquireScanSnapshot 的最新快照拷贝出完整路径，
+ *        结果较多时建议直接使用快照接口以避免拷贝。
  * 
  * @param category 要获取的文件分类
  * @param count [out] 用于接收文件数量的指针
@@ -100,7 +582,91 @@ API FileInfo* GetScanResults(FileCategory category, int* count);
 API void FreeScanResults(FileInfo* results, int count);
 
 /**
- * @brief 将指定文件列表移动到目标目录
+ * @brief 设置每个分类跟踪的最大文件数量 K (默认 100)。
+ *        扫描时每个分类在各工作线程的分片上维护一个大小为 K 的小顶堆，不需要对全部结果排序。
+ *
+ * @param count 每个分类保留的文件数量，<= 0 表示不跟踪
+ */
+API void SetLargestFileCount(int count);
+
+/**
+ * @brief 获取某个分类中最大的若干个文件，按文件大小从大到小排列。
+ *        扫描过程中也可调用，返回截至目前已发现的最大文件。
+ *
+ * @param category 要获取的文件分类
+ * @param max_count 最多返回的文件数量，超过 SetLargestFileCount 设置的 K 时只返回 K 个
+ * @param count [out] 实际返回的文件数量
+ * @return FileInfo* 使用后需要调用 FreeScanResults 释放
+ */
+API FileInfo* GetLargestFiles(FileCategory category, int max_count, int* count);
+
+/**
+ * @brief 获取某个分类当前结果的快照，不拷贝任何路径。
+ *        扫描过程中每积累一批文件 (或每隔 100ms) 发布一次新快照，扫描结束、监视事件、清理和搬迁后立即发布；
+ *        已获取的快照不受之后结果变化的影响。
+ *
+ * @param category 要获取的单个文件分类
+ * @return ScanSnapshot* 快照句柄，使用后需要调用 ReleaseScanSnapshot 释放；不是扫描得到的分类返回 NULL
+ */
+API ScanSnapshot* AcquireScanSnapshot(FileCategory category);
+
+/**
+ * @brief 释放快照句柄。
+ */
+API void ReleaseScanSnapshot(ScanSnapshot* snapshot);
+
+/**
+ * @brief 获取快照中的文件数量。
+ */
+API uint64_t GetScanSnapshotCount(const ScanSnapshot* snapshot);
+
+/**
+ * @brief 获取快照中所有文件的总大小 (字节数)。
+ */
+API uint64_t GetScanSnapshotTotalSize(const ScanSnapshot* snapshot);
+
+/**
+ * @brief 获取快照发布时的结果版本号 (见 GetResultsGeneration)。
+ */
+API uint64_t GetScanSnapshotGeneration(const ScanSnapshot* snapshot);
+
+/**
+ * @brief 按下标读取快照中的一个文件。
+ *
+ * @param snapshot 快照句柄
+ * @param index 下标，范围 [0, GetScanSnapshotCount)
+ * @param entry [out] 用于接收文件信息的结构体指针
+ * @return int 0 表示成功，-1 表示下标越界
+ */
+API int GetScanSnapshotEntry(const ScanSnapshot* snapshot, uint64_t index, ScanSnapshotEntry* entry);
+
+/**
+ * @brief 从 start 开始批量读取快照中的文件，可用于分页或顺序遍历。
+ *
+ * @param snapshot 快照句柄
+ * @param start 起始下标
+ * @param entries [out] 调用方提供的数组
+ * @param max_entries 数组容量
+ * @return uint64_t 实际写入的数量，为 0 表示已经读完
+ */
+API uint64_t GetScanSnapshotEntries(const ScanSnapshot* snapshot, uint64_t start, ScanSnapshotEntry* entries,
+                                    uint64_t max_entries);
+
+/**
+ * @brief 把快照中一个文件的完整路径拷贝到调用方的缓冲区。
+ *
+ * @param snapshot 快照句柄
+ * @param index 下标
+ * @param buffer 缓冲区，可以为 NULL (只查询长度)
+ * @param buffer_size 缓冲区大小，需要大于路径长度才会写入
+ * @return int 路径长度 (不含结尾的 '\0')，下标越界时返回 -1
+ */
+API int CopyScanSnapshotPath(const ScanSnapshot* snapshot, uint64_t index, char* buffer, uint64_t buffer_size);
+
+/**
+ * @brief 将指定文件列表移动到目标目录。
+ *        依次尝试 rename、reflink (FICLONE) 和 copy_file_range 复制 (保留权限和时间戳) 后删除源文件，
+ *        跨磁盘搬迁也能完成；多个文件并发复制，每个目标设备上同时复制的文件数见 SetMigrationConcurrency。
  * 
  * @param file_paths 要移动的文件路径数组
  * @param count 文件数量
@@ -118,6 +684,15 @@ API int MoveFiles(const char** file_paths, int count, const char* destination_di
  */
 API void SetExtensions(FileCategory category, const char* extensions[], int count);
 
+/**
+ * @brief 按当前的扩展名配置对文件名进行分类 (不访问文件系统，与扫描时的规则完全一致)。
+ *        匹配不区分大小写；压缩包后缀 (如 ".tar.gz") 优先于扩展名。
+ *
+ * @param file_name 文件名或路径 (只看末尾部分)
+ * @return FileCategory 所属分类，不属于任何分类时返回 CATEGORY_UNKNOWN
+ */
+API FileCategory ClassifyFileName(const char* file_name);
+
 /**
  * @brief 获取特殊类别垃圾的大小（这些不是通过全盘扫描得到的）。
  * 
@@ -126,6 +701,15 @@ API void SetExtensions(FileCategory category, const char* extensions[], int coun
  */
 API uint64_t GetSpecialCategorySize(FileCategory category);
 
+/**
+ * @brief 一次并行遍历同时获取回收站、缩略图缓存和其他应用缓存的大小。
+ *        结果按目录缓存，并用目录的修改时间校验，重复调用时只需对每个目录做一次 fstat。
+ *        只有目录 mtime 变化 (文件增删、改名) 才会重新统计，原地改写文件内容不会被发现。
+ *
+ * @param sizes 输出各类别大小。
+ */
+API void GetSpecialCategorySizes(SpecialCategorySizes* sizes);
+
 /**
  * @brief 根据提供的位掩码清理一个或多个文件/垃圾类别。
  *        这是所有清理操作的统一入口。
@@ -134,16 +718,39 @@ API uint64_t GetSpecialCategorySize(FileCategory category);
  */
 API uint64_t CleanupCategories(unsigned int category_mask);
 
+/**
+ * @brief 设置缓存 (缩略图、应用缓存) 和回收站的清理方式，默认 CLEANUP_MODE_IMMEDIATE。
+ *        延迟模式下 CleanupCategories 只做 rename 和大小统计，返回值是即将释放的字节数；
+ *        进程退出或崩溃时未删完的墓碑会在下次加载本库时继续回收。
+ */
+API void SetCleanupMode(CleanupMode mode);
+
+/**
+ * @brief 获取后台回收的进度。
+ */
+API void GetReaperProgress(ReaperProgress* progress);
+
+/**
+ * @brief 等待后台回收完成。
+ *
+ * @param timeout_ms 最长等待的毫秒数，小于 0 表示一直等待。
+ * @return int 1 表示所有墓碑已回收，0 表示超时。
+ */
+API int WaitForReaper(int timeout_ms);
+
 /**
  * @brief 清理指定文件夹下的所有可删除文件。
+ *        单次后序遍历：普通文件和符号链接随列举即删，子目录清空后立即删除，
+ *        子目录分发给扫描工作线程数 (SetScanWorkerCount) 个线程并行处理。文件夹本身保留。
  * 
- * @param dir_path 要清理的文件夹的绝对路径。
+ * @param dir_path 要清理的文件夹的绝对路径，必须位于 HOME 目录下。
  * @return uint64_t 返回清理的总字节数。
  */
 API uint64_t CleanupDirectory(const char* dir_path);
 
 /**
- * @brief 根据提供的位掩码搬迁一个或多个文件类别。
+ * @brief 根据提供的位掩码搬迁一个或多个文件类别。搬迁方式同 MoveFiles，完成后打印吞吐量。
+ *        同步接口，等价于 StartMigrationJob (不限速) + ReleaseMigrationJob；搬迁期间不阻塞结果读取。
  * 
  * @param category_mask 使用 | 组合的 FileCategory 枚举值。
  * @param destination_dir 目标目录的绝对路径。
@@ -151,6 +758,132 @@ API uint64_t CleanupDirectory(const char* dir_path);
  */
 API int MigrateCategories(unsigned int category_mask, const char* destination_dir);
 
+/**
+ * @brief 设置搬迁时每个目标设备上同时处理的文件数上限，默认 4。
+ */
+API void SetMigrationConcurrency(int per_device);
+
+/**
+ * @brief 获取最近一次搬迁的统计 (文件数、字节数、吞吐量)。
+ */
+API void GetLastMigrationStats(MigrationStats* stats);
+
+/**
+ * @brief 启动异步搬迁任务并立即返回。
+ *        文件列表取自调用时的扫描结果快照，搬迁期间不持有结果锁；完成后已搬走的文件从扫描结果中移除。
+ *
+ * @param category_mask 使用 | 组合的可搬迁类别 (视频、音频、图片、文档)。
+ * @param destination_dir 目标目录的绝对路径，不存在时自动创建。
+ * @param max_bytes_per_second 复制带宽上限 (字节/秒)，0 表示不限速；rename 和 reflink 不受限制。
+ * @return MigrationJob* 任务句柄，目标目录无法创建时返回 NULL。
+ */
+API MigrationJob* StartMigrationJob(unsigned int category_mask, const char* destination_dir,
+                                    uint64_t max_bytes_per_second);
+
+/**
+ * @brief 获取任务进度 (已完成的文件数、字节数和当前速率)。
+ */
+API void GetMigrationJobProgress(MigrationJob* job, MigrationJobProgress* progress);
+
+/**
+ * @brief 调整正在运行的任务的带宽上限，0 表示不限速。
+ */
+API void SetMigrationJobBandwidthLimit(MigrationJob* job, uint64_t max_bytes_per_second);
+
+/**
+ * @brief 取消任务：不再开始新文件，正在复制的文件放弃并删除临时文件，源文件保持原样。
+ */
+API void CancelMigrationJob(MigrationJob* job);
+
+/**
+ * @brief 等待任务结束。
+ *
+ * @param timeout_ms 最长等待的毫秒数，小于 0 表示一直等待。
+ * @return int 1 表示任务已结束，0 表示超时。
+ */
+API int WaitMigrationJob(MigrationJob* job, int timeout_ms);
+
+/**
+ * @brief 等待任务结束并释放句柄。需要立即结束时先调用 CancelMigrationJob。
+ */
+API void ReleaseMigrationJob(MigrationJob* job);
+
+/**
+ * @brief 在当前扫描结果中查找内容重复的文件 (同步执行)。
+ *        先按大小分组，再比较首尾 4 KB 的哈希，只有两者都相同的文件才会被完整读取 (mmap + SIMD 哈希)。
+ *        同一文件的多个硬链接不算重复。
+ *
+ * @param category_mask 使用 | 组合的扫描类别 (安装包、压缩包、视频、音频、图片、文档)。
+ * @return DuplicateReport* 检测结果，组按可释放字节数从大到小排列；用完后调用 ReleaseDuplicateReport。
+ */
+API DuplicateReport* FindDuplicates(unsigned int category_mask);
+
+/**
+ * @brief 释放重复文件检测结果。
+ */
+API void ReleaseDuplicateReport(DuplicateReport* report);
+
+/**
+ * @brief 获取重复文件组数。
+ */
+API uint64_t GetDuplicateGroupCount(const DuplicateReport* report);
+
+/**
+ * @brief 获取第 index 个重复文件组。
+ *
+ * @return int 0 表示成功，下标越界时返回 -1
+ */
+API int GetDuplicateGroup(const DuplicateReport* report, uint64_t index, DuplicateGroup* group);
+
+/**
+ * @brief 获取重复文件检测的统计。
+ */
+API void GetDuplicateStats(const DuplicateReport* report, DuplicateStats* stats);
+
+/**
+ * @brief 设置目录树统计的文件范围，对下一次 StartScan 生效。
+ *
+ * @param mode 见 DirectoryTreeMode，默认 DIRECTORY_TREE_SCANNED_FILES
+ */
+API void SetDirectoryTreeMode(DirectoryTreeMode mode);
+
+/**
+ * @brief 获取当前扫描会话的目录树。扫描时每个文件只记入所在目录，子树扫描完毕后才把汇总加到父目录，
+ *        因此扫描过程中也可以查询 (未完成的节点 complete 为 0)；监视模式、清理和搬迁的变化会同步到树中。
+ *
+ * @return DirectoryTree* 用完后调用 ReleaseDirectoryTree；还没有扫描过时返回 NULL
+ */
+API DirectoryTree* AcquireDirectoryTree();
+
+/**
+ * @brief 释放目录树句柄。
+ */
+API void ReleaseDirectoryTree(DirectoryTree* tree);
+
+/**
+ * @brief 获取目录树的根节点 (即扫描的主目录)。
+ *
+ * @return int 0 表示成功，-1 表示参数无效
+ */
+API int GetDirectoryTreeRoot(const DirectoryTree* tree, DirectoryNode* node);
+
+/**
+ * @brief 按完整路径查找目录节点。
+ *
+ * @return int 0 表示成功，-1 表示路径不在树中
+ */
+API int FindDirectoryNode(const DirectoryTree* tree, const char* path, DirectoryNode* node);
+
+/**
+ * @brief 获取某个目录的直接子目录，按 bytes 从大到小排列。只访问该目录的子节点，不遍历更深的子树。
+ *
+ * @param id 父目录的 DirectoryNode::id
+ * @param children [out] 接收子目录的数组
+ * @param max_count 数组容量，子目录更多时只返回最大的 max_count 个
+ * @return int 写入的子目录数
+ */
+API int GetDirectoryChildren(const DirectoryTree* tree, const void* id, DirectoryNode* children, int max_count);
+
 /**
  * @brief 清理扫描器资源，等待后台线程结束。必须在程序退出前调用。
  */